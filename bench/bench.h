@@ -0,0 +1,98 @@
+/*
+ * bench.h
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ * 
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ * 
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BENCH_H
+#define BENCH_H 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomickit/atomic.h>
+
+/* Monotonic time in nanoseconds */
+static inline double bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+/* Print one result line: name, threads, total operations and elapsed ns */
+static inline void bench_report(const char *name, int nthreads,
+				double nops, double ns) {
+	printf("%-32s %3d threads %12.0f ops %10.2f ns/op %10.2f Mops/s\n",
+	       name, nthreads, nops, ns / nops, nops * 1e3 / ns);
+	fflush(stdout);
+}
+
+/* Integer argument i of the command line, or def if absent */
+static inline long bench_arg(int argc, char **argv, int i, long def) {
+	return argc > i ? strtol(argv[i], NULL, 0) : def;
+}
+
+/* Run fn(arg, thread_number) on nthreads threads, all starting together;
+ * returns elapsed ns. */
+static inline double bench_threads(int nthreads, void (*fn)(void *, int),
+				   void *arg) {
+	struct bench_thread {
+		pthread_t thread;
+		void (*fn)(void *, int);
+		void *arg;
+		int n;
+		atomic_int *go;
+	} *threads;
+	atomic_int go = ATOMIC_VAR_INIT(0);
+	double start, end;
+	int i;
+	void *run(void *p) {
+		struct bench_thread *t = p;
+		while (ak_load(t->go, mo_acquire) == 0) {
+			cpu_yield();
+		}
+		t->fn(t->arg, t->n);
+		return NULL;
+	}
+
+	threads = calloc(nthreads, sizeof(struct bench_thread));
+	if (threads == NULL) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < nthreads; i++) {
+		threads[i].fn = fn;
+		threads[i].arg = arg;
+		threads[i].n = i;
+		threads[i].go = &go;
+		if (pthread_create(&threads[i].thread, NULL, run,
+				   &threads[i]) != 0) {
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+	start = bench_now();
+	ak_store(&go, 1, mo_release);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i].thread, NULL);
+	}
+	end = bench_now();
+	free(threads);
+	return end - start;
+}
+
+#endif /* ! BENCH_H */
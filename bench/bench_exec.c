@@ -0,0 +1,148 @@
+/*
+ * bench_exec.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include <atomickit/exec.h>
+#include "bench.h"
+
+/* usage: bench_exec [items] [max workers] */
+
+/* below this, a range is sorted in place with qsort */
+#define LEAF 8192
+
+static aexec_t exec;
+static int *data;
+static int *scratch;
+static int *orig;
+static long nitems;
+
+struct sort_args {
+	long start;
+	long end;
+};
+
+static int compar(const void *a, const void *b) {
+	int x = *(const int *) a;
+	int y = *(const int *) b;
+	return (x > y) - (x < y);
+}
+
+/* Merge sort data[start..end), forking the left half off as a task and
+ * merging through scratch. */
+static void sort_task(void *arg) {
+	struct sort_args *args = arg;
+	struct sort_args left, right;
+	aexec_group_t group;
+	long i, j, k;
+	if (args->end - args->start <= LEAF) {
+		qsort(data + args->start, args->end - args->start,
+		      sizeof(int), compar);
+		return;
+	}
+	left.start = args->start;
+	left.end = args->start + (args->end - args->start) / 2;
+	right.start = left.end;
+	right.end = args->end;
+	aexec_group_init(&group);
+	if (aexec_submit(&exec, &group, sort_task, &left) != 0) {
+		perror("aexec_submit");
+		exit(EXIT_FAILURE);
+	}
+	sort_task(&right);
+	aexec_wait_group(&exec, &group);
+	i = left.start;
+	j = right.start;
+	k = args->start;
+	while (i < left.end && j < right.end) {
+		scratch[k++] = data[i] <= data[j] ? data[i++] : data[j++];
+	}
+	while (i < left.end) {
+		scratch[k++] = data[i++];
+	}
+	while (j < right.end) {
+		scratch[k++] = data[j++];
+	}
+	memcpy(data + args->start, scratch + args->start,
+	       sizeof(int) * (args->end - args->start));
+}
+
+static void check_sorted(void) {
+	long i;
+	for (i = 1; i < nitems; i++) {
+		if (data[i - 1] > data[i]) {
+			fprintf(stderr, "not sorted at %ld\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	aexec_group_t group = AEXEC_GROUP_VAR_INIT;
+	struct sort_args args;
+	double start;
+	int maxworkers;
+	int nworkers;
+	long i;
+
+	nitems = bench_arg(argc, argv, 1, 10000000);
+	maxworkers = bench_arg(argc, argv, 2, 8);
+
+	data = malloc(sizeof(int) * nitems);
+	scratch = malloc(sizeof(int) * nitems);
+	orig = malloc(sizeof(int) * nitems);
+	if (data == NULL || scratch == NULL || orig == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	srand(1);
+	for (i = 0; i < nitems; i++) {
+		orig[i] = rand();
+	}
+
+	/* the baseline: one thread, no executor */
+	memcpy(data, orig, sizeof(int) * nitems);
+	start = bench_now();
+	qsort(data, nitems, sizeof(int), compar);
+	bench_report("qsort", 1, nitems, bench_now() - start);
+
+	for (nworkers = 1; nworkers <= maxworkers; nworkers *= 2) {
+		if (aexec_init(&exec, nworkers) != 0) {
+			perror("aexec_init");
+			exit(EXIT_FAILURE);
+		}
+		memcpy(data, orig, sizeof(int) * nitems);
+		args.start = 0;
+		args.end = nitems;
+		start = bench_now();
+		if (aexec_submit(&exec, &group, sort_task, &args) != 0) {
+			perror("aexec_submit");
+			exit(EXIT_FAILURE);
+		}
+		aexec_wait_group(&exec, &group);
+		bench_report("aexec merge sort", nworkers, nitems,
+			     bench_now() - start);
+		check_sorted();
+		aexec_destroy(&exec);
+	}
+
+	free(data);
+	free(scratch);
+	free(orig);
+	return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * bench_pq.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <atomickit/rcp.h>
+#include <atomickit/pq.h>
+#include "bench.h"
+
+/* usage: bench_pq [operations per thread] [max threads] [initial size] */
+
+/* one operation in this many has its latency recorded */
+#define SAMPLE 16
+
+static long niters;
+static long nprefill;
+
+static struct arcp_region item;
+static apq_t pq;
+
+/* Per-thread latency samples, in ns */
+struct samples {
+	double *insert;
+	double *delete_min;
+	long ninsert;
+	long ndelete_min;
+};
+
+static struct samples *samples;
+
+static uint64_t xorshift(uint64_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+/* Each thread alternates at random between inserting at a random priority
+ * and deleting the minimum, against a queue of about nprefill items. */
+static void mixed_pass(void *arg __attribute__((unused)), int n) {
+	struct samples *s = &samples[n];
+	struct arcp_region *region;
+	uint64_t rand;
+	double start;
+	long i;
+	rand = 0x9e3779b97f4a7c15ULL * (n + 1);
+	s->ninsert = 0;
+	s->ndelete_min = 0;
+	for (i = 0; i < niters; i++) {
+		start = i % SAMPLE == 0 ? bench_now() : 0;
+		if (xorshift(&rand) & 1) {
+			if (apq_insert(&pq, xorshift(&rand) >> 16, &item)
+			    != 0) {
+				perror("apq_insert");
+				exit(EXIT_FAILURE);
+			}
+			if (start != 0) {
+				s->insert[s->ninsert++] = bench_now() - start;
+			}
+		} else {
+			region = apq_delete_min(&pq, NULL);
+			if (start != 0) {
+				s->delete_min[s->ndelete_min++] =
+					bench_now() - start;
+			}
+			arcp_release(region);
+		}
+	}
+}
+
+static int compar(const void *a, const void *b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+/* Print the median and tail of the latencies of one kind of operation. */
+static void report_latency(const char *name, int nthreads,
+			   int insert) {
+	double *all;
+	long n, i, k;
+	all = malloc(sizeof(double) * (niters / SAMPLE + 1) * nthreads);
+	if (all == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	n = 0;
+	for (i = 0; i < nthreads; i++) {
+		for (k = 0; k < (insert ? samples[i].ninsert
+				 : samples[i].ndelete_min); k++) {
+			all[n++] = insert ? samples[i].insert[k]
+				: samples[i].delete_min[k];
+		}
+	}
+	if (n > 0) {
+		qsort(all, n, sizeof(double), compar);
+		printf("%-32s %3d threads %10.0f ns p50 %10.0f ns p99"
+		       " %10.0f ns p99.9\n", name, nthreads, all[n / 2],
+		       all[n * 99 / 100], all[n * 999 / 1000]);
+		fflush(stdout);
+	}
+	free(all);
+}
+
+static void run(int nthreads) {
+	struct arcp_region *region;
+	double ns;
+	long i;
+	if (apq_init(&pq) != 0) {
+		perror("apq_init");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < nprefill; i++) {
+		if (apq_insert(&pq, i * 2654435761U % (nprefill * 4), &item)
+		    != 0) {
+			perror("apq_insert");
+			exit(EXIT_FAILURE);
+		}
+	}
+	ns = bench_threads(nthreads, mixed_pass, NULL);
+	bench_report("apq insert/delete_min", nthreads,
+		     (double) niters * nthreads, ns);
+	report_latency("apq insert latency", nthreads, 1);
+	report_latency("apq delete_min latency", nthreads, 0);
+	while ((region = apq_delete_min(&pq, NULL)) != NULL) {
+		arcp_release(region);
+	}
+	apq_destroy(&pq);
+}
+
+int main(int argc, char **argv) {
+	int maxthreads;
+	int nthreads;
+	int i;
+
+	niters = bench_arg(argc, argv, 1, 1000000);
+	maxthreads = bench_arg(argc, argv, 2, 8);
+	nprefill = bench_arg(argc, argv, 3, 1000);
+
+	arcp_region_init(&item, NULL);
+	samples = calloc(maxthreads, sizeof(struct samples));
+	if (samples == NULL) {
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < maxthreads; i++) {
+		samples[i].insert = malloc(sizeof(double)
+					   * (niters / SAMPLE + 1));
+		samples[i].delete_min = malloc(sizeof(double)
+					       * (niters / SAMPLE + 1));
+		if (samples[i].insert == NULL
+		    || samples[i].delete_min == NULL) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+		run(nthreads);
+	}
+
+	for (i = 0; i < maxthreads; i++) {
+		free(samples[i].insert);
+		free(samples[i].delete_min);
+	}
+	free(samples);
+	return 0;
+}
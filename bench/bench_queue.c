@@ -0,0 +1,204 @@
+/*
+ * bench_queue.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <sched.h>
+#include <atomickit/rcp.h>
+#include <atomickit/queue.h>
+#include <atomickit/ring.h>
+#include <atomickit/faaq.h>
+#include <atomickit/multiqueue.h>
+#include "bench.h"
+
+/* usage: bench_queue [items per producer] [max threads] [ring size]
+ *                    [multi-queue shards, 0 for one per processor] */
+
+#define BATCH 16
+
+static long niters;
+static int nproducers;
+
+static struct arcp_region item;
+static aqueue_t queue;
+static aring_t ring;
+static afaaq_t faaq;
+static amultiqueue_t mq;
+static atomic_long nconsumed;
+
+/* Each pass moves niters items per producer from the producers (odd
+ * threads) to the consumers (even threads), who stop once all of them have
+ * been consumed. */
+
+static void aqueue_pass(void *arg __attribute__((unused)), int n) {
+	struct arcp_region *region;
+	long i;
+	if (n % 2) {
+		for (i = 0; i < niters; i++) {
+			if (aqueue_enq(&queue, &item) != 0) {
+				perror("aqueue_enq");
+				exit(EXIT_FAILURE);
+			}
+		}
+		return;
+	}
+	while (ak_load(&nconsumed, mo_relaxed) < niters * nproducers) {
+		region = aqueue_deq(&queue);
+		if (region == NULL) {
+			sched_yield();
+			continue;
+		}
+		ak_ldadd(&nconsumed, 1, mo_relaxed);
+		arcp_release(region);
+	}
+}
+
+static void aqueue_batch_pass(void *arg __attribute__((unused)), int n) {
+	struct arcp_region *regions[BATCH];
+	long i;
+	size_t k;
+	if (n % 2) {
+		for (k = 0; k < BATCH; k++) {
+			regions[k] = &item;
+		}
+		for (i = 0; i < niters; i += BATCH) {
+			if (aqueue_enq_n(&queue, regions, BATCH) != 0) {
+				perror("aqueue_enq_n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		return;
+	}
+	while (ak_load(&nconsumed, mo_relaxed) < niters * nproducers) {
+		k = aqueue_deq_n(&queue, regions, BATCH);
+		if (k == 0) {
+			sched_yield();
+			continue;
+		}
+		ak_ldadd(&nconsumed, k, mo_relaxed);
+		arcp_release_n(regions, k);
+	}
+}
+
+static void aring_pass(void *arg __attribute__((unused)), int n) {
+	struct arcp_region *region;
+	long i;
+	if (n % 2) {
+		for (i = 0; i < niters; i++) {
+			while (!aring_try_enq(&ring, &item)) {
+				sched_yield();
+			}
+		}
+		return;
+	}
+	while (ak_load(&nconsumed, mo_relaxed) < niters * nproducers) {
+		region = aring_try_deq(&ring);
+		if (region == NULL) {
+			sched_yield();
+			continue;
+		}
+		ak_ldadd(&nconsumed, 1, mo_relaxed);
+		arcp_release(region);
+	}
+}
+
+static void afaaq_pass(void *arg __attribute__((unused)), int n) {
+	struct arcp_region *region;
+	long i;
+	if (n % 2) {
+		for (i = 0; i < niters; i++) {
+			if (afaaq_enq(&faaq, &item) != 0) {
+				perror("afaaq_enq");
+				exit(EXIT_FAILURE);
+			}
+		}
+		return;
+	}
+	while (ak_load(&nconsumed, mo_relaxed) < niters * nproducers) {
+		region = afaaq_deq(&faaq);
+		if (region == NULL) {
+			sched_yield();
+			continue;
+		}
+		ak_ldadd(&nconsumed, 1, mo_relaxed);
+		arcp_release(region);
+	}
+}
+
+static void amultiqueue_pass(void *arg __attribute__((unused)), int n) {
+	struct arcp_region *region;
+	long i;
+	if (n % 2) {
+		for (i = 0; i < niters; i++) {
+			if (amultiqueue_enq(&mq, &item) != 0) {
+				perror("amultiqueue_enq");
+				exit(EXIT_FAILURE);
+			}
+		}
+		return;
+	}
+	while (ak_load(&nconsumed, mo_relaxed) < niters * nproducers) {
+		region = amultiqueue_deq(&mq);
+		if (region == NULL) {
+			sched_yield();
+			continue;
+		}
+		ak_ldadd(&nconsumed, 1, mo_relaxed);
+		arcp_release(region);
+	}
+}
+
+static void run(const char *name, void (*fn)(void *, int), int nthreads) {
+	double ns;
+	nproducers = nthreads / 2;
+	ak_store(&nconsumed, 0, mo_relaxed);
+	ns = bench_threads(nthreads, fn, NULL);
+	/* an operation is one enqueue or one dequeue */
+	bench_report(name, nthreads, 2.0 * niters * nproducers, ns);
+}
+
+int main(int argc, char **argv) {
+	int maxthreads;
+	int nthreads;
+
+	/* whole batches */
+	niters = bench_arg(argc, argv, 1, 1000000) / BATCH * BATCH;
+	maxthreads = bench_arg(argc, argv, 2, 64);
+
+	arcp_region_init(&item, NULL);
+	if (aqueue_init(&queue) != 0
+	    || aring_init(&ring, bench_arg(argc, argv, 3, 1024)) != 0
+	    || afaaq_init(&faaq) != 0
+	    || amultiqueue_init(&mq, bench_arg(argc, argv, 4, 0)) != 0) {
+		perror("init");
+		exit(EXIT_FAILURE);
+	}
+
+	for (nthreads = 2; nthreads <= maxthreads; nthreads *= 2) {
+		run("aqueue enq/deq", aqueue_pass, nthreads);
+		run("aqueue enq_n/deq_n", aqueue_batch_pass, nthreads);
+		run("aring enq/deq", aring_pass, nthreads);
+		run("afaaq enq/deq", afaaq_pass, nthreads);
+		run("amultiqueue enq/deq", amultiqueue_pass, nthreads);
+	}
+
+	aqueue_destroy(&queue);
+	aring_destroy(&ring);
+	afaaq_destroy(&faaq);
+	amultiqueue_destroy(&mq);
+	return 0;
+}
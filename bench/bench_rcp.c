@@ -0,0 +1,109 @@
+/*
+ * bench_rcp.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ * 
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ * 
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <atomickit/rcp.h>
+#include <atomickit/array.h>
+#include "bench.h"
+
+/* usage: bench_rcp [iterations per thread] [max threads] */
+
+static long niters;
+
+static struct arcp_region shared_region;
+static struct arcp_region private_regions[64];
+static arcp_t shared_arcp;
+static arcp_versioned_t shared_varcp;
+static struct aary *shared_array;
+
+static void acquire_private(void *arg __attribute__((unused)), int n) {
+	struct arcp_region *region = &private_regions[n % 64];
+	long i;
+	for (i = 0; i < niters; i++) {
+		arcp_release(arcp_acquire(region));
+	}
+}
+
+static void acquire_shared(void *arg __attribute__((unused)),
+			   int n __attribute__((unused))) {
+	long i;
+	for (i = 0; i < niters; i++) {
+		arcp_release(arcp_acquire(&shared_region));
+	}
+}
+
+static void load_shared(void *arg __attribute__((unused)),
+			int n __attribute__((unused))) {
+	long i;
+	for (i = 0; i < niters; i++) {
+		arcp_release(arcp_load(&shared_arcp));
+	}
+}
+
+static void cached_load_shared(void *arg __attribute__((unused)),
+			       int n __attribute__((unused))) {
+	struct arcp_cache cache = ARCP_CACHE_VAR_INIT;
+	long i;
+	for (i = 0; i < niters; i++) {
+		arcp_cached_load(&shared_varcp, &cache);
+	}
+	arcp_cache_release(&cache);
+}
+
+static void aary_load_shared(void *arg __attribute__((unused)), int n) {
+	long i;
+	for (i = 0; i < niters; i++) {
+		arcp_release(aary_load(shared_array,
+				       (i + n) % aary_len(shared_array)));
+	}
+}
+
+static void run(const char *name, void (*fn)(void *, int), int nthreads) {
+	double ns;
+	ns = bench_threads(nthreads, fn, NULL);
+	bench_report(name, nthreads, (double) niters * nthreads, ns);
+}
+
+int main(int argc, char **argv) {
+	int maxthreads;
+	int nthreads;
+	int i;
+
+	niters = bench_arg(argc, argv, 1, 10000000);
+	maxthreads = bench_arg(argc, argv, 2, 4);
+
+	arcp_region_init(&shared_region, NULL);
+	for (i = 0; i < 64; i++) {
+		arcp_region_init(&private_regions[i], NULL);
+	}
+	arcp_init(&shared_arcp, &shared_region);
+	arcp_versioned_init(&shared_varcp, &shared_region);
+	shared_array = aary_create(16);
+	for (i = 0; i < 16; i++) {
+		aary_store(shared_array, i, &private_regions[i]);
+	}
+
+	for (nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+		run("acquire/release private", acquire_private, nthreads);
+		run("acquire/release shared", acquire_shared, nthreads);
+		run("arcp_load/release shared", load_shared, nthreads);
+		run("arcp_cached_load shared", cached_load_shared, nthreads);
+		run("aary_load/release shared", aary_load_shared, nthreads);
+	}
+	return 0;
+}
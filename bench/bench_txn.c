@@ -0,0 +1,131 @@
+/*
+ * bench_txn.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <pthread.h>
+#include <atomickit/rcp.h>
+#include <atomickit/txn.h>
+#include "bench.h"
+
+/* usage: bench_txn [iterations per thread] [max threads] */
+
+#define NPAIRS 64
+
+static long niters;
+
+static struct arcp_region regions[NPAIRS][2];
+/* pairs are padded apart so that private pairs don't share cache lines */
+static struct {
+	arcp_t rcp[2];
+	char pad[64 - 2 * sizeof(arcp_t)];
+} pairs[NPAIRS];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Swap the contents of a pair of pointers in one transaction */
+static void txn_swap(arcp_t *rcp) {
+	struct atxn *txn;
+	struct arcp_region *a, *b;
+	bool committed;
+	do {
+		txn = atxn_begin();
+		a = atxn_load(txn, &rcp[0]);
+		b = atxn_load(txn, &rcp[1]);
+		atxn_store(txn, &rcp[0], b);
+		atxn_store(txn, &rcp[1], a);
+		arcp_release(a);
+		arcp_release(b);
+		committed = atxn_commit(txn);
+		if (!committed) {
+			cpu_yield();
+		}
+	} while (!committed);
+}
+
+/* Swap the contents of a pair of pointers under the global lock, which is
+ * what callers had to do before there were transactions */
+static void mutex_swap(arcp_t *rcp) {
+	struct arcp_region *a, *b;
+	pthread_mutex_lock(&lock);
+	a = arcp_load(&rcp[0]);
+	b = arcp_load(&rcp[1]);
+	arcp_store(&rcp[0], b);
+	arcp_store(&rcp[1], a);
+	pthread_mutex_unlock(&lock);
+	arcp_release(a);
+	arcp_release(b);
+}
+
+static void txn_shared(void *arg __attribute__((unused)),
+		       int n __attribute__((unused))) {
+	long i;
+	for (i = 0; i < niters; i++) {
+		txn_swap(pairs[0].rcp);
+	}
+}
+
+static void mutex_shared(void *arg __attribute__((unused)),
+			 int n __attribute__((unused))) {
+	long i;
+	for (i = 0; i < niters; i++) {
+		mutex_swap(pairs[0].rcp);
+	}
+}
+
+static void txn_private(void *arg __attribute__((unused)), int n) {
+	long i;
+	for (i = 0; i < niters; i++) {
+		txn_swap(pairs[n % NPAIRS].rcp);
+	}
+}
+
+static void mutex_private(void *arg __attribute__((unused)), int n) {
+	long i;
+	for (i = 0; i < niters; i++) {
+		mutex_swap(pairs[n % NPAIRS].rcp);
+	}
+}
+
+static void run(const char *name, void (*fn)(void *, int), int nthreads) {
+	double ns;
+	ns = bench_threads(nthreads, fn, NULL);
+	bench_report(name, nthreads, (double) niters * nthreads, ns);
+}
+
+int main(int argc, char **argv) {
+	int maxthreads;
+	int nthreads;
+	int i;
+
+	niters = bench_arg(argc, argv, 1, 1000000);
+	maxthreads = bench_arg(argc, argv, 2, 4);
+
+	for (i = 0; i < NPAIRS; i++) {
+		arcp_region_init(&regions[i][0], NULL);
+		arcp_region_init(&regions[i][1], NULL);
+		arcp_init(&pairs[i].rcp[0], &regions[i][0]);
+		arcp_init(&pairs[i].rcp[1], &regions[i][1]);
+	}
+
+	for (nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+		run("atxn swap shared pair", txn_shared, nthreads);
+		run("mutex swap shared pair", mutex_shared, nthreads);
+		run("atxn swap private pairs", txn_private, nthreads);
+		run("mutex swap private pairs", mutex_private, nthreads);
+	}
+	return 0;
+}
@@ -10,6 +10,8 @@ ARCH?=${UNAME_ARCH}
 
 CC?=gcc
 CFLAGS?=-Og -g3
+CXX?=g++
+CXXFLAGS?=-Og -g3
 LDFLAGS?=
 AR?=ar
 ARFLAGS?=rv
@@ -18,3 +20,6 @@ CFLAGS+=-Wall -Wextra -Wmissing-prototypes -Wredundant-decls \
         -Wdeclaration-after-statement
 CFLAGS+=-fplan9-extensions
 CFLAGS+=-Iinclude -Iinclude/${ARCH}
+
+CXXFLAGS+=-std=gnu++14 -Wall -Wextra
+CXXFLAGS+=-Iinclude -Iinclude/${ARCH}
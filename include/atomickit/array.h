@@ -43,8 +43,12 @@
  *
  * The array structure to be stored in an arcp_t container.
  */
+#ifdef __cplusplus
+struct aary : arcp_region {
+#else
 struct aary {
 	struct arcp_region;
+#endif
 	size_t len;			/**< the length of the array */
 	struct arcp_region *items[];	/**< the array of items */
 };
@@ -115,6 +119,20 @@ static inline struct arcp_region *aary_load_phantom(struct aary *array,
 	return array->items[i];
 }
 
+/**
+ * Load a specific value from the array currently stored in a pointer.
+ *
+ * The array is borrowed with `arcp_borrow` for the duration of the lookup, so
+ * this is cheaper than loading the array, loading the value, and releasing
+ * the array.
+ *
+ * @param rcp the pointer in which the array is stored.
+ * @param i The index in the array from which to load the value.
+ * @returns The value of the array at the specified index, or NULL if the
+ * pointer is empty or the index is out of range.
+ */
+struct arcp_region *aary_rcp_load(arcp_t *rcp, size_t i);
+
 /**
  * Load the last value from the array.
  *
@@ -495,6 +513,20 @@ struct aary *aary_dup_set_remove(struct aary *array,
  */
 bool aary_set_contains(struct aary *array, struct arcp_region *region);
 
+/**
+ * Determine if the array currently stored in a pointer contains the specified
+ * region.
+ *
+ * The array is borrowed with `arcp_borrow` for the duration of the search.
+ * It must be sorted by arcp_region pointer.
+ *
+ * @param rcp the pointer in which the array is stored.
+ * @param region the region to search for.
+ * @returns true if the array contains the specified region, false if it does
+ * not or if the pointer is empty.
+ */
+bool aary_rcp_set_contains(arcp_t *rcp, struct arcp_region *region);
+
 /* struct aary *aary_set_union(struct aary *array2,
  * 			    struct aary *array2); */
 /* struct aary *aary_dup_set_union(struct aary *array1,
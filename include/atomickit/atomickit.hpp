@@ -0,0 +1,1072 @@
+/** @file atomickit.hpp
+ * C++ Handles
+ *
+ * Header-only C++ wrappers which manage Atomic Kit references by
+ * construction and destruction, so that they can't be leaked or released
+ * twice.
+ *
+ * `ref` holds one reference to a region.  Copying it acquires a reference
+ * and destroying it releases one, but moving it hands the reference over
+ * without touching the count, as does assigning from a temporary.  `borrowed`
+ * holds a region borrowed with `arcp_borrow` and can only be moved.
+ *
+ * `rcp` and `queue` own an `arcp_t` and an `aqueue_t`.  They can be moved as
+ * long as nothing else is using them at the time, but not copied.  `array`
+ * and `dict` own an array or dictionary which has not yet been shared, and so
+ * may still be changed in place; once it is ready, `share` turns it into a
+ * `ref` which can be stored.  `array_snapshot` and `dict_snapshot` hold a
+ * reference to a shared array or dictionary and iterate over its contents
+ * without acquiring each one; the contents live as long as the snapshot.
+ *
+ * Allocation failures are thrown as `std::bad_alloc`.  Types stored in a
+ * handle must derive from `arcp_region`, as the structures in the C headers
+ * do when compiled as C++.  This needs C++14 with the GNU extensions.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_ATOMICKIT_HPP
+#define ATOMICKIT_ATOMICKIT_HPP 1
+
+#include <stdbool.h>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <tuple>
+#include <utility>
+
+extern "C" {
+#include <atomickit/rcp.h>
+#include <atomickit/queue.h>
+#include <atomickit/string.h>
+#include <atomickit/array.h>
+#include <atomickit/dict.h>
+}
+
+namespace atomickit {
+
+/**
+ * A counted reference to a region.
+ */
+template <class T = arcp_region>
+class ref {
+public:
+	/**
+	 * Constructs an empty reference.
+	 */
+	constexpr ref() noexcept : p(nullptr) {}
+
+	/**
+	 * Constructs an empty reference.
+	 */
+	constexpr ref(std::nullptr_t) noexcept : p(nullptr) {}
+
+	/**
+	 * Takes over a reference the caller already holds, such as one
+	 * returned by `arcp_load`.
+	 *
+	 * @param region the region, which may be NULL.
+	 */
+	static ref adopt(T *region) noexcept {
+		ref ret;
+		ret.p = region;
+		return ret;
+	}
+
+	/**
+	 * Acquires a new reference to a region.
+	 *
+	 * @param region the region, which may be NULL.
+	 */
+	static ref acquire(T *region) noexcept {
+		if (region != nullptr) {
+			arcp_acquire(static_cast<arcp_region *>(region));
+		}
+		return adopt(region);
+	}
+
+	ref(const ref &other) noexcept : p(acquire(other.p).detach()) {}
+
+	ref(ref &&other) noexcept : p(other.detach()) {}
+
+	/**
+	 * Converts a reference to a derived type.
+	 */
+	template <class U>
+	ref(const ref<U> &other) noexcept : p(acquire(other.get()).detach()) {}
+
+	/**
+	 * Converts a reference to a derived type.
+	 */
+	template <class U>
+	ref(ref<U> &&other) noexcept : p(other.detach()) {}
+
+	~ref() {
+		arcp_release(static_cast<arcp_region *>(p));
+	}
+
+	/* The argument is a copy only if the right hand side isn't a
+	 * temporary, so each assignment updates the count at most once. */
+	ref &operator=(ref other) noexcept {
+		swap(other);
+		return *this;
+	}
+
+	/**
+	 * Gets the region.
+	 */
+	T *get() const noexcept {
+		return p;
+	}
+
+	T *operator->() const noexcept {
+		return p;
+	}
+
+	T &operator*() const noexcept {
+		return *p;
+	}
+
+	explicit operator bool() const noexcept {
+		return p != nullptr;
+	}
+
+	/**
+	 * Gives up the reference without releasing it, leaving this empty.
+	 *
+	 * @returns the region, to which the caller now holds the reference.
+	 */
+	T *detach() noexcept {
+		T *ret = p;
+		p = nullptr;
+		return ret;
+	}
+
+	/**
+	 * Releases the reference, leaving this empty.
+	 */
+	void reset() noexcept {
+		ref().swap(*this);
+	}
+
+	void swap(ref &other) noexcept {
+		std::swap(p, other.p);
+	}
+
+private:
+	T *p;
+};
+
+template <class T, class U>
+inline bool operator==(const ref<T> &a, const ref<U> &b) noexcept {
+	return static_cast<const arcp_region *>(a.get())
+		== static_cast<const arcp_region *>(b.get());
+}
+
+template <class T, class U>
+inline bool operator!=(const ref<T> &a, const ref<U> &b) noexcept {
+	return !(a == b);
+}
+
+template <class T>
+inline void swap(ref<T> &a, ref<T> &b) noexcept {
+	a.swap(b);
+}
+
+/**
+ * Allocates a region with `arcp_alloc` and constructs a `T` in it.
+ *
+ * @param args the arguments to the constructor of `T`.
+ *
+ * @returns a reference to the new region.
+ */
+template <class T, class... Args>
+ref<T> make_ref(Args &&... args) {
+	void *region;
+	T *ret;
+	region = arcp_alloc(sizeof(T), [](arcp_region *r) {
+		static_cast<T *>(r)->~T();
+	});
+	if (region == nullptr) {
+		throw std::bad_alloc();
+	}
+	/* arcp_alloc has already set up the region; construct the rest
+	 * around it without clearing it */
+	arcp_region saved = *static_cast<arcp_region *>(region);
+	try {
+		ret = new(region) T(std::forward<Args>(args)...);
+	} catch (...) {
+		/* there is no T to finalize */
+		arcp_alloc_free(region);
+		throw;
+	}
+	*static_cast<arcp_region *>(ret) = saved;
+	return ref<T>::adopt(ret);
+}
+
+/**
+ * A region borrowed from a pointer with `arcp_borrow`.
+ */
+template <class T = arcp_region>
+class borrowed {
+public:
+	/**
+	 * Borrows the current contents of a pointer.
+	 *
+	 * @param rcp the pointer from which to borrow.
+	 */
+	explicit borrowed(arcp_t *rcp) noexcept
+		: p(static_cast<T *>(arcp_borrow(rcp))) {}
+
+	borrowed(borrowed &&other) noexcept : p(other.p) {
+		other.p = nullptr;
+	}
+
+	borrowed(const borrowed &) = delete;
+	borrowed &operator=(const borrowed &) = delete;
+
+	~borrowed() {
+		arcp_unborrow(static_cast<arcp_region *>(p));
+	}
+
+	T *get() const noexcept {
+		return p;
+	}
+
+	T *operator->() const noexcept {
+		return p;
+	}
+
+	T &operator*() const noexcept {
+		return *p;
+	}
+
+	explicit operator bool() const noexcept {
+		return p != nullptr;
+	}
+
+private:
+	T *p;
+};
+
+/**
+ * A reference counted pointer.
+ */
+template <class T = arcp_region>
+class rcp {
+public:
+	/**
+	 * Constructs an empty pointer.
+	 */
+	rcp() noexcept {
+		arcp_init(&r, nullptr);
+	}
+
+	/**
+	 * Constructs a pointer holding a region.
+	 */
+	explicit rcp(const ref<T> &region) noexcept {
+		arcp_init(&r, region.get());
+	}
+
+	/**
+	 * Takes over the contents of another pointer without touching its
+	 * count.  Nothing else may be using either pointer.
+	 */
+	rcp(rcp &&other) noexcept {
+		ak_init(&r, ak_load(&other.r, mo_relaxed));
+		ak_store(&other.r, nullptr, mo_relaxed);
+	}
+
+	/**
+	 * Takes over the contents of another pointer without touching its
+	 * count.  Nothing else may be using either pointer.
+	 */
+	rcp &operator=(rcp &&other) noexcept {
+		if (this != &other) {
+			arcp_store(&r, nullptr);
+			ak_store(&r, ak_load(&other.r, mo_relaxed),
+				 mo_relaxed);
+			ak_store(&other.r, nullptr, mo_relaxed);
+		}
+		return *this;
+	}
+
+	rcp(const rcp &) = delete;
+	rcp &operator=(const rcp &) = delete;
+
+	~rcp() {
+		arcp_store(&r, nullptr);
+	}
+
+	/**
+	 * See `arcp_load`.
+	 */
+	ref<T> load() noexcept {
+		return ref<T>::adopt(static_cast<T *>(arcp_load(&r)));
+	}
+
+	/**
+	 * See `arcp_load_phantom`.
+	 */
+	T *load_phantom() noexcept {
+		return static_cast<T *>(arcp_load_phantom(&r));
+	}
+
+	/**
+	 * See `arcp_borrow`.
+	 */
+	borrowed<T> borrow() noexcept {
+		return borrowed<T>(&r);
+	}
+
+	/**
+	 * See `arcp_store`.
+	 */
+	void store(const ref<T> &region) noexcept {
+		arcp_store(&r, region.get());
+	}
+
+	/**
+	 * See `arcp_swap`.
+	 */
+	ref<T> swap(const ref<T> &region) noexcept {
+		return ref<T>::adopt(static_cast<T *>(arcp_swap(&r,
+							      region.get())));
+	}
+
+	/**
+	 * See `arcp_cas`.
+	 */
+	bool cas(T *oldregion, const ref<T> &newregion) noexcept {
+		return arcp_cas(&r, oldregion, newregion.get());
+	}
+
+	/**
+	 * Gets the underlying pointer, for use with the C functions.
+	 */
+	arcp_t *get() noexcept {
+		return &r;
+	}
+
+private:
+	arcp_t r;
+};
+
+/**
+ * A versioned reference counted pointer.
+ */
+template <class T = arcp_region>
+class versioned_rcp {
+public:
+	/**
+	 * Constructs an empty pointer.
+	 */
+	versioned_rcp() noexcept {
+		arcp_versioned_init(&v, nullptr);
+	}
+
+	/**
+	 * Constructs a pointer holding a region.
+	 */
+	explicit versioned_rcp(const ref<T> &region) noexcept {
+		arcp_versioned_init(&v, region.get());
+	}
+
+	versioned_rcp(const versioned_rcp &) = delete;
+	versioned_rcp &operator=(const versioned_rcp &) = delete;
+
+	~versioned_rcp() {
+		arcp_store(&v.rcp, nullptr);
+	}
+
+	/**
+	 * See `arcp_load`.
+	 */
+	ref<T> load() noexcept {
+		return ref<T>::adopt(static_cast<T *>(arcp_load(&v.rcp)));
+	}
+
+	/**
+	 * See `arcp_load_phantom`.
+	 */
+	T *load_phantom() noexcept {
+		return static_cast<T *>(arcp_load_phantom(&v.rcp));
+	}
+
+	/**
+	 * See `arcp_versioned_store`.
+	 */
+	void store(const ref<T> &region) noexcept {
+		arcp_versioned_store(&v, region.get());
+	}
+
+	/**
+	 * Gets the underlying pointer, for use with the C functions.
+	 */
+	arcp_versioned_t *get() noexcept {
+		return &v;
+	}
+
+private:
+	arcp_versioned_t v;
+};
+
+/**
+ * Acquires the contents of several versioned pointers at once, as by
+ * `arcp_load_snapshot`.
+ *
+ * @param rcps the pointers to load.
+ *
+ * @returns a tuple of references to the contents of each pointer.
+ */
+template <class... Ts>
+std::tuple<ref<Ts>...> load_snapshot(versioned_rcp<Ts> &... rcps) noexcept;
+
+namespace detail {
+
+template <class... Ts, std::size_t... I>
+std::tuple<ref<Ts>...> adopt_all(arcp_region **regions,
+				  std::index_sequence<I...>) noexcept {
+	return std::tuple<ref<Ts>...>(
+		ref<Ts>::adopt(static_cast<Ts *>(regions[I]))...);
+}
+
+} /* namespace detail */
+
+template <class... Ts>
+std::tuple<ref<Ts>...> load_snapshot(versioned_rcp<Ts> &... rcps) noexcept {
+	arcp_versioned_t *ptrs[] = { rcps.get()... };
+	arcp_region *regions[sizeof...(Ts)];
+	uintptr_t versions[sizeof...(Ts)];
+	arcp_load_snapshot(ptrs, sizeof...(Ts), regions, versions);
+	return detail::adopt_all<Ts...>(regions,
+					std::index_sequence_for<Ts...>());
+}
+
+/**
+ * An atomic queue.
+ */
+template <class T = arcp_region>
+class queue {
+public:
+	queue() {
+		if (aqueue_init(&q) != 0) {
+			throw std::bad_alloc();
+		}
+		live = true;
+	}
+
+	/**
+	 * Takes over the contents of another queue.  Nothing else may be
+	 * using either queue.
+	 */
+	queue(queue &&other) noexcept : live(other.live) {
+		ak_init(&q.head, ak_load(&other.q.head, mo_relaxed));
+		ak_init(&q.tail, ak_load(&other.q.tail, mo_relaxed));
+		ak_init(&q.seq, 0u);
+		ak_init(&q.waiters, 0u);
+		other.live = false;
+	}
+
+	queue(const queue &) = delete;
+	queue &operator=(const queue &) = delete;
+	queue &operator=(queue &&) = delete;
+
+	~queue() {
+		if (live) {
+			aqueue_destroy(&q);
+		}
+	}
+
+	/**
+	 * See `aqueue_enq`.
+	 */
+	void enq(const ref<T> &item) {
+		if (aqueue_enq(&q, item.get()) != 0) {
+			throw std::bad_alloc();
+		}
+	}
+
+	/**
+	 * See `aqueue_deq`.
+	 */
+	ref<T> deq() noexcept {
+		return ref<T>::adopt(static_cast<T *>(aqueue_deq(&q)));
+	}
+
+	/**
+	 * See `aqueue_deq_wait`.
+	 */
+	ref<T> deq_wait(const struct timespec *timeout = nullptr) noexcept {
+		return ref<T>::adopt(static_cast<T *>(aqueue_deq_wait(&q,
+								      timeout)));
+	}
+
+	/**
+	 * See `aqueue_peek`.
+	 */
+	ref<T> peek() noexcept {
+		return ref<T>::adopt(static_cast<T *>(aqueue_peek(&q)));
+	}
+
+	/**
+	 * See `aqueue_cmpdeq`.
+	 */
+	bool cmpdeq(T *item) noexcept {
+		return aqueue_cmpdeq(&q, item);
+	}
+
+	/**
+	 * Gets the underlying queue, for use with the C functions.
+	 */
+	aqueue_t *get() noexcept {
+		return &q;
+	}
+
+private:
+	aqueue_t q;
+	bool live;
+};
+
+/**
+ * An iterator over the regions in an array, which doesn't acquire them.
+ */
+template <class T>
+class array_iterator {
+public:
+	typedef std::ptrdiff_t difference_type;
+	typedef T *value_type;
+	typedef T *const *pointer;
+	typedef T *reference;
+	typedef std::random_access_iterator_tag iterator_category;
+
+	explicit array_iterator(arcp_region *const *item) noexcept
+		: item(item) {}
+
+	T *operator*() const noexcept {
+		return static_cast<T *>(*item);
+	}
+
+	T *operator[](difference_type n) const noexcept {
+		return static_cast<T *>(item[n]);
+	}
+
+	array_iterator &operator++() noexcept {
+		++item;
+		return *this;
+	}
+
+	array_iterator operator++(int) noexcept {
+		return array_iterator(item++);
+	}
+
+	array_iterator &operator--() noexcept {
+		--item;
+		return *this;
+	}
+
+	array_iterator operator--(int) noexcept {
+		return array_iterator(item--);
+	}
+
+	array_iterator &operator+=(difference_type n) noexcept {
+		item += n;
+		return *this;
+	}
+
+	array_iterator &operator-=(difference_type n) noexcept {
+		item -= n;
+		return *this;
+	}
+
+	array_iterator operator+(difference_type n) const noexcept {
+		return array_iterator(item + n);
+	}
+
+	array_iterator operator-(difference_type n) const noexcept {
+		return array_iterator(item - n);
+	}
+
+	difference_type operator-(const array_iterator &other) const noexcept {
+		return item - other.item;
+	}
+
+	bool operator==(const array_iterator &other) const noexcept {
+		return item == other.item;
+	}
+
+	bool operator!=(const array_iterator &other) const noexcept {
+		return item != other.item;
+	}
+
+	bool operator<(const array_iterator &other) const noexcept {
+		return item < other.item;
+	}
+
+private:
+	arcp_region *const *item;
+};
+
+/**
+ * A reference to a shared array, whose elements are valid for as long as the
+ * snapshot is.
+ */
+template <class T = arcp_region>
+class array_snapshot {
+public:
+	typedef array_iterator<T> iterator;
+
+	/**
+	 * Constructs a snapshot of an array.
+	 *
+	 * @param array a reference to the array, which may be empty.
+	 */
+	explicit array_snapshot(ref<aary> array) noexcept
+		: a(std::move(array)) {}
+
+	/**
+	 * Constructs a snapshot of the array currently stored in a pointer.
+	 */
+	explicit array_snapshot(rcp<aary> &ptr) noexcept : a(ptr.load()) {}
+
+	std::size_t size() const noexcept {
+		return a ? aary_len(a.get()) : 0;
+	}
+
+	bool empty() const noexcept {
+		return size() == 0;
+	}
+
+	/**
+	 * Gets an element without acquiring it.
+	 */
+	T *operator[](std::size_t i) const noexcept {
+		return static_cast<T *>(aary_load_phantom(a.get(), i));
+	}
+
+	/**
+	 * Acquires an element which is to outlive the snapshot.
+	 */
+	ref<T> at(std::size_t i) const noexcept {
+		return ref<T>::adopt(static_cast<T *>(aary_load(a.get(), i)));
+	}
+
+	iterator begin() const noexcept {
+		return iterator(a ? a->items : nullptr);
+	}
+
+	iterator end() const noexcept {
+		return iterator(a ? a->items + a->len : nullptr);
+	}
+
+	/**
+	 * Gets the array, which may be NULL.
+	 */
+	aary *get() const noexcept {
+		return a.get();
+	}
+
+private:
+	ref<aary> a;
+};
+
+/**
+ * An array which has not been shared, and so may be changed in place.
+ */
+template <class T = arcp_region>
+class array {
+public:
+	typedef array_iterator<T> iterator;
+
+	/**
+	 * Creates an array of the given length, filled with NULL.
+	 */
+	explicit array(std::size_t len = 0) : a(aary_create(len)) {
+		if (a == nullptr) {
+			throw std::bad_alloc();
+		}
+	}
+
+	/**
+	 * Creates a copy of a shared array.
+	 */
+	explicit array(const array_snapshot<T> &snapshot)
+		: a(snapshot.get() ? aary_dup(snapshot.get()) : aary_create(0)) {
+		if (a == nullptr) {
+			throw std::bad_alloc();
+		}
+	}
+
+	array(array &&other) noexcept : a(other.a) {
+		other.a = nullptr;
+	}
+
+	array &operator=(array &&other) noexcept {
+		std::swap(a, other.a);
+		return *this;
+	}
+
+	array(const array &) = delete;
+	array &operator=(const array &) = delete;
+
+	~array() {
+		arcp_release(a);
+	}
+
+	std::size_t size() const noexcept {
+		return aary_len(a);
+	}
+
+	T *operator[](std::size_t i) const noexcept {
+		return static_cast<T *>(aary_load_phantom(a, i));
+	}
+
+	iterator begin() const noexcept {
+		return iterator(a->items);
+	}
+
+	iterator end() const noexcept {
+		return iterator(a->items + a->len);
+	}
+
+	/**
+	 * See `aary_store`.
+	 */
+	void store(std::size_t i, const ref<T> &region) noexcept {
+		aary_store(a, i, region.get());
+	}
+
+	/**
+	 * See `aary_insert`.
+	 */
+	void insert(std::size_t i, const ref<T> &region) {
+		update(aary_insert(a, i, region.get()));
+	}
+
+	/**
+	 * See `aary_remove`.
+	 */
+	void remove(std::size_t i) {
+		update(aary_remove(a, i));
+	}
+
+	/**
+	 * See `aary_append`.
+	 */
+	void append(const ref<T> &region) {
+		update(aary_append(a, region.get()));
+	}
+
+	/**
+	 * See `aary_prepend`.
+	 */
+	void prepend(const ref<T> &region) {
+		update(aary_prepend(a, region.get()));
+	}
+
+	/**
+	 * See `aary_pop`.
+	 */
+	void pop() {
+		update(aary_pop(a));
+	}
+
+	/**
+	 * See `aary_shift`.
+	 */
+	void shift() {
+		update(aary_shift(a));
+	}
+
+	/**
+	 * Gets the array, for use with the C functions.
+	 */
+	aary *get() const noexcept {
+		return a;
+	}
+
+	/**
+	 * Gives up the array so that it may be shared, leaving this empty.
+	 *
+	 * @returns a reference to the array.
+	 */
+	ref<aary> share() && noexcept {
+		aary *ret = a;
+		a = nullptr;
+		return ref<aary>::adopt(ret);
+	}
+
+private:
+	void update(aary *array) {
+		if (array == nullptr) {
+			throw std::bad_alloc();
+		}
+		a = array;
+	}
+
+	aary *a;
+};
+
+/**
+ * An entry of a dictionary, neither part of which is acquired.
+ */
+template <class T>
+struct dict_entry {
+	astr *key;	/**< the key */
+	T *value;	/**< the value */
+};
+
+/**
+ * An iterator over the entries of a dictionary, which doesn't acquire them.
+ */
+template <class T>
+class dict_iterator {
+public:
+	typedef std::ptrdiff_t difference_type;
+	typedef dict_entry<T> value_type;
+	typedef const dict_entry<T> *pointer;
+	typedef dict_entry<T> reference;
+	/* entries are made on the fly, so there is nothing to refer to */
+	typedef std::input_iterator_tag iterator_category;
+
+	explicit dict_iterator(const adict_entry *item) noexcept
+		: item(item) {}
+
+	dict_entry<T> operator*() const noexcept {
+		return dict_entry<T>{ item->key,
+				      static_cast<T *>(item->value) };
+	}
+
+	dict_iterator &operator++() noexcept {
+		++item;
+		return *this;
+	}
+
+	dict_iterator operator++(int) noexcept {
+		return dict_iterator(item++);
+	}
+
+	bool operator==(const dict_iterator &other) const noexcept {
+		return item == other.item;
+	}
+
+	bool operator!=(const dict_iterator &other) const noexcept {
+		return item != other.item;
+	}
+
+private:
+	const adict_entry *item;
+};
+
+/**
+ * A reference to a shared dictionary, whose entries are valid for as long as
+ * the snapshot is.
+ */
+template <class T = arcp_region>
+class dict_snapshot {
+public:
+	typedef dict_iterator<T> iterator;
+
+	/**
+	 * Constructs a snapshot of a dictionary.
+	 *
+	 * @param dict a reference to the dictionary, which may be empty.
+	 */
+	explicit dict_snapshot(ref<adict> dict) noexcept
+		: d(std::move(dict)) {}
+
+	/**
+	 * Constructs a snapshot of the dictionary currently stored in a
+	 * pointer.
+	 */
+	explicit dict_snapshot(rcp<adict> &ptr) noexcept : d(ptr.load()) {}
+
+	std::size_t size() const noexcept {
+		return d ? adict_len(d.get()) : 0;
+	}
+
+	bool empty() const noexcept {
+		return size() == 0;
+	}
+
+	/**
+	 * See `adict_cstrget`.
+	 *
+	 * @returns a reference to the value, which is empty if there is no
+	 * entry for the key.
+	 */
+	ref<T> get(const char *key) const noexcept {
+		if (!d) {
+			return ref<T>();
+		}
+		return ref<T>::adopt(static_cast<T *>(
+			adict_cstrget(d.get(), const_cast<char *>(key))));
+	}
+
+	/**
+	 * See `adict_cstrhas`.
+	 */
+	bool has(const char *key) const noexcept {
+		return d && adict_cstrhas(d.get(), const_cast<char *>(key));
+	}
+
+	iterator begin() const noexcept {
+		return iterator(d ? d->items : nullptr);
+	}
+
+	iterator end() const noexcept {
+		return iterator(d ? d->items + d->len : nullptr);
+	}
+
+	/**
+	 * Gets the dictionary, which may be NULL.
+	 */
+	adict *get() const noexcept {
+		return d.get();
+	}
+
+private:
+	ref<adict> d;
+};
+
+/**
+ * A dictionary which has not been shared, and so may be changed in place.
+ */
+template <class T = arcp_region>
+class dict {
+public:
+	typedef dict_iterator<T> iterator;
+
+	/**
+	 * Creates an empty dictionary.
+	 */
+	dict() : d(adict_create()) {
+		if (d == nullptr) {
+			throw std::bad_alloc();
+		}
+	}
+
+	/**
+	 * Creates a copy of a shared dictionary.
+	 */
+	explicit dict(const dict_snapshot<T> &snapshot)
+		: d(snapshot.get() ? adict_dup(snapshot.get()) : adict_create()) {
+		if (d == nullptr) {
+			throw std::bad_alloc();
+		}
+	}
+
+	dict(dict &&other) noexcept : d(other.d) {
+		other.d = nullptr;
+	}
+
+	dict &operator=(dict &&other) noexcept {
+		std::swap(d, other.d);
+		return *this;
+	}
+
+	dict(const dict &) = delete;
+	dict &operator=(const dict &) = delete;
+
+	~dict() {
+		arcp_release(d);
+	}
+
+	std::size_t size() const noexcept {
+		return adict_len(d);
+	}
+
+	/**
+	 * See `adict_cstrget`.
+	 */
+	ref<T> get(const char *key) const noexcept {
+		return ref<T>::adopt(static_cast<T *>(
+			adict_cstrget(d, const_cast<char *>(key))));
+	}
+
+	/**
+	 * See `adict_cstrhas`.
+	 */
+	bool has(const char *key) const noexcept {
+		return adict_cstrhas(d, const_cast<char *>(key));
+	}
+
+	iterator begin() const noexcept {
+		return iterator(d->items);
+	}
+
+	iterator end() const noexcept {
+		return iterator(d->items + d->len);
+	}
+
+	/**
+	 * See `adict_cstrput`.
+	 */
+	void put(const char *key, const ref<T> &value) {
+		adict *ret;
+		ret = adict_cstrput(d, const_cast<char *>(key), value.get());
+		if (ret == nullptr) {
+			throw std::bad_alloc();
+		}
+		d = ret;
+	}
+
+	/**
+	 * See `adict_cstrdel`.
+	 *
+	 * @returns true if there was an entry for the key, false otherwise.
+	 */
+	bool del(const char *key) {
+		adict *ret;
+		if (!has(key)) {
+			return false;
+		}
+		ret = adict_cstrdel(d, const_cast<char *>(key));
+		if (ret == nullptr) {
+			throw std::bad_alloc();
+		}
+		d = ret;
+		return true;
+	}
+
+	/**
+	 * Gets the dictionary, for use with the C functions.
+	 */
+	adict *get() const noexcept {
+		return d;
+	}
+
+	/**
+	 * Gives up the dictionary so that it may be shared, leaving this
+	 * empty.
+	 *
+	 * @returns a reference to the dictionary.
+	 */
+	ref<adict> share() && noexcept {
+		adict *ret = d;
+		d = nullptr;
+		return ref<adict>::adopt(ret);
+	}
+
+private:
+	adict *d;
+};
+
+} /* namespace atomickit */
+
+#endif /* ! ATOMICKIT_ATOMICKIT_HPP */
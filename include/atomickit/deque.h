@@ -0,0 +1,146 @@
+/** @file deque.h
+ * Atomic Work-Stealing Deque
+ *
+ * Implements an unlimited lock free deque of reference counted items, owned
+ * by one thread, for scheduling work.  The owner pushes and pops items at
+ * the bottom, last in first out, with no read-modify-write operations except
+ * when taking the very last item.  Any other thread may steal items from the
+ * top, first in first out, with one compare and swap.
+ *
+ * The items are kept in a circular array which the owner replaces with one
+ * twice the size when it fills up.  The arrays are reference counted, and
+ * thieves hold a reference to the array they are reading from, so an old
+ * array is freed once the last thief is done with it.
+ *
+ * As with `aqueue_t`, the deque takes its own reference to each pushed item
+ * and hands that reference to whoever pops or steals it.  Items may not be
+ * NULL.
+ *
+ * This algorithm is David Chase and Yossi Lev, "Dynamic Circular
+ * Work-Stealing Deque," SPAA 2005, with the memory orderings of Nhat Minh
+ * Lê, Antoniu Pop, Albert Cohen, and Francesco Zappa Nardelli, "Correct and
+ * Efficient Work-Stealing for Weak Memory Models," PPoPP 2013.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_DEQUE_H
+#define ATOMICKIT_DEQUE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include <atomickit/atomic.h>
+#include <atomickit/rcp.h>
+
+/**
+ * The alignment that keeps the owner's and thieves' positions from sharing a
+ * cache line.
+ */
+#define __ADEQUE_CACHELINE 64
+
+/**
+ * Circular array of items.
+ */
+#ifdef __cplusplus
+struct adeque_array : arcp_region {
+#else
+struct adeque_array {
+	struct arcp_region;
+#endif
+	size_t mask;			/**< the number of slots, minus one */
+	atomic_uintptr_t items[];	/**< the slots */
+};
+
+/**
+ * Atomic Work-Stealing Deque.
+ */
+typedef struct {
+	alignas(__ADEQUE_CACHELINE)
+	atomic_intptr_t top;		/**< the next position to steal */
+	alignas(__ADEQUE_CACHELINE)
+	atomic_intptr_t bottom;		/**< the next position to push */
+	arcp_t array;			/**< the current array */
+} adeque_t;
+
+/**
+ * Initializes a deque.
+ *
+ * @param deque a pointer to the deque being initialized.
+ * @param size the number of items the deque will hold before it first
+ * grows; this is rounded up to a power of two.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int adeque_init(adeque_t *deque, size_t size);
+
+/**
+ * Pushes an item onto the bottom of the deque.  Only the owner may push.
+ *
+ * @param deque a pointer to the deque onto which the item is being pushed.
+ * @param item a pointer to the item to push, which may not be NULL.
+ *
+ * @returns zero on success, nonzero if the deque needed to grow and could
+ * not.
+ */
+int adeque_push(adeque_t *deque, struct arcp_region *item);
+
+/**
+ * Pops the item from the bottom of the deque, the one most recently pushed.
+ * Only the owner may pop.
+ *
+ * @param deque a pointer to the deque from which the item is being popped.
+ *
+ * @returns a pointer to the popped item, or NULL if the deque was empty.
+ */
+struct arcp_region *adeque_pop(adeque_t *deque);
+
+/**
+ * Steals the item from the top of the deque, the one least recently pushed.
+ * Any thread may steal.
+ *
+ * @param deque a pointer to the deque from which the item is being stolen.
+ *
+ * @returns a pointer to the stolen item, or NULL if the deque was empty or
+ * another thread took the item first.
+ */
+struct arcp_region *adeque_steal(adeque_t *deque);
+
+/**
+ * Gets the number of items in the deque.  This is only a snapshot unless
+ * called by the owner with no thieves about.
+ *
+ * @param deque a pointer to the deque.
+ *
+ * @returns the number of items in the deque.
+ */
+static inline size_t adeque_size(adeque_t *deque) {
+	intptr_t n;
+	n = ak_load(&deque->bottom, mo_relaxed)
+		- ak_load(&deque->top, mo_relaxed);
+	return n < 0 ? 0 : (size_t) n;
+}
+
+/**
+ * Destroys a deque, releasing any items still in it.  No other thread may be
+ * using the deque.
+ *
+ * @param deque a pointer to the deque being destroyed.
+ */
+void adeque_destroy(adeque_t *deque);
+
+#endif /* ! ATOMICKIT_DEQUE_H */
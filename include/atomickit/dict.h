@@ -49,8 +49,12 @@ struct adict_entry {
  *
  * The dictionary structure to be stored in an arcp_t container.
  */
+#ifdef __cplusplus
+struct adict : arcp_region {
+#else
 struct adict {
 	struct arcp_region;
+#endif
 	size_t len;			/**< The number of entries in this
 					 *   dictionary */
 	struct adict_entry items[];	/**< a sorted array of the entries in
@@ -68,7 +72,7 @@ struct adict {
  * @param n the number of entries to get the size for.
  * @returns the size of a dictionary of the given number of entries.
  */
-#define ADICT_SIZE(n) (ADICT_OVERHEAD + sizeof(struct adict_entry) * n)
+#define ADICT_SIZE(n) (ADICT_OVERHEAD + sizeof(struct adict_entry) * (n))
 
 /**
  * Create a duplicate of a given dictionary.
@@ -119,6 +123,32 @@ struct arcp_region *adict_get(struct adict *dict, struct astr *key);
  */
 struct arcp_region *adict_cstrget(struct adict *dict, char *key);
 
+/**
+ * Get the value for the given key from the dictionary currently stored in a
+ * pointer.
+ *
+ * The dictionary is borrowed with `arcp_borrow` for the duration of the
+ * lookup, so this is cheaper than loading the dictionary, getting the value,
+ * and releasing the dictionary.
+ *
+ * @param rcp the pointer in which the dictionary is stored.
+ * @param key the key to look up.
+ * @returns the value or if the pointer is empty or the value could not be
+ * found sets errno to EINVAL and returns NULL.
+ */
+struct arcp_region *adict_rcp_get(arcp_t *rcp, struct astr *key);
+
+/**
+ * Get the value for the given key from the dictionary currently stored in a
+ * pointer, using a cstr key.
+ *
+ * @param rcp the pointer in which the dictionary is stored.
+ * @param key the key to look up.
+ * @returns the value or if the pointer is empty or the value could not be
+ * found sets errno to EINVAL and returns NULL.
+ */
+struct arcp_region *adict_rcp_cstrget(arcp_t *rcp, char *key);
+
 /**
  * Checks if a dictionary contains an entry for the specified key.
  *
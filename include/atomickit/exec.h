@@ -0,0 +1,155 @@
+/** @file exec.h
+ * Atomic Work-Stealing Executor
+ *
+ * Implements a pool of worker threads which run submitted tasks.  Each
+ * worker keeps the tasks it submits itself in its own `adeque_t`, running
+ * the most recent first, and when it runs out it takes tasks submitted from
+ * outside the pool, and then steals the oldest tasks of other workers.
+ * Tasks submitted from outside the pool go into a shared `afaaq_t`.  A
+ * worker with nothing to do spins for a little while and then sleeps until
+ * more work is submitted; submitters only make a system call to wake a
+ * worker while there is a worker asleep.
+ *
+ * Tasks are grouped with `aexec_group_t`, which counts the tasks in the group
+ * which have not yet finished, and `aexec_wait_group` waits for all of them.
+ * A worker waiting for a group runs other tasks meanwhile, so a task may
+ * submit subtasks and wait for them, fork-join style, without tying up its
+ * worker.
+ *
+ * Tasks are allocated with `arcp_alloc`, and so come from `amalloc`.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_EXEC_H
+#define ATOMICKIT_EXEC_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <atomickit/atomic.h>
+#include <atomickit/faaq.h>
+#include <atomickit/deque.h>
+
+/**
+ * The number of times an idle worker looks for work before it sleeps.
+ */
+#define AEXEC_IDLE_SPINS 128
+
+/**
+ * The number of tasks each worker's deque holds before it first grows.
+ */
+#define AEXEC_DEQUE_SIZE 256
+
+/**
+ * Task group.
+ */
+typedef struct {
+	atomic_uint state;	/**< twice the number of unfinished tasks,
+				 *   plus one while threads outside the pool
+				 *   are waiting, which sleep on it */
+} aexec_group_t;
+
+/**
+ * Initialization value for `aexec_group_t`.
+ */
+#define AEXEC_GROUP_VAR_INIT { ATOMIC_VAR_INIT(0) }
+
+struct aexec;
+
+/**
+ * Worker thread.
+ */
+struct aexec_worker {
+	adeque_t deque;		/**< tasks submitted by this worker */
+	struct aexec *exec;	/**< the pool this worker belongs to */
+	pthread_t thread;	/**< this worker's thread */
+	unsigned int rand;	/**< state for choosing whom to steal
+				 *   from */
+};
+
+/**
+ * Atomic Work-Stealing Executor.
+ */
+typedef struct aexec {
+	afaaq_t inject;			/**< tasks submitted from outside the
+					 *   pool */
+	struct aexec_worker *workers;	/**< the workers */
+	int nworkers;			/**< the number of workers */
+	atomic_bool stop;		/**< set when the pool is being
+					 *   destroyed */
+	atomic_uint seq;		/**< advanced on each submission that
+					 *   has sleepers to wake; sleepers
+					 *   sleep on it */
+	atomic_uint sleepers;		/**< the number of sleeping workers */
+} aexec_t;
+
+/**
+ * Initializes a task group.
+ *
+ * @param group a pointer to the group being initialized.
+ */
+static inline void aexec_group_init(aexec_group_t *group) {
+	ak_init(&group->state, 0);
+}
+
+/**
+ * Initializes an executor and starts its workers.
+ *
+ * @param exec a pointer to the executor being initialized.
+ * @param nworkers the number of workers, or zero or less for one per online
+ * processor.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int aexec_init(aexec_t *exec, int nworkers);
+
+/**
+ * Submits a task.  If called from one of the executor's workers, the task
+ * goes to that worker's own deque; otherwise it goes to the shared queue.
+ *
+ * @param exec a pointer to the executor which will run the task.
+ * @param group the group to add the task to, or NULL.
+ * @param fn the function to run.
+ * @param arg the argument to pass to fn.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int aexec_submit(aexec_t *exec, aexec_group_t *group, void (*fn)(void *),
+		 void *arg);
+
+/**
+ * Waits until every task in the group has finished.  Called from one of the
+ * executor's workers, this runs other tasks while it waits; otherwise it
+ * sleeps.
+ *
+ * @param exec a pointer to the executor running the tasks.
+ * @param group a pointer to the group to wait for.
+ */
+void aexec_wait_group(aexec_t *exec, aexec_group_t *group);
+
+/**
+ * Stops the workers and destroys an executor.  The workers finish the tasks
+ * already submitted before they stop.  Nothing may be submitted from outside
+ * the pool once this is called, and it may not be called from one of the
+ * executor's workers.
+ *
+ * @param exec a pointer to the executor being destroyed.
+ */
+void aexec_destroy(aexec_t *exec);
+
+#endif /* ! ATOMICKIT_EXEC_H */
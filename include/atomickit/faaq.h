@@ -0,0 +1,130 @@
+/** @file faaq.h
+ * Atomic Fetch and Add Queue
+ *
+ * Implements an unlimited lock free multi-producer multi-consumer FIFO queue
+ * of reference counted items for heavily contended use.  Where `aqueue_t`
+ * has every producer compare and swap the same tail node, retrying whenever
+ * another producer gets there first, this queue is a linked list of arrays
+ * ("segments"), and producers and consumers each claim a slot in the current
+ * segment with a fetch and add, which never fails.  A producer then stores
+ * its item into the slot it claimed, and a consumer swaps it out.  Only when
+ * a segment runs out of slots do threads compare and swap, to link and move
+ * on to the next segment.
+ *
+ * A consumer which gets to a slot before its producer marks it taken, and
+ * the producer then tries again with a new slot, so a slow producer can be
+ * held off by fast consumers; in practice this is rare.
+ *
+ * As with `aqueue_t`, the queue takes its own reference to each enqueued item
+ * and hands that reference to whoever dequeues it.  Items may not be NULL.
+ *
+ * This algorithm is Pedro Ramalhete and Andreia Correia's "FAAArrayQueue,"
+ * 2016, itself a simplification of Adam Morrison and Yehuda Afek's LCRQ,
+ * "Fast Concurrent Queues for x86 Processors," PPoPP 2013.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_FAAQ_H
+#define ATOMICKIT_FAAQ_H 1
+
+#include <stddef.h>
+#include <stdalign.h>
+#include <atomickit/atomic.h>
+#include <atomickit/rcp.h>
+
+/**
+ * The number of slots in each segment.
+ */
+#define AFAAQ_SEGMENT_SIZE 1024
+
+/**
+ * The alignment that keeps producer and consumer positions from sharing a
+ * cache line.
+ */
+#define __AFAAQ_CACHELINE 64
+
+/**
+ * Queue segment.  Segments are allocated with `arcp_alloc`, which does not
+ * promise cache line alignment, so the positions are kept apart by padding.
+ */
+#ifdef __cplusplus
+struct afaaq_segment : arcp_region {
+#else
+struct afaaq_segment {
+	struct arcp_region;
+#endif
+	arcp_t next;			/**< the next segment */
+	struct afaaq_segment *reap;	/**< the next segment awaiting release,
+					 *   while a chain of segments is
+					 *   being destroyed */
+	atomic_size_t deq;		/**< the next slot to dequeue */
+	char __pad0[__AFAAQ_CACHELINE - sizeof(atomic_size_t)];
+	atomic_size_t enq;		/**< the next slot to enqueue */
+	char __pad1[__AFAAQ_CACHELINE - sizeof(atomic_size_t)];
+	atomic_uintptr_t items[AFAAQ_SEGMENT_SIZE];
+					/**< the slots: NULL, an item, or
+					 *   taken */
+};
+
+/**
+ * Atomic Fetch and Add Queue.
+ */
+typedef struct {
+	alignas(__AFAAQ_CACHELINE)
+	arcp_t head;		/**< the segment being dequeued from */
+	alignas(__AFAAQ_CACHELINE)
+	arcp_t tail;		/**< the segment being enqueued to */
+} afaaq_t;
+
+/**
+ * Initializes a queue.
+ *
+ * @param faaq a pointer to the queue being initialized.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int afaaq_init(afaaq_t *faaq);
+
+/**
+ * Enqueues the given item.
+ *
+ * @param faaq a pointer to the queue in which the item is being enqueued.
+ * @param item a pointer to the item to enqueue, which may not be NULL.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int afaaq_enq(afaaq_t *faaq, struct arcp_region *item);
+
+/**
+ * Dequeues an item.
+ *
+ * @param faaq a pointer to the queue from which the item is being dequeued.
+ *
+ * @returns a pointer to the dequeued item, or NULL if the queue was empty.
+ */
+struct arcp_region *afaaq_deq(afaaq_t *faaq);
+
+/**
+ * Destroys a queue, releasing any items still in it.  No other thread may be
+ * using the queue.
+ *
+ * @param faaq a pointer to the queue being destroyed.
+ */
+void afaaq_destroy(afaaq_t *faaq);
+
+#endif /* ! ATOMICKIT_FAAQ_H */
@@ -0,0 +1,158 @@
+/** @file iqueue.h
+ * Atomic Intrusive Queue
+ *
+ * Implements an unlimited FIFO queue of reference counted items which carry
+ * their own link, so that enqueueing allocates nothing and touches only the
+ * item and the tail of the queue.  An item embeds a `struct aiqueue_node` in
+ * place of a `struct arcp_region`:
+ *
+ *     struct my_item {
+ *             struct aiqueue_node;
+ *             ...
+ *     };
+ *
+ * and its destruction function must call `aiqueue_node_finalize`.
+ *
+ * Unlike `aqueue_t`, this is a multi-producer, single-consumer queue, and it
+ * is not lock free.  Any number of threads may enqueue at once, but only one
+ * thread may dequeue at a time.  As in `aqueue_t`, the first node of the
+ * queue is a sentinel, and the queue holds a reference to the last dequeued
+ * item until the next item is dequeued.  Here, though, the sentinel is the
+ * last dequeued item itself, so an item may be in at most one queue at a
+ * time, and may not be enqueued again until it has stopped being its last
+ * queue's sentinel; see `aiqueue_done`.
+ *
+ * Enqueueing swaps the item into the tail with `arcp_swap`, a single atomic
+ * exchange, and then links the old tail to it with `arcp_store`, another,
+ * rather than using the compare and swap loop of `aqueue_t`.  With items that
+ * come back to the queue, a compare and swap can succeed against an item that
+ * has left and been enqueued again since it was loaded; a swap cannot.
+ * Enqueueing is wait free, but the price is that dequeueing can be blocked:
+ * an item whose enqueuer has swapped it in but not yet linked it is not yet
+ * visible to `aiqueue_deq`, and neither is any item enqueued after it, so an
+ * enqueuer stalled between its two steps hides the rest of the queue from the
+ * consumer until it runs again.
+ *
+ * This algorithm is Dmitry Vyukov's intrusive MPSC node-based queue.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_IQUEUE_H
+#define ATOMICKIT_IQUEUE_H 1
+
+#include <stdbool.h>
+#include <atomickit/rcp.h>
+
+/**
+ * Intrusive queue link, embedded at the start of each item.
+ */
+#ifdef __cplusplus
+struct aiqueue_node : arcp_region {
+#else
+struct aiqueue_node {
+	struct arcp_region;
+#endif
+	arcp_t next;			/**< the next item in the queue */
+	struct aiqueue_node *reap;	/**< the next node awaiting release,
+					 *   while a chain of nodes is being
+					 *   destroyed */
+};
+
+/**
+ * Atomic Intrusive Queue.
+ */
+typedef struct {
+	arcp_t head;		/**< the sentinel */
+	arcp_t tail;		/**< the last item in the queue */
+} aiqueue_t;
+
+/**
+ * Initializes the link of an item, after `arcp_region_init`.
+ *
+ * @param node the item to initialize.
+ */
+static inline void aiqueue_node_init(struct aiqueue_node *node) {
+	arcp_init(&node->next, NULL);
+	node->reap = NULL;
+}
+
+/**
+ * Releases what the link of an item refers to.  This must be called from the
+ * destruction function of every item.
+ *
+ * @param node the item being destroyed.
+ */
+void aiqueue_node_finalize(struct aiqueue_node *node);
+
+/**
+ * Initializes a queue.
+ *
+ * @param aiqueue a pointer to the queue being initialized.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int aiqueue_init(aiqueue_t *aiqueue);
+
+/**
+ * Enqueues the given item.  The item may not be in any queue, or be the
+ * sentinel of any queue.  The caller keeps its reference to the item.
+ *
+ * @param aiqueue a pointer to the queue in which the item is being enqueued.
+ * @param node a pointer to the item to enqueue.
+ */
+void aiqueue_enq(aiqueue_t *aiqueue, struct aiqueue_node *node);
+
+/**
+ * Dequeues an item, which becomes the sentinel of the queue.  Only one thread
+ * may dequeue from a queue at a time.  The old sentinel's link to the item is
+ * cleared before the item takes its place, so an item which is done links to
+ * nothing, and nothing earlier in the queue still links to it.
+ *
+ * @param aiqueue a pointer to the queue from which the item is being dequeued.
+ *
+ * @returns a pointer to the dequeued item, or NULL if the queue was empty or
+ * the next item is still being linked in by its enqueuer.  In the latter case
+ * the queue may hold any number of items behind the one being linked, which
+ * will not be dequeued until its enqueuer finishes.
+ */
+struct aiqueue_node *aiqueue_deq(aiqueue_t *aiqueue);
+
+/**
+ * Checks whether a dequeued item has stopped being the sentinel of the queue
+ * it was dequeued from, and so may be enqueued again.  Once this is true it
+ * stays true until the item is enqueued again, and until then the item
+ * neither links to another item nor is linked to by one.
+ *
+ * @param aiqueue a pointer to the queue from which the item was dequeued.
+ * @param node a pointer to the item.
+ *
+ * @returns true if the queue is done with the item, false otherwise.
+ */
+static inline bool aiqueue_done(aiqueue_t *aiqueue, struct aiqueue_node *node) {
+	return (struct aiqueue_node *) arcp_load_phantom(&aiqueue->head)
+		!= node;
+}
+
+/**
+ * Destroys a queue, releasing the items still in it.
+ *
+ * @param aiqueue a pointer to the queue being destroyed.
+ */
+void aiqueue_destroy(aiqueue_t *aiqueue);
+
+#endif /* ! ATOMICKIT_IQUEUE_H */
@@ -0,0 +1,118 @@
+/** @file multiqueue.h
+ * Atomic Multi-Queue
+ *
+ * Implements an unlimited lock free queue of reference counted items with
+ * relaxed ordering, for throughput when many threads enqueue and dequeue at
+ * once.  The queue is a number of shards, each an `afaaq_t`.  Each thread
+ * always enqueues to the same shard, chosen when it first enqueues, so the
+ * items enqueued by any one thread still come out in the order it enqueued
+ * them; items from different threads come out in no particular order.
+ *
+ * A dequeuer picks two shards at random and takes from whichever has more
+ * items in it ("the power of two choices"), which keeps the shards about
+ * equally full without any thread looking at all of them.  Only if both are
+ * empty does it sweep the rest.
+ *
+ * As with `aqueue_t`, the queue takes its own reference to each enqueued item
+ * and hands that reference to whoever dequeues it.  Items may not be NULL.
+ *
+ * This follows Hamza Rihani, Peter Sanders, and Roman Dementiev,
+ * "MultiQueues: Simpler, Faster, and Better Relaxed Concurrent Priority
+ * Queues," 2014, applied to FIFO queues.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_MULTIQUEUE_H
+#define ATOMICKIT_MULTIQUEUE_H 1
+
+#include <stddef.h>
+#include <stdalign.h>
+#include <atomickit/atomic.h>
+#include <atomickit/rcp.h>
+#include <atomickit/faaq.h>
+
+/**
+ * The alignment that keeps the size of a shard from sharing a cache line
+ * with its queue.
+ */
+#define __AMULTIQUEUE_CACHELINE 64
+
+/**
+ * Multi-queue shard.  The shards are allocated with `amalloc`, which does
+ * not promise cache line alignment, so `amultiqueue_init` aligns them
+ * itself.
+ */
+struct amultiqueue_shard {
+	afaaq_t queue;			/**< the items */
+	alignas(__AMULTIQUEUE_CACHELINE)
+	atomic_size_t size;		/**< about how many items there are;
+					 *   never less than the real
+					 *   number */
+};
+
+/**
+ * Atomic Multi-Queue.
+ */
+typedef struct {
+	struct amultiqueue_shard *shards;	/**< the shards */
+	size_t nshards;				/**< the number of shards */
+	void *mem;				/**< the allocation holding
+						 *   the shards, which may
+						 *   start before them */
+} amultiqueue_t;
+
+/**
+ * Initializes a multi-queue.
+ *
+ * @param mq a pointer to the queue being initialized.
+ * @param nshards the number of shards, or zero for one per online
+ * processor.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int amultiqueue_init(amultiqueue_t *mq, size_t nshards);
+
+/**
+ * Enqueues the given item on the calling thread's shard.
+ *
+ * @param mq a pointer to the queue in which the item is being enqueued.
+ * @param item a pointer to the item to enqueue, which may not be NULL.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int amultiqueue_enq(amultiqueue_t *mq, struct arcp_region *item);
+
+/**
+ * Dequeues an item from some shard.
+ *
+ * @param mq a pointer to the queue from which the item is being dequeued.
+ *
+ * @returns a pointer to the dequeued item, or NULL if every shard was
+ * empty.
+ */
+struct arcp_region *amultiqueue_deq(amultiqueue_t *mq);
+
+/**
+ * Destroys a multi-queue, releasing any items still in it.  No other thread
+ * may be using the queue.
+ *
+ * @param mq a pointer to the queue being destroyed.
+ */
+void amultiqueue_destroy(amultiqueue_t *mq);
+
+#endif /* ! ATOMICKIT_MULTIQUEUE_H */
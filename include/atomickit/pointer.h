@@ -0,0 +1,290 @@
+/** @file pointer.h
+ * Tagged Pointers
+ *
+ * Utilities for storing small amounts of data in the unused bits of a
+ * pointer.  The low bits are free because of alignment, and how many there
+ * are depends on what is pointed to.  The high bits are free because user
+ * space addresses don't use the whole width of a pointer; how many there are
+ * depends on the architecture, and may be none.  A tagged pointer must have
+ * all its tags stripped before it is dereferenced.
+ *
+ * Counts are the most common tag, so a count field, given by its shift and
+ * its maximum value, has its own set of operations, including atomic
+ * increment and decrement.  `APTR_COUNTSHIFT` and `APTR_COUNTMAX` choose the
+ * widest field available.
+ *
+ * Where a tag won't fit in a pointer, `aptr_pair_t` pairs a pointer with a
+ * full-width counter that can be compared and swapped together with it.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ * 
+ * This file is part of Atomic Kit.
+ * 
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ * 
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_POINTER_H
+#define ATOMICKIT_POINTER_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <atomickit/atomic.h>
+
+/**
+ * The number of bits in a pointer.
+ */
+#define APTR_BITS (sizeof(uintptr_t) * 8)
+
+/**
+ * The number of unused high bits in a pointer on this architecture.  This is
+ * a plain integer constant, so it may be tested with `#if`.
+ */
+#define APTR_HIGHBITS __AK_PTR_HIGHBITS
+
+/**
+ * The position of the lowest unused high bit.
+ */
+#define APTR_HIGHSHIFT (APTR_BITS - APTR_HIGHBITS)
+
+/**
+ * The mask for bit `n` of the unused high bits, counting up from
+ * `APTR_HIGHSHIFT`.
+ */
+#define APTR_HIGHBIT(n) (((uintptr_t) 1) << (APTR_HIGHSHIFT + (n)))
+
+#if APTR_HIGHBITS > 0
+/**
+ * The mask for the unused high bits.
+ */
+# define APTR_HIGHMASK (~((uintptr_t) 0) << APTR_HIGHSHIFT)
+#else
+# define APTR_HIGHMASK ((uintptr_t) 0)
+#endif
+
+/**
+ * The mask for the unused low bits of a pointer to something with the given
+ * alignment, which must be a power of two.
+ */
+#define APTR_LOWMASK(align) (((uintptr_t) (align)) - 1)
+
+/**
+ * Gets the low tag of a pointer.
+ */
+#define aptr_low(ptr, align) (((uintptr_t) (ptr)) & APTR_LOWMASK(align))
+
+/**
+ * Sets the low tag of a pointer.
+ */
+#define aptr_setlow(ptr, align, tag)					\
+	((__typeof__((void) 0, (ptr)))					\
+	 ((((uintptr_t) (ptr)) & ~APTR_LOWMASK(align)) | ((uintptr_t) (tag))))
+
+#if APTR_HIGHBITS > 0
+/**
+ * Gets the high tag of a pointer.
+ */
+# define aptr_high(ptr) (((uintptr_t) (ptr)) >> APTR_HIGHSHIFT)
+
+/**
+ * Sets the high tag of a pointer.
+ */
+# define aptr_sethigh(ptr, tag)						\
+	((__typeof__((void) 0, (ptr)))					\
+	 ((((uintptr_t) (ptr)) & ~APTR_HIGHMASK)			\
+	  | (((uintptr_t) (tag)) << APTR_HIGHSHIFT)))
+#else
+# define aptr_high(ptr) ((void) (ptr), (uintptr_t) 0)
+# define aptr_sethigh(ptr, tag) ((void) (tag), (ptr))
+#endif
+
+/**
+ * Removes all tags from a pointer, so that it may be dereferenced.
+ */
+#define aptr_strip(ptr, align)						\
+	((__typeof__((void) 0, (ptr)))					\
+	 (((uintptr_t) (ptr)) & ~(APTR_LOWMASK(align) | APTR_HIGHMASK)))
+
+#if APTR_HIGHBITS > 0
+/**
+ * The shift of the widest count that fits in a pointer to something with the
+ * given alignment.  This is in the high bits if there are any, and the low
+ * bits otherwise.
+ */
+# define APTR_COUNTSHIFT(align) APTR_HIGHSHIFT
+
+/**
+ * The maximum value of the widest count that fits in a pointer to something
+ * with the given alignment.
+ */
+# define APTR_COUNTMAX(align) (APTR_HIGHMASK >> APTR_HIGHSHIFT)
+#else
+# define APTR_COUNTSHIFT(align) 0
+# define APTR_COUNTMAX(align) APTR_LOWMASK(align)
+#endif
+
+/**
+ * Gets the count in a pointer.
+ */
+#define aptr_count(ptr, shift, max)					\
+	((((uintptr_t) (ptr)) >> (shift)) & ((uintptr_t) (max)))
+
+/**
+ * Sets the count in a pointer.
+ */
+#define aptr_setcount(ptr, shift, max, count)				\
+	((__typeof__((void) 0, (ptr)))					\
+	 ((((uintptr_t) (ptr)) & ~(((uintptr_t) (max)) << (shift)))	\
+	  | (((uintptr_t) (count)) << (shift))))
+
+/**
+ * Removes the count from a pointer, leaving any other tags.
+ */
+#define aptr_decount(ptr, shift, max) aptr_setcount(ptr, shift, max, 0)
+
+/**
+ * Adds one to the count in a pointer, which must not be at its maximum.
+ */
+#define aptr_inc(ptr, shift)						\
+	((__typeof__((void) 0, (ptr)))					\
+	 (((uintptr_t) (ptr)) + (((uintptr_t) 1) << (shift))))
+
+/**
+ * Subtracts one from the count in a pointer, which must not be zero.
+ */
+#define aptr_dec(ptr, shift)						\
+	((__typeof__((void) 0, (ptr)))					\
+	 (((uintptr_t) (ptr)) - (((uintptr_t) 1) << (shift))))
+
+/**
+ * Atomically increments the count in a pointer, waiting while the count is
+ * at its maximum.
+ *
+ * @param object the atomic pointer.
+ * @param shift the shift of the count.
+ * @param max the maximum value of the count.
+ * @param order the memory order for the increment.
+ *
+ * @returns the new value of the pointer.
+ */
+#define aptr_ldinc(object, shift, max, order)				\
+({									\
+	__typeof__((void) 0, *(object)) __aptr_p;			\
+	__aptr_p = ak_load((object), mo_relaxed);			\
+	do {								\
+		while (unlikely(aptr_count(__aptr_p, (shift), (max))	\
+				== (uintptr_t) (max))) {		\
+			cpu_yield();					\
+			__aptr_p = ak_load((object), mo_relaxed);	\
+		}							\
+	} while (unlikely(!ak_cas((object), &__aptr_p,			\
+				  aptr_inc(__aptr_p, (shift)),		\
+				  (order), mo_relaxed)));		\
+	aptr_inc(__aptr_p, (shift));					\
+})
+
+/**
+ * Atomically decrements the count in a pointer, as long as the count is not
+ * zero and the rest of the pointer has not changed.
+ *
+ * @param object the atomic pointer.
+ * @param expected a pointer to the last value seen; on failure this is
+ * updated to the current value.
+ * @param shift the shift of the count.
+ * @param max the maximum value of the count.
+ * @param order the memory order for the decrement.
+ *
+ * @returns true if the count was decremented, false otherwise.
+ */
+#define aptr_lddec(object, expected, shift, max, order)			\
+({									\
+	__typeof__(expected) __aptr_e = (expected);			\
+	__typeof__(*__aptr_e) __aptr_base;				\
+	_Bool __aptr_r = 1;						\
+	__aptr_base = aptr_decount(*__aptr_e, (shift), (max));		\
+	while (unlikely(!ak_cas((object), __aptr_e,			\
+				aptr_dec(*__aptr_e, (shift)),		\
+				(order), mo_relaxed))) {		\
+		if (aptr_decount(*__aptr_e, (shift), (max)) != __aptr_base \
+		    || aptr_count(*__aptr_e, (shift), (max)) == 0) {	\
+			__aptr_r = 0;					\
+			break;						\
+		}							\
+	}								\
+	__aptr_r;							\
+})
+
+/**
+ * A pointer paired with a full-width counter, which are compared and swapped
+ * together.  Use only through the `aptr_pair` functions.
+ */
+typedef struct {
+	alignas(2 * sizeof(uintptr_t)) void *ptr;	/**< the pointer */
+	uintptr_t count;				/**< the counter */
+} aptr_pair_t;
+
+/**
+ * Initializes a pointer pair.  This is not atomic.
+ *
+ * @param pair the pair to initialize.
+ * @param ptr the initial pointer.
+ * @param count the initial counter.
+ */
+static inline void aptr_pair_init(volatile aptr_pair_t *pair, void *ptr,
+				  uintptr_t count) {
+	pair->ptr = ptr;
+	pair->count = count;
+}
+
+/**
+ * Compares and swaps a pointer pair.  This is always sequentially
+ * consistent.
+ *
+ * @param pair the pair to update.
+ * @param expected the value the pair should have; on failure this is updated
+ * to the value it does have.
+ * @param desired the value to store.
+ *
+ * @returns true if the pair was updated, false otherwise.
+ */
+static inline bool aptr_pair_cas(volatile aptr_pair_t *pair,
+				 aptr_pair_t *expected,
+				 aptr_pair_t desired) {
+	uintptr_t lo, hi;
+	bool ret;
+	lo = (uintptr_t) expected->ptr;
+	hi = expected->count;
+	ret = __ak_cas2(pair, &lo, &hi, (uintptr_t) desired.ptr,
+			desired.count);
+	expected->ptr = (void *) lo;
+	expected->count = hi;
+	return ret;
+}
+
+/**
+ * Atomically loads a pointer pair.  The pair must be in writable memory.
+ *
+ * @param pair the pair to load.
+ *
+ * @returns the value of the pair.
+ */
+static inline aptr_pair_t aptr_pair_load(volatile aptr_pair_t *pair) {
+	aptr_pair_t ret = { NULL, 0 };
+	/* fails, loading the value, unless the value is the one being
+	 * stored anyway */
+	aptr_pair_cas(pair, &ret, ret);
+	return ret;
+}
+
+#endif /* ! ATOMICKIT_POINTER_H */
@@ -0,0 +1,136 @@
+/** @file pq.h
+ * Atomic Priority Queue
+ *
+ * Implements an unlimited lock free priority queue of reference counted
+ * items, each inserted with a 64-bit priority.  `apq_delete_min` removes an
+ * item with the lowest priority; items of equal priority come out in no
+ * particular order.  The queue is a skiplist: every item is in a sorted list
+ * at level 0, and a random subset of each level is in the level above, so
+ * that inserting takes a logarithmic number of steps.
+ *
+ * Deleting the minimum claims the first item at level 0 which nobody else
+ * has claimed, by setting its deleted flag, and then unlinks it.  Before
+ * unlinking, the deleter links the item to its own embedded marker, and the
+ * marker to the item's successor; since nothing can be inserted after a
+ * marker, nothing inserted after the item while it is being unlinked can be
+ * lost.  This is the technique of Doug Lea's ConcurrentSkipListMap.  Levels
+ * above 0 only speed up the search; a deleted item found there is simply
+ * unlinked.
+ *
+ * `apq_delete_min` is exact when nothing is being inserted at the same time.
+ * An item inserted at a lower priority than the one being deleted, while it
+ * is being deleted, may be passed over; neither will be lost.
+ *
+ * Nodes are allocated with `arcp_alloc`, so a node stays alive while any
+ * thread is looking at it, and the queue holds its own reference to each
+ * item.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_PQ_H
+#define ATOMICKIT_PQ_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <atomickit/atomic.h>
+#include <atomickit/rcp.h>
+
+/**
+ * The most levels a skiplist node may have.
+ */
+#define APQ_MAX_LEVEL 24
+
+/**
+ * Deletion marker, embedded in each node.
+ */
+#ifdef __cplusplus
+struct apq_marker : arcp_region {
+#else
+struct apq_marker {
+	struct arcp_region;
+#endif
+	arcp_t next;			/**< the successor of the deleted
+					 *   node */
+};
+
+/**
+ * Skiplist node.
+ */
+#ifdef __cplusplus
+struct apq_node : arcp_region {
+#else
+struct apq_node {
+	struct arcp_region;
+#endif
+	uint64_t prio;			/**< the priority of the item */
+	arcp_t item;			/**< the item */
+	atomic_bool deleted;		/**< set once the item is claimed */
+	int level;			/**< the number of levels */
+	struct apq_marker marker;	/**< linked after the node when it
+					 *   is being unlinked */
+	arcp_t next[];			/**< the next node at each level */
+};
+
+/**
+ * Atomic Priority Queue.
+ */
+typedef struct {
+	struct apq_node *head;	/**< a node with every level, before all
+				 *   items */
+	atomic_int level;	/**< the most levels any node has had */
+} apq_t;
+
+/**
+ * Initializes a priority queue.
+ *
+ * @param pq a pointer to the queue being initialized.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int apq_init(apq_t *pq);
+
+/**
+ * Inserts an item.
+ *
+ * @param pq a pointer to the queue in which the item is being inserted.
+ * @param prio the priority of the item; lower comes out first.
+ * @param item a pointer to the item to insert, which may not be NULL.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int apq_insert(apq_t *pq, uint64_t prio, struct arcp_region *item);
+
+/**
+ * Removes an item with the lowest priority.
+ *
+ * @param pq a pointer to the queue from which the item is being removed.
+ * @param priop where to put the priority of the item, or NULL.
+ *
+ * @returns a pointer to the removed item, or NULL if the queue was empty.
+ */
+struct arcp_region *apq_delete_min(apq_t *pq, uint64_t *priop);
+
+/**
+ * Destroys a priority queue, releasing any items still in it.  No other
+ * thread may be using the queue.
+ *
+ * @param pq a pointer to the queue being destroyed.
+ */
+void apq_destroy(apq_t *pq);
+
+#endif /* ! ATOMICKIT_PQ_H */
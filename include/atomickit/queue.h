@@ -29,16 +29,26 @@
 #ifndef ATOMICKIT_QUEUE_H
 #define ATOMICKIT_QUEUE_H 1
 
+#include <stddef.h>
 #include <stdbool.h>
+#include <time.h>
+#include <atomickit/atomic.h>
 #include <atomickit/rcp.h>
 
 /**
  * Queue node
  */
+#ifdef __cplusplus
+struct aqueue_node : arcp_region {
+#else
 struct aqueue_node {
 	struct arcp_region;
+#endif
 	arcp_t next;		/**< the next item in the queue */
 	arcp_t item;		/**< the content of this node */
+	struct aqueue_node *reap;
+				/**< the next node awaiting release, while
+				 *   a chain of nodes is being destroyed */
 };
 
 /**
@@ -47,6 +57,9 @@ struct aqueue_node {
 typedef struct {
 	arcp_t head;		/**< the first item in the queue */
 	arcp_t tail;		/**< the last item in the queue */
+	atomic_uint seq;	/**< advanced on each enqueue that has
+				 *   waiters to wake; waiters sleep on it */
+	atomic_uint waiters;	/**< the number of waiting dequeuers */
 } aqueue_t;
 
 /**
@@ -54,7 +67,7 @@ typedef struct {
  */
 #define AQUEUE_NODE_VAR_INIT(ptrcount, refcount, next, item)	\
 	{ ARCP_REGION_VAR_INIT(ptrcount, refcount, NULL, NULL),	\
-	  ARCP_VAR_INIT(next), ARCP_VAR_INIT(item) }
+	  ARCP_VAR_INIT(next), ARCP_VAR_INIT(item), NULL }
 
 /**
  * Initialization value for a sentinel `struct aqueue_node`.
@@ -65,8 +78,14 @@ typedef struct {
 /**
  * Initialization value for `aqueue_t`.
  */
-#define AQUEUE_VAR_INIT(head, tail) \
-	{ ARCP_VAR_INIT(head), ARCP_VAR_INIT(tail) }
+#define AQUEUE_VAR_INIT(head, tail)				\
+	{ ARCP_VAR_INIT(head), ARCP_VAR_INIT(tail),		\
+	  ATOMIC_VAR_INIT(0), ATOMIC_VAR_INIT(0) }
+
+/**
+ * The number of times `aqueue_deq_wait` tries to dequeue before it sleeps.
+ */
+#define AQUEUE_WAIT_SPINS 128
 
 /**
  * Initializes a queue.
@@ -87,6 +106,20 @@ int aqueue_init(aqueue_t *aqueue);
  */
 int aqueue_enq(aqueue_t *aqueue, struct arcp_region *item);
 
+/**
+ * Enqueues several items at once.  The nodes for the items are linked
+ * together privately and then added to the queue with a single compare and
+ * swap, so the items are adjacent in the queue and either all or none of
+ * them are enqueued.
+ *
+ * @param aqueue a pointer to the queue in which the items are being enqueued.
+ * @param items the items to enqueue, in order.
+ * @param n the number of items.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int aqueue_enq_n(aqueue_t *aqueue, struct arcp_region **items, size_t n);
+
 /**
  * Dequeues an item.
  *
@@ -96,6 +129,49 @@ int aqueue_enq(aqueue_t *aqueue, struct arcp_region *item);
  */
 struct arcp_region *aqueue_deq(aqueue_t *aqueue);
 
+/**
+ * Dequeues an item, waiting for one if the queue is empty.  The caller spins
+ * for a short while and then sleeps until an item is enqueued.  Enqueuers
+ * only make a system call to wake the caller while there is a caller to
+ * wake.
+ *
+ * @param aqueue a pointer to the queue from which the item is being dequeued.
+ * @param timeout the longest to wait, or NULL to wait indefinitely.
+ *
+ * @returns a pointer to the dequeued item, or NULL if the timeout expired.
+ */
+struct arcp_region *aqueue_deq_wait(aqueue_t *aqueue,
+				    const struct timespec *timeout);
+
+/**
+ * Dequeues up to `n` items at once, detaching them from the queue with a
+ * single compare and swap.
+ *
+ * @param aqueue a pointer to the queue from which the items are being
+ * dequeued.
+ * @param items where to put the dequeued items.
+ * @param n the room in `items`.
+ *
+ * @returns the number of items dequeued.
+ */
+size_t aqueue_deq_n(aqueue_t *aqueue, struct arcp_region **items, size_t n);
+
+/**
+ * Dequeues every item in the queue at once, detaching them from the queue
+ * with a single compare and swap.  Items enqueued while the queue is being
+ * drained may be left in the queue.
+ *
+ * @param aqueue a pointer to the queue being drained.
+ * @param fn the function to call with each dequeued item, in order.  It is
+ * given the reference to the item that was held by the queue.
+ * @param arg an argument to pass to `fn`.
+ *
+ * @returns the number of items dequeued.
+ */
+size_t aqueue_drain(aqueue_t *aqueue,
+		    void (*fn)(struct arcp_region *item, void *arg),
+		    void *arg);
+
 /**
  * Returns a pointer to the first item without dequeueing it.
  *
@@ -32,12 +32,15 @@
 #ifndef ATOMICKIT_RCP_H
 #define ATOMICKIT_RCP_H 1
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdalign.h>
 #include <atomickit/atomic.h>
+#include <atomickit/pointer.h>
 
 struct arcp_region;
+struct arcp_shards;
 
 /**
  * Atomic Reference Counted Pointer
@@ -51,6 +54,42 @@ typedef _Atomic(struct arcp_region *) arcp_t;
  */
 typedef void (*arcp_destroy_f)(struct arcp_region *);
 
+/**
+ * Whether to use the 64-bit refcount layout.
+ *
+ * The 64-bit layout allows 2^30 - 1 stored and 2^31 - 1 checked out
+ * references to a region; the 32-bit layout allows 2^14 - 1 and 2^15 - 1.
+ * Both are updated with a single compare and swap.  The default is the 64-bit
+ * layout on 64-bit targets.  If this is defined, it must be defined to the
+ * same value when building the library and when building code which uses it.
+ */
+#ifndef ARCP_WIDE_REFCOUNT
+# if UINTPTR_MAX > UINT32_MAX
+#  define ARCP_WIDE_REFCOUNT 1
+# else
+#  define ARCP_WIDE_REFCOUNT 0
+# endif
+#endif
+
+#if ARCP_WIDE_REFCOUNT
+/**
+ * The type for the refcount as it is stored in an arcp_region.
+ */
+typedef union {
+	struct {
+		unsigned int destroy_lock:1;	/**< Lock during attempted
+						 *   destruction */
+		int storecount:31;		/**< Number of pointers
+						 *   referencing this */
+		int32_t usecount;		/**< Number of checked out
+						 *   references */
+	} v;					/**< value */
+	uint_least64_t p;			/**< pun */
+} arcp_refcount_t;
+
+/* The atomic type in which the refcount pun is stored */
+typedef atomic_uint_least64_t __arcp_atomic_refcount_t;
+#else
 /**
  * The type for the refcount as it is stored in an arcp_region.
  */
@@ -66,6 +105,10 @@ typedef union {
 	uint_least32_t p;			/**< pun */
 } arcp_refcount_t;
 
+/* The atomic type in which the refcount pun is stored */
+typedef atomic_uint_least32_t __arcp_atomic_refcount_t;
+#endif
+
 /**
  * Atomic Reference Counted Region
  *
@@ -78,12 +121,14 @@ typedef union {
 struct arcp_region {
 	arcp_destroy_f destroy;			/**< Pointer to a destruction
 						 *   function. */
-	atomic_uint_least32_t refcount;		/**< References to this
+	__arcp_atomic_refcount_t refcount;	/**< References to this
 						 *   region. */
 	arcp_t weakref;				/**< Pointer to the weak
 						 *   reference for this
 						 *   region; initially
 						 *   NULL. */
+	struct arcp_shards *shards;		/**< Sharded reference
+						 *   counts, or NULL. */
 };
 
 /**
@@ -93,72 +138,172 @@ struct arcp_region {
  * a strong reference.  It is itself an `arcp_region` and can/should be stored
  * in `arcp_t` containers.
  */
+#ifdef __cplusplus
+struct arcp_weakref : arcp_region {
+#else
 struct arcp_weakref {
 	struct arcp_region;
+#endif
 	arcp_t target;				/**< The arcp_region to which
 						 *   this is a reference. */
 };
 
 /**
- * The alignment of the data portion of an rcp region. The maximum number of
- * threads concurrently checking out a given item from a given transaction
- * (not the number who concurrenty have the item checked out, which should be
- * sufficient for all purposes) will be equal to `ARCP_ALIGN - 1`. Check out
- * will block for all threads above this threshold.
+ * Versioned Atomic Reference Counted Pointer
+ *
+ * A reference counted pointer paired with a version which changes whenever
+ * the pointer is stored to, so that readers holding an `arcp_cache` can tell
+ * that their cached region is current with a single load, and
+ * `arcp_load_snapshot` can tell that a pointer has not been stored to at all
+ * even if it holds the same region again.  The pointer may be read with any
+ * of the `arcp_t` functions, but must only be changed with
+ * `arcp_versioned_store`, by at most 127 threads at once.
+ */
+typedef struct {
+	arcp_t rcp;			/**< The pointer itself */
+	atomic_uintptr_t version;	/**< Odd; changed by each store */
+} arcp_versioned_t;
+
+/**
+ * Cached Read of a Versioned Atomic Reference Counted Pointer
+ *
+ * A single thread's last loaded region from an `arcp_versioned_t`, with the
+ * version at which it was loaded.  The cache holds a reference to the
+ * region.
+ */
+struct arcp_cache {
+	struct arcp_region *region;	/**< The cached region */
+	uintptr_t version;		/**< The version of the cached region,
+					 *   or 0 if nothing is cached */
+};
+
+/**
+ * The alignment of the data portion of an rcp region. Where pointers have no
+ * unused high bits, the maximum number of threads concurrently checking out
+ * a given item from a given transaction (not the number who concurrenty have
+ * the item checked out, which should be sufficient for all purposes) will be
+ * equal to `ARCP_ALIGN - 1`; otherwise it is one less than two to the power
+ * of `APTR_HIGHBITS - 1`. Check out will block for all threads above this
+ * threshold.
  */
 #define ARCP_ALIGN alignof(struct arcp_region *)
 
-/* The mask for the transaction count. */
-#define __ARCP_COUNTMASK ((uintptr_t) (ARCP_ALIGN - 1))
+/**
+ * The number of per-thread subcounters used by a region initialized with
+ * `arcp_region_init_sharded`.  Must be a power of two.
+ */
+#define ARCP_NSHARDS 16
+
+#if APTR_HIGHBITS > 1
+/* The transaction count lives in the high bits, below the bit marking a
+ * transaction descriptor (see txn.h). */
+# define __ARCP_COUNTSHIFT APTR_HIGHSHIFT
+# define __ARCP_COUNTMAX ((((uintptr_t) 1) << (APTR_HIGHBITS - 1)) - 1)
+# define __ARCP_TXNBIT APTR_HIGHBIT(APTR_HIGHBITS - 1)
+#else
+/* The transaction count lives in the low bits, and there are no
+ * transactions. */
+# define __ARCP_COUNTSHIFT 0
+# define __ARCP_COUNTMAX APTR_LOWMASK(ARCP_ALIGN)
+# define __ARCP_TXNBIT ((uintptr_t) 0)
+#endif
 
 /* Gets the count for a given pointer. */
-#define __ARCP_PTR2COUNT(ptr) (((uintptr_t) (ptr)) & __ARCP_COUNTMASK)
+#define __ARCP_PTR2COUNT(ptr)						\
+	aptr_count(ptr, __ARCP_COUNTSHIFT, __ARCP_COUNTMAX)
 
 /* Sets the count for a given pointer. */
 #define __ARCP_PTRSETCOUNT(ptr, count)					\
 	((struct arcp_region *)						\
-	 ((((uintptr_t) (ptr)) & ~__ARCP_COUNTMASK) | ((uintptr_t) (count))))
+	 aptr_setcount(ptr, __ARCP_COUNTSHIFT, __ARCP_COUNTMAX, count))
 
 /* Increments the count for a given pointer. */
 #define __ARCP_PTRINC(ptr)						\
-	((struct arcp_region *)						\
-	 (((uintptr_t) (ptr)) + 1))
+	((struct arcp_region *) aptr_inc(ptr, __ARCP_COUNTSHIFT))
 
 /* Decrements the count for a given pointer. */
 #define __ARCP_PTRDEC(ptr)						\
-	((struct arcp_region *)						\
-	 (((uintptr_t) (ptr)) - 1))
+	((struct arcp_region *) aptr_dec(ptr, __ARCP_COUNTSHIFT))
 
 /* Separates the pointer from the count */
 #define __ARCP_PTRDECOUNT(ptr)						\
 	((struct arcp_region *)						\
-	 (((uintptr_t) (ptr)) & ~__ARCP_COUNTMASK))
+	 aptr_decount(ptr, __ARCP_COUNTSHIFT, __ARCP_COUNTMAX))
+
+/* Tests whether a pointer holds a transaction descriptor. */
+#define __ARCP_PTR2TXN(ptr) ((((uintptr_t) (ptr)) & __ARCP_TXNBIT) != 0)
+
+/* Marks a pointer as holding a transaction descriptor. */
+#define __ARCP_PTRSETTXN(ptr)						\
+	((struct arcp_region *)						\
+	 (((uintptr_t) (ptr)) | __ARCP_TXNBIT))
+
+/* Separates the transaction descriptor from its mark. */
+#define __ARCP_PTRDETXN(ptr)						\
+	((struct arcp_region *)						\
+	 (((uintptr_t) (ptr)) & ~__ARCP_TXNBIT))
+
+/* The version of an arcp_versioned_t counts finished stores from bit 8 up
+ * and stores in progress in bits 1 to 7; bit 0 is always set. */
+#define __ARCP_VERSION_WRITER ((uintptr_t) 2)
+#define __ARCP_VERSION_STORED ((uintptr_t) 256)
+#define __ARCP_VERSION_WRITERS(version)				\
+	(((uintptr_t) (version)) & (__ARCP_VERSION_STORED - 2))
+
+/**
+ * The number of regions a thread may have borrowed at once with
+ * `arcp_borrow` before further borrows fall back to ordinary references.
+ */
+#define ARCP_NBORROWS 4
+
+/**
+ * Whether the library counts contention on reference counted pointers.
+ *
+ * When the library is built with this defined to 1, retried refcount updates,
+ * spins on saturated pointers, failed compare and swaps and destructions are
+ * counted, and can be retrieved with `arcp_stats_top`.  Otherwise the
+ * statistics functions exist but report nothing.
+ */
+#ifndef ARCP_INSTRUMENT
+# define ARCP_INSTRUMENT 0
+#endif
 
 /**
  * Initialization value for `arcp_t`.
  */
 #define ARCP_VAR_INIT(region) ATOMIC_VAR_INIT(region)
 
-/* Initialization value for a uint32_t that is punned as an arcp_refcount_t */
+/* Initialization value for an integer that is punned as an arcp_refcount_t */
 #define __ARCP_REFCOUNT_INIT(scount, ucount)				\
 	(((arcp_refcount_t)						\
 	  { .v = { .destroy_lock = 0,					\
 		   .storecount = (scount),				\
 		  .usecount = (ucount) }}).p)
 
+/**
+ * Initialization value for `arcp_versioned_t`.
+ */
+#define ARCP_VERSIONED_VAR_INIT(region)					\
+	{ ARCP_VAR_INIT(region), ATOMIC_VAR_INIT(1) }
+
+/**
+ * Initialization value for an empty `struct arcp_cache`.
+ */
+#define ARCP_CACHE_VAR_INIT { NULL, 0 }
+
 /**
  * Initialization value for `struct arcp_region`.
  */
 #define ARCP_REGION_VAR_INIT(storecount, usecount, destroy, weakref)	\
 	{ destroy, ATOMIC_VAR_INIT(__ARCP_REFCOUNT_INIT((storecount),	\
 							(usecount))),	\
-	  ARCP_VAR_INIT(weakref) }
+	  ARCP_VAR_INIT(weakref), NULL }
 
 /**
  * Static initialization value for `struct arcp_region`.
  */
 #define ARCP_REGION_STATIC_VAR_INIT(weakref)			\
-	{ NULL, ATOMIC_VAR_INIT(1), ARCP_VAR_INIT(weakref) }
+	{ NULL, ATOMIC_VAR_INIT(1), ARCP_VAR_INIT(weakref), NULL }
 /* note that it doesn't matter where the 1 goes, to the destroy_lock,
  * storecount, or usecount; it will always block collection. */
 
@@ -183,6 +328,56 @@ struct arcp_weakref {
  */
 void arcp_region_init(struct arcp_region *region, arcp_destroy_f destroy);
 
+/**
+ * Allocates and initializes a reference counted region.
+ *
+ * The region is initialized as with `arcp_region_init`, but the library
+ * records its size and frees it itself once it is no longer in use, so no
+ * destruction function need be written just to call `afree`.
+ *
+ * @param size the size of the region, including the `struct arcp_region` at
+ * its start.
+ * @param finalize a function to call on the region before it is freed, or
+ * NULL if no cleanup is needed.  It must not free the region.
+ *
+ * @returns the new region, or NULL if allocation failed.
+ */
+void *arcp_alloc(size_t size, arcp_destroy_f finalize);
+
+/**
+ * Frees a region allocated with `arcp_alloc` which was never used, without
+ * calling its finalizer; for when setting up the rest of the region fails.
+ *
+ * @param region the region to free, to which there must be no other
+ * references.
+ */
+void arcp_alloc_free(void *region);
+
+/**
+ * Initializes a reference counted region whose use count is sharded.
+ *
+ * This is meant for the few regions which are acquired and released by many
+ * threads at once, such as a global configuration stored in an `arcp_t`.
+ * Once such a region is stored in at least one `arcp_t` and then used, the
+ * use count changes made by `arcp_acquire`, `arcp_release`, and `arcp_load`
+ * go to one of `ARCP_NSHARDS` per-thread subcounters rather than to the
+ * shared reference count.  When the region is no longer stored anywhere, the
+ * subcounters are folded back into the reference count, so the region is
+ * still destroyed exactly when its last reference is released.
+ *
+ * While the subcounters are in use `arcp_usecount` and `arcp_storecount` do
+ * not reflect the true counts.
+ *
+ * @param region a pointer to a reference counted region.
+ * @param destroy pointer to a function that will destroy the region once it
+ * is no longer in use.
+ *
+ * @returns zero on success, nonzero on failure.  On failure the region is
+ * still initialized, but its use count is not sharded.
+ */
+int arcp_region_init_sharded(struct arcp_region *region,
+			     arcp_destroy_f destroy);
+
 /**
  * Initializes the weak reference for a reference counted region.
  *
@@ -203,6 +398,26 @@ int arcp_region_init_weakref(struct arcp_region *region);
  */
 void arcp_region_destroy_weakref(struct arcp_region *region);
 
+/**
+ * Allocates and initializes a reference counted region with a weak
+ * reference.
+ *
+ * As `arcp_alloc`, but the weak reference which `arcp_region_init_weakref`
+ * would allocate separately is placed immediately before the region in the
+ * same allocation.  The memory is freed once both the region and its weak
+ * reference are no longer in use, so a region which has outlived its weak
+ * references costs no extra allocation and a weak reference load touches
+ * adjacent memory.
+ *
+ * @param size the size of the region, including the `struct arcp_region` at
+ * its start.
+ * @param finalize a function to call on the region once it is no longer in
+ * use, or NULL if no cleanup is needed.  It must not free the region.
+ *
+ * @returns the new region, or NULL if allocation failed.
+ */
+void *arcp_alloc_weak(size_t size, arcp_destroy_f finalize);
+
 /**
  * Returns the current checked out reference count of the region.
  *
@@ -232,7 +447,7 @@ static inline int arcp_storecount(struct arcp_region *region);
  * @param region the region whose reference count should be incremented.
  */
 #define arcp_acquire(region) ((typeof(region)) __arcp_acquire(region))
-struct arcp_region *__arcp_acquire(struct arcp_region *region);
+static inline struct arcp_region *__arcp_acquire(struct arcp_region *region);
 
 /**
  * Returns a weak reference to this region.
@@ -262,7 +477,32 @@ static inline struct arcp_weakref *arcp_weakref_phantom(
  *
  * @param region the region to release a reference to.
  */
-void arcp_release(struct arcp_region *region);
+static inline void arcp_release(struct arcp_region *region);
+
+/**
+ * Increments the reference count of each region in an array.
+ *
+ * Equivalent to calling `arcp_acquire` on each element, but repeated
+ * pointers are folded into a single update of their reference count. NULL
+ * elements are skipped.
+ *
+ * @param regions the regions whose reference counts should be incremented.
+ * @param n the number of elements in `regions`.
+ */
+void arcp_acquire_n(struct arcp_region **regions, size_t n);
+
+/**
+ * Releases a reference to each region in an array.
+ *
+ * Equivalent to calling `arcp_release` on each element, but repeated
+ * pointers are folded into a single update of their reference count, and
+ * regions whose last reference is released are destroyed together once the
+ * counts have all been updated. NULL elements are skipped.
+ *
+ * @param regions the regions to release a reference to.
+ * @param n the number of elements in `regions`.
+ */
+void arcp_release_n(struct arcp_region **regions, size_t n);
 
 /**
  * Loads the item to which the weak reference refers.
@@ -298,7 +538,8 @@ void arcp_init(arcp_t *rcp, struct arcp_region *region);
  * Store a new region as the content of the reference counted pointer.
  *
  * The caller's references are untouched, so call `arcp_region_release()` on
- * newregion if you no longer intend to reference it.
+ * newregion if you no longer intend to reference it.  The store is a single
+ * atomic exchange, which never retries however contended the pointer is.
  *
  * @param rcp the pointer for which to commit the new content.
  * @param region the new content of the pointer.
@@ -339,6 +580,7 @@ struct arcp_region *arcp_load(arcp_t *rcp);
  */
 static inline struct arcp_region *arcp_load_phantom(arcp_t *rcp);
 
+
 /**
  * Acquires a strong reference to a region whose weak stub is currently stored
  * in a reference counted pointer.
@@ -350,12 +592,113 @@ static inline struct arcp_region *arcp_load_phantom(arcp_t *rcp);
  */
 struct arcp_region *arcp_load_weak(arcp_t *rcp);
 
+/**
+ * Borrow the contents of a reference counted pointer.
+ *
+ * The borrowed region is guaranteed to stay alive until it is returned with
+ * `arcp_unborrow`, without the reference count of the region being touched.
+ * Borrowing and returning write only to memory private to the calling thread,
+ * except that a thread's first outstanding borrow and its return each update
+ * a count shared by all threads.  While that count is nonzero, destroying any
+ * region scans every thread's borrows.  If the last reference to a borrowed
+ * region is released elsewhere, its destruction is deferred until it is
+ * returned, so borrows should be short.
+ *
+ * A thread may have `ARCP_NBORROWS` regions borrowed at once; any further
+ * borrows quietly take an ordinary reference instead.  A borrowed region must
+ * not be passed to `arcp_release` or `arcp_acquire`; use `arcp_load` on a
+ * pointer to obtain a reference which outlives the borrow.
+ *
+ * @param rcp the pointer from which to borrow the current contents.
+ *
+ * @returns the region currently stored in the reference counted pointer.
+ */
+struct arcp_region *arcp_borrow(arcp_t *rcp);
+
+/**
+ * Return a region borrowed with `arcp_borrow`.
+ *
+ * @param region the borrowed region, which may be NULL.
+ */
+void arcp_unborrow(struct arcp_region *region);
+
+/**
+ * Initializes a versioned reference counted pointer.
+ *
+ * This is not atomic.  Use `arcp_versioned_store` if there may be concurrent
+ * access.
+ *
+ * @param vrcp the versioned pointer to initialize.
+ * @param region the initial content of the pointer, which may be NULL.
+ */
+void arcp_versioned_init(arcp_versioned_t *vrcp, struct arcp_region *region);
+
+/**
+ * Stores a region in a versioned reference counted pointer and advances its
+ * version, so that readers using `arcp_cached_load` pick up the new region.
+ *
+ * @param vrcp the versioned pointer in which to store the region.
+ * @param region the region to store, which may be NULL.
+ */
+void arcp_versioned_store(arcp_versioned_t *vrcp, struct arcp_region *region);
+
+/**
+ * Acquires the contents of several versioned reference counted pointers at
+ * once.
+ *
+ * The regions returned were all stored in their pointers at the same moment,
+ * which separate calls to `arcp_load` do not guarantee.  The pointers are
+ * loaded and then their versions checked again until a check finds none of
+ * them stored to, so if there are no concurrent stores this takes two passes;
+ * under a constant stream of stores it may retry indefinitely.  Because the
+ * versions are compared rather than the regions, a region which is stored
+ * back into a pointer it had left is noticed like any other store.
+ *
+ * @param vrcps the pointers to load.
+ * @param n the number of elements in `vrcps`.
+ * @param regions the array in which to place a reference to the contents of
+ * each pointer.
+ * @param versions the array in which to place the version at which each
+ * region was loaded, suitable for filling an `arcp_cache`.
+ */
+void arcp_load_snapshot(arcp_versioned_t **vrcps, size_t n,
+			struct arcp_region **regions, uintptr_t *versions);
+
+/**
+ * Loads the region in a versioned reference counted pointer through a cache.
+ *
+ * If the pointer has not been stored to since the cache was filled, this is
+ * a single load of the version and returns the cached region.  Otherwise the
+ * current region is acquired into the cache and the previously cached region
+ * is released.
+ *
+ * No reference is returned to the caller: the returned region remains valid
+ * until the next `arcp_cached_load` or `arcp_cache_release` on the same cache.
+ * A cache must not be shared between threads.
+ *
+ * @param vrcp the versioned pointer to load.
+ * @param cache the calling thread's cache for `vrcp`.
+ *
+ * @returns the region currently stored in the versioned pointer.
+ */
+static inline struct arcp_region *arcp_cached_load(arcp_versioned_t *vrcp,
+						   struct arcp_cache *cache);
+
+/**
+ * Releases the reference held by a cache and empties it.
+ *
+ * @param cache the cache to empty.
+ */
+void arcp_cache_release(struct arcp_cache *cache);
+
 /**
  * Exchange a new region with the content of the reference counted pointer.
  *
  * This is unconditional and should only be used in special circumstances. The
  * caller's references are untouched, so call `arcp_region_release()` on
- * newregion if you no longer intend to reference it.
+ * newregion if you no longer intend to reference it.  Like `arcp_store`, this
+ * is a single atomic exchange, which never retries however contended the
+ * pointer is.
  *
  * @param rcp the pointer for which to commit the new content.
  * @param region the new content of the transaction.
@@ -389,7 +732,8 @@ struct arcp_region *arcp_exchange_weak(arcp_t *rcp,
  * oldregion and/or newregion if you no longer intend to reference them. Note
  * that the semantics of updating oldregion that might be expected in analogy
  * to `ak_cas` do not hold, as updating oldregion cannot be implemented as a
- * trivial side-effect of this operation.
+ * trivial side-effect of this operation.  A successful compare and swap is
+ * sequentially consistent.
  *
  * @param rcp the pointer for which to commit the new content.
  * @param oldregion the previous content of the transaction.
@@ -416,6 +760,157 @@ bool arcp_cas(arcp_t *rcp, struct arcp_region *oldregion,
 bool arcp_cas_release(arcp_t *rcp, struct arcp_region *oldregion,
 		      struct arcp_region *newregion);
 
+/**
+ * The number of times `arcp_update` tries to apply a transformation by
+ * itself before handing it to a combining writer.
+ */
+#define ARCP_UPDATE_TRIES 8
+
+/**
+ * Transformation applied by `arcp_update`.
+ *
+ * This may be called several times for a single update, and should have no
+ * effect besides building the new region.
+ *
+ * @param oldregion the current content of the pointer, which may be NULL.
+ * The function must not release it.
+ * @param newregion where to store the new content, which may be NULL.  The
+ * function passes a reference to it to `arcp_update`; if it stores
+ * `oldregion`, which it must then have acquired, the pointer is left
+ * unchanged.
+ * @param arg the argument passed to `arcp_update`.
+ *
+ * @returns zero on success, or nonzero to abandon the update.
+ */
+typedef int (*arcp_update_f)(struct arcp_region *oldregion,
+			     struct arcp_region **newregion, void *arg);
+
+/**
+ * Replaces the content of a reference counted pointer with a transformation
+ * of it.
+ *
+ * This is the usual loop of `arcp_load`, building a new region, and
+ * `arcp_cas_release`, with exponential backoff between attempts.  After
+ * `ARCP_UPDATE_TRIES` failed attempts the transformation is queued instead,
+ * and one of the queued writers applies every waiting transformation for the
+ * pointer in turn, storing only the final result, so that under contention
+ * each transformation is applied once per batch rather than once per
+ * attempt.
+ *
+ * @param rcp the pointer to update.
+ * @param fn the transformation to apply.
+ * @param arg an argument to pass to `fn`.
+ *
+ * @returns zero on success, or the nonzero value returned by `fn` if it
+ * abandoned the update.
+ */
+int arcp_update(arcp_t *rcp, arcp_update_f fn, void *arg);
+
+/**
+ * Kinds of contention event counted when the library is built with
+ * `ARCP_INSTRUMENT`.
+ */
+enum arcp_stat_kind {
+	ARCP_STAT_UREFS_RETRY = 0,	/**< Retried refcount update of a
+					 *   region, by region */
+	ARCP_STAT_TAG_SPIN,		/**< Spin on a pointer whose count is
+					 *   saturated, by pointer */
+	ARCP_STAT_CAS_FAIL,		/**< Failed `arcp_cas` or
+					 *   `arcp_cas_release`, by pointer */
+	ARCP_STAT_DESTROY,		/**< Destruction of a region, by
+					 *   destruction function */
+	ARCP_STAT_UPDATE_RETRY,		/**< Failed attempt by `arcp_update`,
+					 *   by pointer */
+	ARCP_STAT_NKINDS		/**< The number of kinds */
+};
+
+/**
+ * Contention counted at a single location.
+ */
+struct arcp_stat {
+	const void *addr;			/**< The region, pointer or
+						 *   destruction function */
+	unsigned long count[ARCP_STAT_NKINDS];	/**< Events of each kind */
+};
+
+/**
+ * Sets the rate at which contention events are sampled.
+ *
+ * Each thread counts only one of every `rate` events, adding `rate` to its
+ * counter, so that counts remain estimates of the true totals at a fraction
+ * of the cost.  The default rate is 1, which counts every event.
+ *
+ * @param rate the sampling rate; 0 is treated as 1.
+ */
+void arcp_stats_sample(unsigned int rate);
+
+/**
+ * Gets the most contended locations.
+ *
+ * Locations are ordered by the sum of their counts, highest first.
+ *
+ * @param stats an array in which to store the locations.
+ * @param n the number of elements in `stats`.
+ *
+ * @returns the number of locations stored, which is 0 if the library was not
+ * built with `ARCP_INSTRUMENT`.
+ */
+size_t arcp_stats_top(struct arcp_stat *stats, size_t n);
+
+/**
+ * Discards all contention counts.
+ *
+ * Events counted concurrently with this may be lost.
+ */
+void arcp_stats_reset(void);
+
+/* The value which adds one to the usecount of a punned refcount */
+#define __ARCP_USECOUNT_ONE __ARCP_REFCOUNT_INIT(0, 1)
+
+/* Out of line portions of `arcp_acquire` and `arcp_release`, for sharded
+ * regions and regions with weak references, and for releasing the last
+ * reference. */
+void __arcp_acquire_slow(struct arcp_region *region);
+void __arcp_release_slow(struct arcp_region *region);
+void __arcp_release_last(struct arcp_region *region);
+
+static inline struct arcp_region *__arcp_acquire(struct arcp_region *region) {
+	if (region != NULL) {
+		if (likely(region->shards == NULL)) {
+			/* the caller already holds a reference, so this can
+			 * neither reach nor leave zero */
+			ak_ldadd(&region->refcount, __ARCP_USECOUNT_ONE,
+				 mo_relaxed);
+		} else {
+			__arcp_acquire_slow(region);
+		}
+	}
+	return region;
+}
+
+static inline void arcp_release(struct arcp_region *region) {
+	arcp_refcount_t o_count;
+	if (region != NULL) {
+		if (unlikely(region->shards != NULL
+			     || __ARCP_PTRDECOUNT(ak_load(&region->weakref,
+							  mo_relaxed))
+			     != NULL)) {
+			/* a region with a weak reference could be revived
+			 * while its count sat at zero unlocked, so go
+			 * straight from one to zero with the lock held */
+			__arcp_release_slow(region);
+			return;
+		}
+		o_count.p = ak_ldsub(&region->refcount, __ARCP_USECOUNT_ONE,
+				     mo_acq_rel);
+		if (unlikely(o_count.p == __ARCP_USECOUNT_ONE)) {
+			/* that was the last reference and nobody holds the
+			 * destroy lock */
+			__arcp_release_last(region);
+		}
+	}
+}
+
 /**
  * Get the number of checked out references to the region.
  *
@@ -463,8 +958,29 @@ arcp_weakref_phantom(struct arcp_region *region) {
  *
  * @returns the current contents of the pointer.
  */
+/* Out of line portion of `arcp_load_phantom`, for a pointer in the middle
+ * of a transaction. */
+struct arcp_region *__arcp_load_phantom_txn(arcp_t *rcp);
+
 static inline struct arcp_region *arcp_load_phantom(arcp_t *rcp) {
-	return __ARCP_PTRDECOUNT(ak_load(rcp, mo_acquire));
+	struct arcp_region *region;
+	region = __ARCP_PTRDECOUNT(ak_load(rcp, mo_acquire));
+	if (unlikely(__ARCP_PTR2TXN(region))) {
+		return __arcp_load_phantom_txn(rcp);
+	}
+	return region;
+}
+
+/* Out of line portion of `arcp_cached_load`, for a stale cache. */
+struct arcp_region *__arcp_cache_refresh(arcp_versioned_t *vrcp,
+					 struct arcp_cache *cache);
+
+static inline struct arcp_region *arcp_cached_load(arcp_versioned_t *vrcp,
+						   struct arcp_cache *cache) {
+	if (likely(ak_load(&vrcp->version, mo_acquire) == cache->version)) {
+		return cache->region;
+	}
+	return __arcp_cache_refresh(vrcp, cache);
 }
 
 #endif /* ! ATOMICKIT_RCP_H */
@@ -0,0 +1,121 @@
+/** @file ring.h
+ * Atomic Ring
+ *
+ * Implements a bounded lock free multi-producer multi-consumer FIFO queue of
+ * reference counted items.  Unlike `aqueue_t`, the ring allocates nothing
+ * once initialized: items are stored directly in a fixed array of slots,
+ * each of which carries a sequence number telling producers and consumers
+ * whose turn it is.  An enqueue or dequeue is one compare and swap on a
+ * shared position plus a store to the slot, with no reference counted loads.
+ *
+ * As with `aqueue_t`, the ring takes its own reference to each enqueued item
+ * and hands that reference to whoever dequeues it.  Items may not be NULL.
+ *
+ * This algorithm is Dmitry Vyukov's "Bounded MPMC queue," 2010.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_RING_H
+#define ATOMICKIT_RING_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <atomickit/atomic.h>
+#include <atomickit/rcp.h>
+
+/**
+ * The alignment that keeps producer and consumer positions from sharing a
+ * cache line.
+ */
+#define __ARING_CACHELINE 64
+
+/**
+ * Ring slot
+ */
+struct aring_slot {
+	atomic_size_t seq;		/**< the position this slot is ready
+					 *   for; equal to the enqueue
+					 *   position when empty and one more
+					 *   when full */
+	struct arcp_region *item;	/**< the content of this slot */
+};
+
+/**
+ * Atomic Ring.
+ */
+typedef struct {
+	alignas(__ARING_CACHELINE)
+	atomic_size_t enq;		/**< the next position to enqueue */
+	alignas(__ARING_CACHELINE)
+	atomic_size_t deq;		/**< the next position to dequeue */
+	alignas(__ARING_CACHELINE)
+	size_t mask;			/**< the number of slots, minus one */
+	struct aring_slot *slots;	/**< the slots */
+} aring_t;
+
+/**
+ * Initializes a ring.
+ *
+ * @param ring a pointer to the ring being initialized.
+ * @param size the minimum number of items the ring will hold; this is
+ * rounded up to a power of two.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int aring_init(aring_t *ring, size_t size);
+
+/**
+ * Enqueues the given item, if there is room.
+ *
+ * @param ring a pointer to the ring in which the item is being enqueued.
+ * @param item a pointer to the item to enqueue, which may not be NULL.
+ *
+ * @returns true if the item was enqueued, false if the ring was full.
+ */
+bool aring_try_enq(aring_t *ring, struct arcp_region *item);
+
+/**
+ * Dequeues an item, if there is one.
+ *
+ * @param ring a pointer to the ring from which the item is being dequeued.
+ *
+ * @returns a pointer to the dequeued item, or NULL if the ring was empty.
+ */
+struct arcp_region *aring_try_deq(aring_t *ring);
+
+/**
+ * Gets the number of items the ring holds when full.
+ *
+ * @param ring a pointer to the ring.
+ *
+ * @returns the capacity of the ring.
+ */
+static inline size_t aring_capacity(aring_t *ring) {
+	return ring->mask + 1;
+}
+
+/**
+ * Destroys a ring, releasing any items still in it.  No other thread may be
+ * using the ring.
+ *
+ * @param ring a pointer to the ring being destroyed.
+ */
+void aring_destroy(aring_t *ring);
+
+#endif /* ! ATOMICKIT_RING_H */
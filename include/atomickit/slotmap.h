@@ -0,0 +1,139 @@
+/** @file slotmap.h
+ * Atomic Slot Map
+ *
+ * A lock free, growable table of reference counted regions, addressed by
+ * 64-bit handles which combine a slot index with the generation of the slot.
+ * Removing an item advances the generation of its slot, so stale handles are
+ * detected with a single load rather than needing a weak reference to each
+ * item.  Freed slots are reused through a lock free free list.
+ *
+ * A slot's generation is 32 bits, so a handle could be mistaken for a new
+ * one after its slot has been reused 2^31 times.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ * 
+ * This file is part of Atomic Kit.
+ * 
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ * 
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_SLOTMAP_H
+#define ATOMICKIT_SLOTMAP_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <atomickit/atomic.h>
+#include <atomickit/rcp.h>
+
+/**
+ * Handle to an item in a slot map.  The low 32 bits are the slot index and
+ * the high 32 bits its generation.
+ */
+typedef uint64_t aslot_t;
+
+/**
+ * A handle which never refers to any item.
+ */
+#define ASLOT_NULL ((aslot_t) 0)
+
+/**
+ * The number of slots in the first segment of a slot map.  Each further
+ * segment is twice the size of the one before.
+ */
+#define ASLOTMAP_SEGMENT0 64
+
+/**
+ * The maximum number of segments in a slot map, which limits it to just under
+ * 2^32 slots.
+ */
+#define ASLOTMAP_NSEGMENTS 26
+
+/**
+ * Slot map slot
+ */
+struct aslot {
+	atomic_uint_least32_t gen;	/**< odd while occupied */
+	atomic_uint_least32_t next;	/**< next free slot, plus one */
+	arcp_t region;			/**< the item */
+};
+
+/**
+ * Atomic Slot Map.
+ */
+typedef struct {
+	_Atomic(struct aslot *) segment[ASLOTMAP_NSEGMENTS];
+					/**< slots; allocated as needed and
+					 *   never moved */
+	atomic_uint_least32_t top;	/**< number of slots ever handed out */
+	atomic_uint_least64_t free;	/**< free list head index plus one, in
+					 *   the low 32 bits, and a tag */
+} aslotmap_t;
+
+/**
+ * Initializes a slot map.
+ *
+ * @param map a pointer to the slot map being initialized.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int aslotmap_init(aslotmap_t *map);
+
+/**
+ * Destroys a slot map, releasing all the items it still holds.
+ *
+ * @param map a pointer to the slot map being destroyed.
+ */
+void aslotmap_destroy(aslotmap_t *map);
+
+/**
+ * Inserts an item into a slot map.
+ *
+ * @param map a pointer to the slot map in which to insert the item.
+ * @param region the item to insert, which may be NULL.
+ *
+ * @returns a handle to the item, or `ASLOT_NULL` if the slot map could not
+ * be grown.
+ */
+aslot_t aslotmap_insert(aslotmap_t *map, struct arcp_region *region);
+
+/**
+ * Removes an item from a slot map.
+ *
+ * @param map a pointer to the slot map from which to remove the item.
+ * @param handle the handle of the item to remove.
+ *
+ * @returns true if the item was removed, false if the handle was stale.
+ */
+bool aslotmap_remove(aslotmap_t *map, aslot_t handle);
+
+/**
+ * Checks whether a handle still refers to an item.
+ *
+ * @param map a pointer to the slot map.
+ * @param handle the handle to check.
+ *
+ * @returns true if the item is still in the slot map, false otherwise.
+ */
+bool aslotmap_valid(aslotmap_t *map, aslot_t handle);
+
+/**
+ * Gets the item to which a handle refers.
+ *
+ * @param map a pointer to the slot map.
+ * @param handle the handle of the item to get.
+ *
+ * @returns a reference to the item, or NULL if the handle was stale.
+ */
+struct arcp_region *aslotmap_get(aslotmap_t *map, aslot_t handle);
+
+#endif /* ! ATOMICKIT_SLOTMAP_H */
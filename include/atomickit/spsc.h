@@ -0,0 +1,204 @@
+/** @file spsc.h
+ * Single Producer Single Consumer Ring
+ *
+ * Implements a bounded wait free FIFO queue for exactly one producing thread
+ * and one consuming thread.  Each side owns its own position, which only it
+ * writes, and keeps a cached copy of the other side's position, so that most
+ * operations touch no cache line the other thread is writing.  Neither side
+ * ever waits for the other: pushing to a full ring or popping from an empty
+ * one simply transfers fewer items.  This makes the ring suitable for
+ * exchanging data with a thread that must not block, such as a real-time
+ * audio thread.
+ *
+ * The ring holds fixed-size elements of any type, copied in and out by
+ * value.  A ring whose elements are `struct arcp_region *` may also be used
+ * through the `region` functions, which, as with `aqueue_t`, take a
+ * reference to each pushed item and hand it to whoever pops it.  Taking that
+ * reference is a single atomic add for an ordinary region, so these stay wait
+ * free, but for a region with sharded use counts (see
+ * `arcp_region_init_sharded`) it may retry, and pushing such regions is only
+ * lock free.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_SPSC_H
+#define ATOMICKIT_SPSC_H 1
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <atomickit/atomic.h>
+#include <atomickit/rcp.h>
+
+/**
+ * The alignment that keeps the producer's and consumer's fields from sharing
+ * a cache line.
+ */
+#define __ASPSC_CACHELINE 64
+
+/**
+ * Single Producer Single Consumer Ring.
+ */
+typedef struct {
+	alignas(__ASPSC_CACHELINE)
+	atomic_size_t head;	/**< the next position to pop; written only
+				 *   by the consumer */
+	size_t tail_cache;	/**< the consumer's last copy of `tail` */
+	alignas(__ASPSC_CACHELINE)
+	atomic_size_t tail;	/**< the next position to push; written only
+				 *   by the producer */
+	size_t head_cache;	/**< the producer's last copy of `head` */
+	alignas(__ASPSC_CACHELINE)
+	size_t mask;		/**< the number of elements, minus one */
+	size_t elsize;		/**< the size of an element */
+	char *buf;		/**< the elements */
+} aspsc_t;
+
+/**
+ * Initializes a ring.
+ *
+ * @param spsc a pointer to the ring being initialized.
+ * @param size the minimum number of elements the ring will hold; this is
+ * rounded up to a power of two.
+ * @param elsize the size of each element, which must not be zero.
+ *
+ * @returns zero on success, nonzero on error.
+ */
+int aspsc_init(aspsc_t *spsc, size_t size, size_t elsize);
+
+/**
+ * Destroys a ring.  Any regions still in a ring of regions must be popped and
+ * released first.
+ *
+ * @param spsc a pointer to the ring being destroyed.
+ */
+void aspsc_destroy(aspsc_t *spsc);
+
+/**
+ * Pushes up to `n` elements, as many as there is room for.  Only the producer
+ * may call this.
+ *
+ * @param spsc a pointer to the ring.
+ * @param els the elements to push.
+ * @param n the number of elements in `els`.
+ *
+ * @returns the number of elements pushed, which are the first ones in `els`.
+ */
+size_t aspsc_push_n(aspsc_t *spsc, const void *els, size_t n);
+
+/**
+ * Pops up to `n` elements, as many as there are.  Only the consumer may call
+ * this.
+ *
+ * @param spsc a pointer to the ring.
+ * @param els where to put the popped elements.
+ * @param n the room in `els`, in elements.
+ *
+ * @returns the number of elements popped.
+ */
+size_t aspsc_pop_n(aspsc_t *spsc, void *els, size_t n);
+
+/**
+ * Pushes one element, if there is room.  Only the producer may call this.
+ *
+ * @param spsc a pointer to the ring.
+ * @param el the element to push.
+ *
+ * @returns true if the element was pushed, false if the ring was full.
+ */
+static inline bool aspsc_push(aspsc_t *spsc, const void *el) {
+	return aspsc_push_n(spsc, el, 1) == 1;
+}
+
+/**
+ * Pops one element, if there is one.  Only the consumer may call this.
+ *
+ * @param spsc a pointer to the ring.
+ * @param el where to put the popped element.
+ *
+ * @returns true if an element was popped, false if the ring was empty.
+ */
+static inline bool aspsc_pop(aspsc_t *spsc, void *el) {
+	return aspsc_pop_n(spsc, el, 1) == 1;
+}
+
+/**
+ * Pushes up to `n` regions, as many as there is room for, taking a reference
+ * to each one pushed.  The ring's elements must be `struct arcp_region *`.
+ * Only the producer may call this.  This is wait free unless some of the
+ * regions have sharded use counts.
+ *
+ * @param spsc a pointer to the ring.
+ * @param regions the regions to push.
+ * @param n the number of elements in `regions`.
+ *
+ * @returns the number of regions pushed, which are the first ones in
+ * `regions`.
+ */
+size_t aspsc_push_region_n(aspsc_t *spsc, struct arcp_region **regions,
+			   size_t n);
+
+/**
+ * Pops up to `n` regions, as many as there are.  The caller receives the
+ * ring's reference to each one.  The ring's elements must be
+ * `struct arcp_region *`.  Only the consumer may call this.
+ *
+ * @param spsc a pointer to the ring.
+ * @param regions where to put the popped regions.
+ * @param n the room in `regions`.
+ *
+ * @returns the number of regions popped.
+ */
+static inline size_t aspsc_pop_region_n(aspsc_t *spsc,
+					struct arcp_region **regions,
+					size_t n) {
+	return aspsc_pop_n(spsc, regions, n);
+}
+
+/**
+ * Pushes one region, if there is room, taking a reference to it.  The ring's
+ * elements must be `struct arcp_region *`.  Only the producer may call this.
+ *
+ * @param spsc a pointer to the ring.
+ * @param region the region to push.
+ *
+ * @returns true if the region was pushed, false if the ring was full.
+ */
+static inline bool aspsc_push_region(aspsc_t *spsc,
+				     struct arcp_region *region) {
+	return aspsc_push_region_n(spsc, &region, 1) == 1;
+}
+
+/**
+ * Pops one region, if there is one.  The caller receives the ring's reference
+ * to it.  The ring's elements must be `struct arcp_region *`.  Only the
+ * consumer may call this.
+ *
+ * @param spsc a pointer to the ring.
+ *
+ * @returns the popped region, or NULL if the ring was empty.
+ */
+static inline struct arcp_region *aspsc_pop_region(aspsc_t *spsc) {
+	struct arcp_region *region;
+	if (aspsc_pop_n(spsc, &region, 1) == 1) {
+		return region;
+	}
+	return NULL;
+}
+
+#endif /* ! ATOMICKIT_SPSC_H */
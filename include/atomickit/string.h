@@ -31,8 +31,12 @@
  *
  * The string structure to be stored in an arcp_t container.
  */
+#ifdef __cplusplus
+struct astr : arcp_region {
+#else
 struct astr {
 	struct arcp_region;
+#endif
 	size_t len;		/**< the number of bytes in the string data */
 	char *data;		/**< a pointer to the string data */
 };
@@ -0,0 +1,154 @@
+/** @file txn.h
+ * Atomic Transactions
+ *
+ * Obstruction free multi-word compare and swap over reference counted
+ * pointers.  A transaction collects the expected and desired values of
+ * several `arcp_t`s and then commits them all at once: either every pointer
+ * still held its expected value and now holds its desired value, or nothing
+ * changed.
+ *
+ * Committing installs a descriptor in each pointer in address order and then
+ * decides the outcome with a single compare and swap on the descriptor.
+ * While a descriptor is installed, `arcp_load` and friends see the value the
+ * pointer has at that moment.  `arcp_store` and `arcp_swap` replace the
+ * descriptor outright and abort the transaction if it has not yet decided;
+ * `arcp_cas` and other transactions wait a short while for it to decide,
+ * and then abort it, before going ahead.
+ *
+ * Nobody helps another thread's transaction to finish, so this is not lock
+ * free: a transaction which commits without meeting any other thread is
+ * guaranteed to succeed, but overlapping transactions, even ones which only
+ * read a pointer, can abort each other indefinitely.  Callers should retry
+ * failed commits after backing off.
+ *
+ * Descriptors are marked in the pointer by its high bit, so transactions are
+ * only available where pointers have spare high bits, as on 64-bit targets;
+ * see `ATXN_AVAILABLE`.  Elsewhere `atxn_begin` fails, rather than handing
+ * out transactions which could never commit.  Pointers embedded in the
+ * reference counting machinery itself, such as weak references, may not take
+ * part in transactions.
+ */
+/*
+ * Copyright 2014 Evan Buswell
+ * 
+ * This file is part of Atomic Kit.
+ * 
+ * Atomic Kit is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, version 2.
+ * 
+ * Atomic Kit is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMICKIT_TXN_H
+#define ATOMICKIT_TXN_H 1
+
+#include <stdbool.h>
+#include <atomickit/rcp.h>
+
+/**
+ * Whether transactions are available on this target.  Where this is 0,
+ * `atxn_begin` always fails with `errno` set to `ENOSYS`.
+ */
+#define ATXN_AVAILABLE (__ARCP_TXNBIT != 0)
+
+/**
+ * The number of times a writer or transaction which finds an undecided
+ * transaction in its way yields before aborting it.
+ */
+#define ATXN_PATIENCE 64
+
+/**
+ * An atomic transaction.
+ */
+struct atxn;
+
+/**
+ * Begins a transaction.
+ *
+ * @returns a new transaction, or NULL on allocation failure or if
+ * transactions are not available (see `ATXN_AVAILABLE`).
+ */
+struct atxn *atxn_begin(void);
+
+/**
+ * Loads a pointer as part of a transaction.  The transaction will only commit
+ * if the pointer still holds the loaded value.  If the pointer is already part
+ * of the transaction, this gives the value the transaction will store.
+ *
+ * @param txn the transaction.
+ * @param rcp the pointer to load.
+ *
+ * @returns a reference to the value of the pointer.
+ */
+struct arcp_region *atxn_load(struct atxn *txn, arcp_t *rcp);
+
+/**
+ * Stores a region to a pointer as part of a transaction.  If the pointer is
+ * not yet part of the transaction, it is loaded first as by `atxn_load`.
+ *
+ * @param txn the transaction.
+ * @param rcp the pointer to which to store.
+ * @param region the region to store, which may be NULL.
+ */
+void atxn_store(struct atxn *txn, arcp_t *rcp, struct arcp_region *region);
+
+/**
+ * Adds a compare and swap to a transaction.  If the pointer is already part of
+ * the transaction and would not be set to `oldregion` by it, the transaction
+ * will fail.
+ *
+ * @param txn the transaction.
+ * @param rcp the pointer to compare and swap.
+ * @param oldregion the region the pointer must hold for the transaction to
+ * commit.
+ * @param newregion the region to store if it does.
+ */
+void atxn_cas(struct atxn *txn, arcp_t *rcp, struct arcp_region *oldregion,
+	      struct arcp_region *newregion);
+
+/**
+ * Commits a transaction, storing all its values at once if every pointer in
+ * it still holds the value it expects.  The transaction is released.
+ *
+ * @param txn the transaction.
+ *
+ * @returns true if the transaction committed, false otherwise.
+ */
+bool atxn_commit(struct atxn *txn);
+
+/**
+ * Abandons a transaction without trying to commit it.
+ *
+ * @param txn the transaction.
+ */
+void atxn_abort(struct atxn *txn);
+
+/* Internal functions shared between rcp.c and txn.c. */
+
+/* Update the references for a region, destroying it if need be. */
+void __arcp_refs(struct arcp_region *region, int storedelta, int usedelta);
+
+/* Settle the transaction whose descriptor is installed in rcp, if any. */
+void __arcp_settle(arcp_t *rcp);
+
+/* Get the value a transaction currently gives a pointer. */
+struct arcp_region *__atxn_value(struct arcp_region *txn, arcp_t *rcp);
+
+/* Account for a transaction descriptor which arcp_store or arcp_swap has
+ * taken out of rcp, along with count loads in progress, aborting the
+ * transaction if it has not yet decided.  Returns a reference to the value
+ * rcp held. */
+struct arcp_region *__atxn_displace(struct arcp_region *txn, arcp_t *rcp,
+				   uintptr_t count);
+
+/* Abort a transaction unless it decides within ATXN_PATIENCE yields, and
+ * remove its descriptor from rcp. */
+void __atxn_abort_wait(struct arcp_region *txn, arcp_t *rcp);
+
+#endif /* ! ATOMICKIT_TXN_H */
@@ -1,7 +1,7 @@
 /** @file atomickit/arch/misc.h
  * misc.h
  *
- * Gives us cpu_yield()
+ * Gives us cpu_yield(), the pointer layout and double-width compare and swap
  */
 /*
  * Copyright 2014 Evan Buswell
@@ -33,4 +33,32 @@ static inline void cpu_yield(void) {
 	__asm__ volatile("rep; nop" ::: "memory");
 }
 
+#ifdef __x86_64__
+/* The number of high bits left unused in user space pointers, which only
+ * reach past 47 bits when explicitly requested. */
+# define __AK_PTR_HIGHBITS 16
+/* A type as wide as two pointers */
+# define __AK_CAS2_TYPE unsigned __int128
+# define __AK_CAS2_INSN "cmpxchg16b"
+#else
+# define __AK_PTR_HIGHBITS 0
+# define __AK_CAS2_TYPE uint64_t
+# define __AK_CAS2_INSN "cmpxchg8b"
+#endif
+
+/* Compare and swap two adjacent pointer-sized words at once.  The object
+ * must be aligned to twice the size of a pointer. */
+static inline _Bool __ak_cas2(volatile void *object, uintptr_t *expected_lo,
+			      uintptr_t *expected_hi, uintptr_t desired_lo,
+			      uintptr_t desired_hi) {
+	_Bool ret;
+	__asm__ __volatile__("lock; " __AK_CAS2_INSN " %1; setz %0"
+			     : "=q" (ret),
+			       "+m" (*(volatile __AK_CAS2_TYPE *) object),
+			       "+a" (*expected_lo), "+d" (*expected_hi)
+			     : "b" (desired_lo), "c" (desired_hi)
+			     : "memory", "cc");
+	return ret;
+}
+
 #endif /* ! ATOMICKIT_ARCH_MISC_H */
@@ -25,29 +25,25 @@
 #include "atomickit/malloc.h"
 
 static void aary_destroy(struct aary *array) {
-	size_t i;
 	/* release each value */
-	for (i = 0; i < array->len; i++) {
-		arcp_release(array->items[i]);
-	}
+	arcp_release_n(array->items, array->len);
 	/* free the memory of the array itself */
 	afree(array, AARY_SIZE(array->len));
 }
 
 struct aary *aary_dup(struct aary *array) {
 	struct aary *ret;
-	size_t i;
 	/* allocate the memory required to duplicate the array */
 	ret = amalloc(AARY_SIZE(array->len));
 	if (ret == NULL) {
 		/* allocation failure */
 		return NULL;
 	}
-	/* acquire a reference to each item in the old array and copy it
-	 * over */
-	for (i = 0; i < array->len; i++) {
-		ret->items[i] = arcp_acquire(array->items[i]);
-	}
+	/* copy each item in the old array over and acquire a reference to
+	 * it */
+	memcpy(ret->items, array->items,
+	       sizeof(struct arcp_region *) * array->len);
+	arcp_acquire_n(ret->items, array->len);
 	/* set up the array */
 	ret->len = array->len;
 	arcp_region_init(ret, (arcp_destroy_f) aary_destroy);
@@ -70,6 +66,17 @@ struct aary *aary_create(size_t len) {
 	return ret;
 }
 
+struct arcp_region *aary_rcp_load(arcp_t *rcp, size_t i) {
+	struct aary *array;
+	struct arcp_region *ret;
+	array = (struct aary *) arcp_borrow(rcp);
+	if (array == NULL) {
+		return NULL;
+	}
+	ret = i < array->len ? aary_load(array, i) : NULL;
+	arcp_unborrow(array);
+	return ret;
+}
 
 struct aary *aary_insert(struct aary *array,
 			 size_t i, struct arcp_region *region) {
@@ -102,7 +109,6 @@ struct aary *aary_insert(struct aary *array,
 struct aary *aary_dup_insert(struct aary *array,
 			     size_t i, struct arcp_region *region) {
 	size_t len;
-	size_t j;
 	struct aary *new_array;
 	len = array->len;
 	/* allocate space for the new array */
@@ -110,16 +116,16 @@ struct aary *aary_dup_insert(struct aary *array,
 	if (new_array == NULL) {
 		return NULL;
 	}
-	/* acquire items from the old array and copy them over, leaving a hole
-	 * for the new value. */
-	for (j = 0; j < i; j++) {
-		new_array->items[j] = arcp_acquire(array->items[j]);
-	}
-	for (; j < len; j++) {
-		new_array->items[j + 1] = arcp_acquire(array->items[j]);
-	}
+	/* copy items from the old array over, leaving a hole for the new
+	 * value. */
+	memcpy(new_array->items, array->items,
+	       sizeof(struct arcp_region *) * i);
+	memcpy(&new_array->items[i + 1], &array->items[i],
+	       sizeof(struct arcp_region *) * (len - i));
 	/* add inserted item */
-	new_array->items[i] = arcp_acquire(region);
+	new_array->items[i] = region;
+	/* acquire everything at once */
+	arcp_acquire_n(new_array->items, len + 1);
 	/* set up array */
 	new_array->len = len + 1;
 	arcp_region_init(new_array, (arcp_destroy_f) aary_destroy);
@@ -166,7 +172,6 @@ struct aary *aary_remove(struct aary *array, size_t i) {
 
 struct aary *aary_dup_remove(struct aary *array, size_t i) {
 	size_t len;
-	size_t j;
 	struct aary *new_array;
 	len = array->len;
 	/* allocate space for the new array */
@@ -174,14 +179,13 @@ struct aary *aary_dup_remove(struct aary *array, size_t i) {
 	if (new_array == NULL) {
 		return NULL;
 	}
-	/* acquire items from the old array and copy them over, skipping the
-	 * removed value. */
-	for (j = 0; j < i; j++) {
-		new_array->items[j] = arcp_acquire(array->items[j]);
-	}
-	for (; j + 1 < len; j++) {
-		new_array->items[j] = arcp_acquire(array->items[j + 1]);
-	}
+	/* copy items from the old array over, skipping the removed value, and
+	 * acquire them. */
+	memcpy(new_array->items, array->items,
+	       sizeof(struct arcp_region *) * i);
+	memcpy(&new_array->items[i], &array->items[i + 1],
+	       sizeof(struct arcp_region *) * (len - (i + 1)));
+	arcp_acquire_n(new_array->items, len - 1);
 	/* set up array */
 	new_array->len = len - 1;
 	arcp_region_init(new_array, (arcp_destroy_f) aary_destroy);
@@ -206,7 +210,6 @@ struct aary *aary_append(struct aary *array, struct arcp_region *region) {
 struct aary *aary_dup_append(struct aary *array,
 			     struct arcp_region *region) {
 	size_t len;
-	size_t j;
 	struct aary *new_array;
 	len = array->len;
 	/* allocate space for the new array */
@@ -214,13 +217,13 @@ struct aary *aary_dup_append(struct aary *array,
 	if (new_array == NULL) {
 		return NULL;
 	}
-	/* acquire a reference to each item in the old array and copy it
-	 * over */
-	for (j = 0; j < len; j++) {
-		new_array->items[j] = arcp_acquire(array->items[j]);
-	}
+	/* copy each item in the old array over */
+	memcpy(new_array->items, array->items,
+	       sizeof(struct arcp_region *) * len);
 	/* append the last value */
-	new_array->items[len] = arcp_acquire(region);
+	new_array->items[len] = region;
+	/* acquire everything at once */
+	arcp_acquire_n(new_array->items, len + 1);
 	/* set up array */
 	new_array->len = len + 1;
 	arcp_region_init(new_array, (arcp_destroy_f) aary_destroy);
@@ -248,7 +251,6 @@ struct aary *aary_pop(struct aary *array) {
 
 struct aary *aary_dup_pop(struct aary *array) {
 	size_t len;
-	size_t j;
 	struct aary *new_array;
 	len = array->len;
 	/* allocate space for the new array */
@@ -256,11 +258,11 @@ struct aary *aary_dup_pop(struct aary *array) {
 	if (new_array == NULL) {
 		return NULL;
 	}
-	/* acquire a reference to each item in the old array and copy it
-	 * over */
-	for (j = 0; j < len - 1; j++) {
-		new_array->items[j] = arcp_acquire(array->items[j]);
-	}
+	/* copy each remaining item in the old array over and acquire a
+	 * reference to it */
+	memcpy(new_array->items, array->items,
+	       sizeof(struct arcp_region *) * (len - 1));
+	arcp_acquire_n(new_array->items, len - 1);
 	/* set up array */
 	new_array->len = len - 1;
 	arcp_region_init(new_array, (arcp_destroy_f) aary_destroy);
@@ -296,7 +298,6 @@ struct aary *aary_prepend(struct aary *array, struct arcp_region *region) {
 struct aary *aary_dup_prepend(struct aary *array,
 			      struct arcp_region *region) {
 	size_t len;
-	size_t j;
 	struct aary *new_array;
 	len = array->len;
 	/* allocate space for the new array */
@@ -304,12 +305,13 @@ struct aary *aary_dup_prepend(struct aary *array,
 	if (new_array == NULL) {
 		return NULL;
 	}
-	/* acquire items from the old array and copy them over */
-	for (j = 0; j < len; j++) {
-		new_array->items[j + 1] = arcp_acquire(array->items[j]);
-	}
+	/* copy items from the old array over */
+	memcpy(&new_array->items[1], array->items,
+	       sizeof(struct arcp_region *) * len);
 	/* prepend new item */
-	new_array->items[0] = arcp_acquire(region);
+	new_array->items[0] = region;
+	/* acquire everything at once */
+	arcp_acquire_n(new_array->items, len + 1);
 	/* set up array */
 	new_array->len = len + 1;
 	arcp_region_init(new_array, (arcp_destroy_f) aary_destroy);
@@ -353,7 +355,6 @@ struct aary *aary_shift(struct aary *array) {
 
 struct aary *aary_dup_shift(struct aary *array) {
 	size_t len;
-	size_t j;
 	struct aary *new_array;
 	len = array->len;
 	/* allocate space for the new array */
@@ -361,10 +362,10 @@ struct aary *aary_dup_shift(struct aary *array) {
 	if (new_array == NULL) {
 		return NULL;
 	}
-	/* acquire items from the old array and copy them over */
-	for (j = 1; j < len; j++) {
-		new_array->items[j - 1] = arcp_acquire(array->items[j]);
-	}
+	/* copy items from the old array over and acquire them */
+	memcpy(new_array->items, &array->items[1],
+	       sizeof(struct arcp_region *) * (len - 1));
+	arcp_acquire_n(new_array->items, len - 1);
 	/* set up array */
 	new_array->len = len - 1;
 	arcp_region_init(new_array, (arcp_destroy_f) aary_destroy);
@@ -533,3 +534,15 @@ bool aary_set_contains(struct aary *array, struct arcp_region *region) {
 	/* couldn't find it... */
 	return false;
 }
+
+bool aary_rcp_set_contains(arcp_t *rcp, struct arcp_region *region) {
+	struct aary *array;
+	bool ret;
+	array = (struct aary *) arcp_borrow(rcp);
+	if (array == NULL) {
+		return false;
+	}
+	ret = aary_set_contains(array, region);
+	arcp_unborrow(array);
+	return ret;
+}
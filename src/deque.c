@@ -0,0 +1,174 @@
+/*
+ * deque.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "atomickit/atomic.h"
+#include "atomickit/rcp.h"
+#include "atomickit/deque.h"
+
+static struct adeque_array *adeque_array_new(size_t nslots) {
+	struct adeque_array *array;
+	array = arcp_alloc(sizeof(struct adeque_array)
+			   + sizeof(atomic_uintptr_t) * nslots, NULL);
+	if (array == NULL) {
+		return NULL;
+	}
+	array->mask = nslots - 1;
+	return array;
+}
+
+int adeque_init(adeque_t *deque, size_t size) {
+	struct adeque_array *array;
+	size_t nslots;
+	/* round up to a power of two, so that positions wrap cleanly */
+	for (nslots = 2; nslots < size; nslots <<= 1) {
+		if (nslots > SIZE_MAX / 2 / sizeof(atomic_uintptr_t)) {
+			return -1;
+		}
+	}
+	array = adeque_array_new(nslots);
+	if (array == NULL) {
+		return -1;
+	}
+	ak_init(&deque->top, 0);
+	ak_init(&deque->bottom, 0);
+	arcp_init(&deque->array, array);
+	arcp_release(array);
+	return 0;
+}
+
+/* Replace the array with one twice the size, holding the items from top to
+ * bottom at the same positions. */
+static struct adeque_array *adeque_grow(adeque_t *deque,
+					struct adeque_array *array,
+					intptr_t top, intptr_t bottom) {
+	struct adeque_array *new_array;
+	intptr_t i;
+	if (array->mask + 1 > SIZE_MAX / 2 / sizeof(atomic_uintptr_t)) {
+		return NULL;
+	}
+	new_array = adeque_array_new((array->mask + 1) * 2);
+	if (new_array == NULL) {
+		return NULL;
+	}
+	for (i = top; i < bottom; i++) {
+		ak_init(&new_array->items[i & new_array->mask],
+			ak_load(&array->items[i & array->mask], mo_relaxed));
+	}
+	/* thieves still reading the old array keep it alive until they are
+	 * done */
+	arcp_store(&deque->array, new_array);
+	arcp_release(new_array);
+	return new_array;
+}
+
+int adeque_push(adeque_t *deque, struct arcp_region *item) {
+	struct adeque_array *array;
+	intptr_t bottom;
+	intptr_t top;
+	bottom = ak_load(&deque->bottom, mo_relaxed);
+	top = ak_load(&deque->top, mo_acquire);
+	/* only the owner replaces the array */
+	array = (struct adeque_array *) arcp_load_phantom(&deque->array);
+	if (unlikely((size_t) (bottom - top) > array->mask)) {
+		array = adeque_grow(deque, array, top, bottom);
+		if (array == NULL) {
+			return -1;
+		}
+	}
+	ak_store(&array->items[bottom & array->mask],
+		 (uintptr_t) arcp_acquire(item), mo_relaxed);
+	/* publish the item before the new bottom */
+	ak_fence(mo_release);
+	ak_store(&deque->bottom, bottom + 1, mo_relaxed);
+	return 0;
+}
+
+struct arcp_region *adeque_pop(adeque_t *deque) {
+	struct adeque_array *array;
+	struct arcp_region *item;
+	intptr_t bottom;
+	intptr_t top;
+	bottom = ak_load(&deque->bottom, mo_relaxed) - 1;
+	array = (struct adeque_array *) arcp_load_phantom(&deque->array);
+	/* claim the bottom item before looking at what the thieves have
+	 * claimed */
+	ak_store(&deque->bottom, bottom, mo_relaxed);
+	ak_fence(mo_seq_cst);
+	top = ak_load(&deque->top, mo_relaxed);
+	if (unlikely(top > bottom)) {
+		/* empty */
+		ak_store(&deque->bottom, bottom + 1, mo_relaxed);
+		return NULL;
+	}
+	item = (struct arcp_region *)
+		ak_load(&array->items[bottom & array->mask], mo_relaxed);
+	if (top == bottom) {
+		/* this is the last item; race the thieves for it */
+		if (!ak_cas_strong(&deque->top, &top, top + 1,
+				   mo_seq_cst, mo_relaxed)) {
+			item = NULL;
+		}
+		ak_store(&deque->bottom, bottom + 1, mo_relaxed);
+	}
+	/* the deque's reference is now the caller's */
+	return item;
+}
+
+struct arcp_region *adeque_steal(adeque_t *deque) {
+	struct adeque_array *array;
+	struct arcp_region *item;
+	intptr_t bottom;
+	intptr_t top;
+	top = ak_load(&deque->top, mo_acquire);
+	ak_fence(mo_seq_cst);
+	bottom = ak_load(&deque->bottom, mo_acquire);
+	if (top >= bottom) {
+		/* empty */
+		return NULL;
+	}
+	/* hold on to the array while reading it, in case the owner replaces
+	 * it */
+	array = (struct adeque_array *) arcp_load(&deque->array);
+	item = (struct arcp_region *)
+		ak_load(&array->items[top & array->mask], mo_relaxed);
+	arcp_release(array);
+	if (!ak_cas_strong(&deque->top, &top, top + 1,
+			   mo_seq_cst, mo_relaxed)) {
+		/* the owner or another thief got there first */
+		return NULL;
+	}
+	/* the deque's reference is now the caller's */
+	return item;
+}
+
+void adeque_destroy(adeque_t *deque) {
+	struct adeque_array *array;
+	intptr_t bottom;
+	intptr_t i;
+	array = (struct adeque_array *) arcp_load_phantom(&deque->array);
+	bottom = ak_load(&deque->bottom, mo_relaxed);
+	for (i = ak_load(&deque->top, mo_relaxed); i < bottom; i++) {
+		arcp_release((struct arcp_region *)
+			     ak_load(&array->items[i & array->mask],
+				     mo_relaxed));
+	}
+	arcp_store(&deque->array, NULL);
+}
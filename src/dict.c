@@ -25,34 +25,51 @@
 #include "atomickit/malloc.h"
 #include "atomickit/dict.h"
 
-static void adict_destroy(struct adict *dict) {
-	size_t i;
+/* The number of regions gathered for each call to arcp_acquire_n or
+ * arcp_release_n */
+#define ADICT_BATCH 32
 
-	/* release each key and value */
+/* Apply arcp_acquire_n or arcp_release_n to each key and value of a
+ * dictionary, gathering them into batches rather than handing over the
+ * entries themselves, which are not an array of regions. */
+static void adict_refs_n(struct adict *dict,
+			 void (*refs_n)(struct arcp_region **, size_t)) {
+	struct arcp_region *regions[ADICT_BATCH];
+	size_t i, n;
+
+	n = 0;
 	for (i = 0; i < dict->len; i++) {
-		arcp_release(dict->items[i].key);
-		arcp_release(dict->items[i].value);
+		regions[n++] = dict->items[i].key;
+		regions[n++] = dict->items[i].value;
+		if (n == ADICT_BATCH) {
+			refs_n(regions, n);
+			n = 0;
+		}
 	}
+	refs_n(regions, n);
+}
+
+static void adict_destroy(struct adict *dict) {
+	/* release each key and value */
+	adict_refs_n(dict, arcp_release_n);
 	/* free the memory */
 	afree(dict, ADICT_SIZE(dict->len));
 }
 
 struct adict *adict_dup(struct adict *dict) {
 	struct adict *ret;
-	size_t i;
 
 	/* try to allocate memory for the duplicate dictionary */
 	ret = amalloc(ADICT_SIZE(dict->len));
 	if (ret == NULL) {
 		return NULL;
 	}
-	/* acquire values and copy them to the new dictionary */
-	for (i = 0; i < dict->len; i++) {
-		ret->items[i].key = arcp_acquire(dict->items[i].key);
-		ret->items[i].value = arcp_acquire(dict->items[i].value);
-	}
-	/* set up dictionary */
+	/* copy values to the new dictionary and acquire them */
+	memcpy(ret->items, dict->items,
+	       sizeof(struct adict_entry) * dict->len);
 	ret->len = dict->len;
+	adict_refs_n(ret, arcp_acquire_n);
+	/* set up dictionary */
 	arcp_region_init(ret, (arcp_destroy_f) adict_destroy);
 	return ret;
 }
@@ -152,6 +169,32 @@ struct arcp_region *adict_cstrget(struct adict *dict, char *key) {
 	return NULL;
 }
 
+struct arcp_region *adict_rcp_get(arcp_t *rcp, struct astr *key) {
+	struct adict *dict;
+	struct arcp_region *ret;
+	dict = (struct adict *) arcp_borrow(rcp);
+	if (dict == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	ret = adict_get(dict, key);
+	arcp_unborrow(dict);
+	return ret;
+}
+
+struct arcp_region *adict_rcp_cstrget(arcp_t *rcp, char *key) {
+	struct adict *dict;
+	struct arcp_region *ret;
+	dict = (struct adict *) arcp_borrow(rcp);
+	if (dict == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	ret = adict_cstrget(dict, key);
+	arcp_unborrow(dict);
+	return ret;
+}
+
 bool adict_has(struct adict *dict, struct astr *key) {
 	size_t i;
 	size_t len;
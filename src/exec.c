@@ -0,0 +1,312 @@
+/*
+ * exec.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stddef.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "atomickit/atomic.h"
+#include "atomickit/malloc.h"
+#include "atomickit/rcp.h"
+#include "atomickit/faaq.h"
+#include "atomickit/deque.h"
+#include "atomickit/exec.h"
+
+struct aexec_task {
+	struct arcp_region;
+	void (*fn)(void *);
+	void *arg;
+	aexec_group_t *group;
+};
+
+/* The parts of an aexec_group_t's state: the flag for waiters outside the
+ * pool, and one unfinished task */
+#define AEXEC_GROUP_WAITING 1u
+#define AEXEC_GROUP_TASK 2u
+
+/* The worker running on this thread, if any */
+static _Thread_local struct aexec_worker *aexec_self;
+
+/* Wake up to n sleeping workers, if there are any, after something has been
+ * submitted.  The submission must have been sequentially consistent, as
+ * afaaq_enq and the store to stop are; then this load pairs with the fence
+ * in aexec_worker_main: either we see the sleeper, or the sleeper sees what
+ * we submitted. */
+static inline void aexec_wake(aexec_t *exec, int n) {
+	if (likely(ak_load(&exec->sleepers, mo_seq_cst) == 0)) {
+		return;
+	}
+	ak_ldadd(&exec->seq, 1, mo_release);
+	syscall(SYS_futex, &exec->seq, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/* Mark a task of a group finished, waking any waiters if it was the last.
+ * Once the count reaches zero a waiter may return and free the group, so
+ * the decrement must be the last access to it; FUTEX_WAKE only uses the
+ * address to find the sleepers, and never touches the memory. */
+static void aexec_group_finish(aexec_group_t *group) {
+	if (ak_ldsub(&group->state, AEXEC_GROUP_TASK, mo_acq_rel)
+	    == (AEXEC_GROUP_TASK | AEXEC_GROUP_WAITING)) {
+		syscall(SYS_futex, &group->state, FUTEX_WAKE_PRIVATE, INT_MAX,
+			NULL, NULL, 0);
+	}
+}
+
+/* Run a task and mark it finished in its group. */
+static void aexec_run(struct aexec_task *task) {
+	aexec_group_t *group;
+	task->fn(task->arg);
+	group = task->group;
+	arcp_release(task);
+	if (group != NULL) {
+		aexec_group_finish(group);
+	}
+}
+
+/* Find a task for worker: its own newest, then the oldest submitted from
+ * outside, then another worker's oldest. */
+static struct aexec_task *aexec_find(struct aexec_worker *worker) {
+	aexec_t *exec;
+	struct aexec_task *task;
+	int i, n, victim;
+	task = (struct aexec_task *) adeque_pop(&worker->deque);
+	if (task != NULL) {
+		return task;
+	}
+	exec = worker->exec;
+	task = (struct aexec_task *) afaaq_deq(&exec->inject);
+	if (task != NULL) {
+		return task;
+	}
+	n = exec->nworkers;
+	/* xorshift, to spread thieves out over their victims */
+	worker->rand ^= worker->rand << 13;
+	worker->rand ^= worker->rand >> 17;
+	worker->rand ^= worker->rand << 5;
+	victim = worker->rand % n;
+	for (i = 0; i < n; i++, victim = (victim + 1) % n) {
+		if (&exec->workers[victim] == worker) {
+			continue;
+		}
+		task = (struct aexec_task *)
+			adeque_steal(&exec->workers[victim].deque);
+		if (task != NULL) {
+			return task;
+		}
+	}
+	return NULL;
+}
+
+static void *aexec_worker_main(void *arg) {
+	struct aexec_worker *worker;
+	struct aexec_task *task;
+	aexec_t *exec;
+	unsigned int seq;
+	int spins;
+	worker = arg;
+	exec = worker->exec;
+	aexec_self = worker;
+	spins = 0;
+	for (;;) {
+		task = aexec_find(worker);
+		if (task != NULL) {
+			aexec_run(task);
+			spins = 0;
+			continue;
+		}
+		if (ak_load(&exec->stop, mo_acquire)) {
+			break;
+		}
+		if (++spins < AEXEC_IDLE_SPINS) {
+			cpu_yield();
+			continue;
+		}
+		ak_ldadd(&exec->sleepers, 1, mo_relaxed);
+		/* pairs with the seq_cst load in aexec_wake */
+		ak_fence(mo_seq_cst);
+		seq = ak_load(&exec->seq, mo_acquire);
+		task = aexec_find(worker);
+		if (task == NULL && !ak_load(&exec->stop, mo_acquire)) {
+			/* sleeps unless a submitter has advanced seq since we
+			 * read it */
+			syscall(SYS_futex, &exec->seq, FUTEX_WAIT_PRIVATE, seq,
+				NULL, NULL, 0);
+		}
+		ak_ldsub(&exec->sleepers, 1, mo_relaxed);
+		if (task != NULL) {
+			aexec_run(task);
+		}
+		spins = 0;
+	}
+	aexec_self = NULL;
+	return NULL;
+}
+
+int aexec_init(aexec_t *exec, int nworkers) {
+	int i, j;
+	if (nworkers <= 0) {
+		nworkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		if (nworkers <= 0) {
+			nworkers = 1;
+		}
+	}
+	if (afaaq_init(&exec->inject) != 0) {
+		return -1;
+	}
+	exec->workers = amalloc(sizeof(struct aexec_worker) * nworkers);
+	if (exec->workers == NULL) {
+		goto undo_inject;
+	}
+	exec->nworkers = nworkers;
+	ak_init(&exec->stop, false);
+	ak_init(&exec->seq, 0);
+	ak_init(&exec->sleepers, 0);
+	for (i = 0; i < nworkers; i++) {
+		if (adeque_init(&exec->workers[i].deque,
+				AEXEC_DEQUE_SIZE) != 0) {
+			goto undo_deques;
+		}
+		exec->workers[i].exec = exec;
+		/* any nonzero seed will do */
+		exec->workers[i].rand = 2 * i + 1;
+	}
+	for (j = 0; j < nworkers; j++) {
+		if (pthread_create(&exec->workers[j].thread, NULL,
+				   aexec_worker_main,
+				   &exec->workers[j]) != 0) {
+			goto undo_threads;
+		}
+	}
+	return 0;
+
+undo_threads:
+	ak_store(&exec->stop, true, mo_seq_cst);
+	aexec_wake(exec, INT_MAX);
+	while (j-- > 0) {
+		pthread_join(exec->workers[j].thread, NULL);
+	}
+undo_deques:
+	while (i-- > 0) {
+		adeque_destroy(&exec->workers[i].deque);
+	}
+	afree(exec->workers, sizeof(struct aexec_worker) * nworkers);
+undo_inject:
+	afaaq_destroy(&exec->inject);
+	return -1;
+}
+
+int aexec_submit(aexec_t *exec, aexec_group_t *group, void (*fn)(void *),
+		 void *arg) {
+	struct aexec_task *task;
+	int r;
+	task = arcp_alloc(sizeof(struct aexec_task), NULL);
+	if (task == NULL) {
+		return -1;
+	}
+	task->fn = fn;
+	task->arg = arg;
+	task->group = group;
+	if (group != NULL) {
+		ak_ldadd(&group->state, AEXEC_GROUP_TASK, mo_relaxed);
+	}
+	if (aexec_self != NULL && aexec_self->exec == exec) {
+		/* not sequentially consistent, so aexec_wake may miss a
+		 * worker falling asleep; that only costs parallelism, since
+		 * this worker runs the task itself if nobody steals it */
+		r = adeque_push(&aexec_self->deque, task);
+	} else {
+		r = afaaq_enq(&exec->inject, task);
+	}
+	/* the deque or queue has its own reference now */
+	arcp_release(task);
+	if (unlikely(r != 0)) {
+		if (group != NULL) {
+			aexec_group_finish(group);
+		}
+		return -1;
+	}
+	aexec_wake(exec, 1);
+	return 0;
+}
+
+void aexec_wait_group(aexec_t *exec, aexec_group_t *group) {
+	struct aexec_task *task;
+	unsigned int state;
+	if (aexec_self != NULL && aexec_self->exec == exec) {
+		/* help out until the group is done */
+		while (ak_load(&group->state, mo_acquire)
+		       >= AEXEC_GROUP_TASK) {
+			task = aexec_find(aexec_self);
+			if (task != NULL) {
+				aexec_run(task);
+			} else {
+				cpu_yield();
+			}
+		}
+		return;
+	}
+	state = ak_load(&group->state, mo_acquire);
+	while (state >= AEXEC_GROUP_TASK) {
+		/* the flag tells the last task to wake us; it is in the same
+		 * word as the count, so that the task sees it with the same
+		 * decrement that lets us go */
+		if (!(state & AEXEC_GROUP_WAITING)) {
+			if (!ak_cas(&group->state, &state,
+				    state | AEXEC_GROUP_WAITING,
+				    mo_acquire, mo_acquire)) {
+				continue;
+			}
+			state |= AEXEC_GROUP_WAITING;
+		}
+		/* sleeps unless the state has changed since we read it */
+		syscall(SYS_futex, &group->state, FUTEX_WAIT_PRIVATE, state,
+			NULL, NULL, 0);
+		state = ak_load(&group->state, mo_acquire);
+	}
+	if (state == AEXEC_GROUP_WAITING) {
+		/* the group is still ours; drop the flag, so that the tasks
+		 * of its next use don't make a system call for nobody */
+		ak_cas_strong(&group->state, &state, 0, mo_relaxed,
+			      mo_relaxed);
+	}
+}
+
+void aexec_destroy(aexec_t *exec) {
+	struct aexec_task *task;
+	int i;
+	ak_store(&exec->stop, true, mo_seq_cst);
+	aexec_wake(exec, INT_MAX);
+	for (i = 0; i < exec->nworkers; i++) {
+		pthread_join(exec->workers[i].thread, NULL);
+	}
+	/* the workers have emptied the queue, unless somebody submitted
+	 * from outside after all; discard anything like that */
+	while ((task = (struct aexec_task *) afaaq_deq(&exec->inject))
+	       != NULL) {
+		arcp_release(task);
+	}
+	afaaq_destroy(&exec->inject);
+	for (i = 0; i < exec->nworkers; i++) {
+		adeque_destroy(&exec->workers[i].deque);
+	}
+	afree(exec->workers, sizeof(struct aexec_worker) * exec->nworkers);
+}
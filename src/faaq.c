@@ -0,0 +1,196 @@
+/*
+ * faaq.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "atomickit/atomic.h"
+#include "atomickit/rcp.h"
+#include "atomickit/faaq.h"
+
+/* What a consumer leaves in a slot it has dequeued from, or given up on */
+#define AFAAQ_TAKEN ((uintptr_t) 1)
+
+/* Segments whose release has been put off until the segment which was
+ * destroyed first on this thread is finished; see afaaq_segment_finalize */
+static _Thread_local struct afaaq_segment *afaaq_reap_list;
+static _Thread_local bool afaaq_reaping;
+
+static void afaaq_segment_finalize(struct afaaq_segment *segment) {
+	struct afaaq_segment *next;
+	uintptr_t item;
+	size_t i;
+	/* release whatever was never dequeued */
+	for (i = 0; i < AFAAQ_SEGMENT_SIZE; i++) {
+		item = ak_load(&segment->items[i], mo_relaxed);
+		if (item != 0 && item != AFAAQ_TAKEN) {
+			arcp_release((struct arcp_region *) item);
+		}
+	}
+	next = (struct afaaq_segment *) arcp_swap(&segment->next, NULL);
+	if (next == NULL) {
+		return;
+	}
+	if (afaaq_reaping) {
+		/* as in aqueue, leave the rest of the chain to the outermost
+		 * call rather than recursing down it */
+		next->reap = afaaq_reap_list;
+		afaaq_reap_list = next;
+		return;
+	}
+	afaaq_reaping = true;
+	arcp_release(next);
+	while ((next = afaaq_reap_list) != NULL) {
+		afaaq_reap_list = next->reap;
+		arcp_release(next);
+	}
+	afaaq_reaping = false;
+}
+
+/* Allocate a segment whose first slot already holds item, if item is not
+ * NULL. */
+static struct afaaq_segment *afaaq_segment_new(struct arcp_region *item) {
+	struct afaaq_segment *segment;
+	size_t i;
+	segment = arcp_alloc(sizeof(struct afaaq_segment),
+			     (arcp_destroy_f) afaaq_segment_finalize);
+	if (segment == NULL) {
+		return NULL;
+	}
+	arcp_init(&segment->next, NULL);
+	segment->reap = NULL;
+	ak_init(&segment->deq, 0);
+	ak_init(&segment->enq, item == NULL ? 0 : 1);
+	ak_init(&segment->items[0], (uintptr_t) item);
+	for (i = 1; i < AFAAQ_SEGMENT_SIZE; i++) {
+		ak_init(&segment->items[i], 0);
+	}
+	return segment;
+}
+
+int afaaq_init(afaaq_t *faaq) {
+	struct afaaq_segment *segment;
+	segment = afaaq_segment_new(NULL);
+	if (segment == NULL) {
+		return -1;
+	}
+	arcp_init(&faaq->head, segment);
+	arcp_init(&faaq->tail, segment);
+	arcp_release(segment);
+	return 0;
+}
+
+int afaaq_enq(afaaq_t *faaq, struct arcp_region *item) {
+	struct afaaq_segment *tail;
+	struct afaaq_segment *next;
+	uintptr_t expected;
+	size_t i;
+
+	/* the queue's reference, handed on to the dequeuer */
+	arcp_acquire(item);
+	for (;;) {
+		tail = (struct afaaq_segment *) arcp_load(&faaq->tail);
+		/* sequentially consistent, like the segment CAS below, so
+		 * that a caller can check for sleeping consumers with a
+		 * seq_cst load instead of a fence */
+		i = ak_ldadd(&tail->enq, 1, mo_seq_cst);
+		if (likely(i < AFAAQ_SEGMENT_SIZE)) {
+			expected = 0;
+			if (likely(ak_cas_strong(&tail->items[i], &expected,
+						 (uintptr_t) item,
+						 mo_seq_cst, mo_relaxed))) {
+				arcp_release(tail);
+				return 0;
+			}
+			/* a dequeuer gave up on the slot before we got to it;
+			 * claim another */
+			arcp_release(tail);
+			continue;
+		}
+		/* this segment is full */
+		next = (struct afaaq_segment *) arcp_load(&tail->next);
+		if (next != NULL) {
+			/* somebody else has added a segment, but has not yet
+			 * moved the tail to it; help it along */
+			arcp_cas_release(&faaq->tail, tail, next);
+			continue;
+		}
+		next = afaaq_segment_new(item);
+		if (unlikely(next == NULL)) {
+			arcp_release(tail);
+			arcp_release(item);
+			return -1;
+		}
+		if (likely(arcp_cas(&tail->next, NULL, next))) {
+			/* if this doesn't work, somebody else has already moved
+			 * the tail along */
+			arcp_cas(&faaq->tail, tail, next);
+			arcp_release(next);
+			arcp_release(tail);
+			return 0;
+		}
+		/* somebody else added a segment first; take item back out of
+		 * ours so that freeing it doesn't release item, and loop */
+		ak_store(&next->items[0], 0, mo_relaxed);
+		arcp_release(next);
+		arcp_release(tail);
+	}
+}
+
+struct arcp_region *afaaq_deq(afaaq_t *faaq) {
+	struct afaaq_segment *head;
+	struct afaaq_segment *next;
+	uintptr_t item;
+	size_t i;
+	for (;;) {
+		head = (struct afaaq_segment *) arcp_load(&faaq->head);
+		if (ak_load(&head->deq, mo_relaxed)
+		    >= ak_load(&head->enq, mo_relaxed)
+		    && arcp_load_phantom(&head->next) == NULL) {
+			/* empty; checking first keeps idle dequeuers from
+			 * spoiling slots which producers are about to fill */
+			arcp_release(head);
+			return NULL;
+		}
+		i = ak_ldadd(&head->deq, 1, mo_relaxed);
+		if (unlikely(i >= AFAAQ_SEGMENT_SIZE)) {
+			/* this segment is used up; move on to the next */
+			next = (struct afaaq_segment *) arcp_load(&head->next);
+			if (next == NULL) {
+				arcp_release(head);
+				return NULL;
+			}
+			arcp_cas_release(&faaq->head, head, next);
+			continue;
+		}
+		item = ak_swap(&head->items[i], AFAAQ_TAKEN, mo_acquire);
+		arcp_release(head);
+		if (likely(item != 0)) {
+			/* the queue's reference is now the caller's */
+			return (struct arcp_region *) item;
+		}
+		/* the producer of this slot hasn't stored its item yet; it
+		 * will find the slot taken and try another */
+	}
+}
+
+void afaaq_destroy(afaaq_t *faaq) {
+	arcp_store(&faaq->head, NULL);
+	arcp_store(&faaq->tail, NULL);
+}
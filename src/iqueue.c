@@ -0,0 +1,105 @@
+/*
+ * iqueue.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdbool.h>
+#include "atomickit/rcp.h"
+#include "atomickit/iqueue.h"
+
+/* Nodes whose release has been put off until the node which was destroyed
+ * first on this thread is finished; see aiqueue_node_finalize */
+static _Thread_local struct aiqueue_node *aiqueue_reap_list;
+static _Thread_local bool aiqueue_reaping;
+
+void aiqueue_node_finalize(struct aiqueue_node *node) {
+	struct aiqueue_node *next;
+	next = (struct aiqueue_node *) arcp_swap(&node->next, NULL);
+	if (next == NULL) {
+		return;
+	}
+	if (aiqueue_reaping) {
+		/* as in aqueue, leave the rest of the chain to the outermost
+		 * call rather than recursing down it */
+		next->reap = aiqueue_reap_list;
+		aiqueue_reap_list = next;
+		return;
+	}
+	aiqueue_reaping = true;
+	arcp_release(next);
+	while ((next = aiqueue_reap_list) != NULL) {
+		aiqueue_reap_list = next->reap;
+		arcp_release(next);
+	}
+	aiqueue_reaping = false;
+}
+
+int aiqueue_init(aiqueue_t *aiqueue) {
+	struct aiqueue_node *sentinel;
+	/* the first sentinel is not an item; after that each dequeued item
+	 * serves */
+	sentinel = arcp_alloc(sizeof(struct aiqueue_node),
+			      (arcp_destroy_f) aiqueue_node_finalize);
+	if (sentinel == NULL) {
+		return -1;
+	}
+	aiqueue_node_init(sentinel);
+	arcp_init(&aiqueue->head, sentinel);
+	arcp_init(&aiqueue->tail, sentinel);
+	arcp_release(sentinel);
+	return 0;
+}
+
+void aiqueue_enq(aiqueue_t *aiqueue, struct aiqueue_node *node) {
+	struct aiqueue_node *prev;
+
+	/* drop the link left from the last time node was in a queue */
+	arcp_store(&node->next, NULL);
+
+	/* claim the end of the queue, then hook the old end up to it; each
+	 * is one exchange, so an enqueuer never retries.  Until the hook is
+	 * in the dequeuer can't get past prev, so prev can't come back
+	 * around to be enqueued again under us. */
+	prev = (struct aiqueue_node *) arcp_swap(&aiqueue->tail, node);
+	arcp_store(&prev->next, node);
+	arcp_release(prev);
+}
+
+struct aiqueue_node *aiqueue_deq(aiqueue_t *aiqueue) {
+	struct aiqueue_node *head;
+	struct aiqueue_node *next;
+	/* there is only one dequeuer, so head can't change under us */
+	head = (struct aiqueue_node *) arcp_load_phantom(&aiqueue->head);
+	next = (struct aiqueue_node *) arcp_load(&head->next);
+	if (next == NULL) {
+		/* empty, or the next item is still being linked in, which
+		 * hides whatever was enqueued after it */
+		return NULL;
+	}
+	/* unhook the old sentinel before retiring it, so that once
+	 * aiqueue_done says it is done it no longer leads to next, which may
+	 * by then have left and be in a queue again */
+	arcp_store(&head->next, NULL);
+	/* next is the new sentinel; our reference to it is the caller's */
+	arcp_store(&aiqueue->head, next);
+	return next;
+}
+
+void aiqueue_destroy(aiqueue_t *aiqueue) {
+	arcp_store(&aiqueue->head, NULL);
+	arcp_store(&aiqueue->tail, NULL);
+}
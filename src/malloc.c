@@ -27,6 +27,7 @@
 #include <sys/types.h>
 #include <sys/mman.h>
 #include "atomickit/atomic.h"
+#include "atomickit/pointer.h"
 #include "atomickit/malloc.h"
 
 /* These things look like simple parameters, but if you change them beware the
@@ -40,10 +41,11 @@
 #define PAGE_CEIL(size)							\
 	(((((size) - 1) >> PAGE_SIZE_LOG2) + 1) << PAGE_SIZE_LOG2)
 /* Reference counting is stored in the extra bits of the aligned pointers. */
+#define PTR_COUNTSHIFT	APTR_COUNTSHIFT(MIN_SIZE)
+#define PTR_COUNTMAX	APTR_COUNTMAX(MIN_SIZE)
 #define PTR_DECOUNT(ptr)						\
-	((struct fstack_item *) (((uintptr_t) (ptr))			\
-				 & ~((uintptr_t) (MIN_SIZE - 1))))
-#define PTR_COUNT(ptr)	(((uintptr_t) (ptr)) & ((uintptr_t) (MIN_SIZE - 1)))
+	((struct fstack_item *) aptr_decount(ptr, PTR_COUNTSHIFT, PTR_COUNTMAX))
+#define PTR_COUNT(ptr)	aptr_count(ptr, PTR_COUNTSHIFT, PTR_COUNTMAX)
 
 /* For debugging amalloc */
 /* #define AMALLOC_DEBUG 1 */
@@ -446,17 +448,8 @@ static inline void *fstack_pop(int bin) {
 		void *next;
 		/* Acquire the top of the stack and update its reference
 		 * count. */
-		next = ak_load(&glbl_fstack[bin], mo_consume);
-		do {
-			while (PTR_COUNT(next) == MIN_SIZE - 1) {
-				/* Spinlock if too many threads are accessing
-				 * this at once. */
-				cpu_yield();
-				next = ak_load(&glbl_fstack[bin], mo_acquire);
-			}
-		} while (unlikely(!ak_cas(&glbl_fstack[bin], &next, next + 1,
-					  mo_acq_rel, mo_consume)));
-		next += 1;
+		next = aptr_ldinc(&glbl_fstack[bin], PTR_COUNTSHIFT,
+				  PTR_COUNTMAX, mo_acq_rel);
 		if (PTR_DECOUNT(next) == NULL) {
 			/* The stack is currently empty; get rid of the
 			 * reference count we just added to the NULL pointer.
@@ -554,17 +547,8 @@ static void fstack_push(int bin, void *ptr) {
 		/* Get the top of the stack; we have to update reference count
 		 * since we act like pop if there's more than our own
 		 * reference count. */
-		next = ak_load(&glbl_fstack[bin], mo_acquire);
-		do {
-			while (PTR_COUNT(next) == MIN_SIZE - 1) {
-				/* Spinlock if too many threads are accessing
-				 * this at once. */
-				cpu_yield();
-				next = ak_load(&glbl_fstack[bin], mo_acquire);
-			}
-		} while (unlikely(!ak_cas(&glbl_fstack[bin], &next, next + 1,
-					  mo_acq_rel, mo_acquire)));
-		next += 1;
+		next = aptr_ldinc(&glbl_fstack[bin], PTR_COUNTSHIFT,
+				  PTR_COUNTMAX, mo_acq_rel);
 		if (PTR_DECOUNT(next) == NULL) {
 			/* This is the only item that will be on the stack. */
 			new_item->next = NULL;
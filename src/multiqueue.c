@@ -0,0 +1,154 @@
+/*
+ * multiqueue.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include <unistd.h>
+#include "atomickit/atomic.h"
+#include "atomickit/malloc.h"
+#include "atomickit/rcp.h"
+#include "atomickit/faaq.h"
+#include "atomickit/multiqueue.h"
+
+/* Hands out thread numbers, from which each thread's shard is chosen */
+static atomic_size_t amultiqueue_nthreads = ATOMIC_VAR_INIT(0);
+
+/* One more than this thread's number, or zero if it doesn't have one yet */
+static _Thread_local size_t amultiqueue_thread;
+
+/* State for choosing shards to dequeue from */
+static _Thread_local uint32_t amultiqueue_rand;
+
+/* The size of the allocation for nshards shards, with room to align them */
+static inline size_t amultiqueue_memsize(size_t nshards) {
+	return sizeof(struct amultiqueue_shard) * nshards
+		+ alignof(struct amultiqueue_shard) - 1;
+}
+
+int amultiqueue_init(amultiqueue_t *mq, size_t nshards) {
+	long nprocs;
+	size_t i;
+	if (nshards == 0) {
+		nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+		nshards = nprocs > 0 ? (size_t) nprocs : 1;
+	}
+	mq->mem = amalloc(amultiqueue_memsize(nshards));
+	if (mq->mem == NULL) {
+		return -1;
+	}
+	/* amalloc doesn't promise the shards' alignment, so round up */
+	mq->shards = (struct amultiqueue_shard *)
+		(((uintptr_t) mq->mem + alignof(struct amultiqueue_shard) - 1)
+		 & ~(uintptr_t) (alignof(struct amultiqueue_shard) - 1));
+	for (i = 0; i < nshards; i++) {
+		if (afaaq_init(&mq->shards[i].queue) != 0) {
+			while (i-- > 0) {
+				afaaq_destroy(&mq->shards[i].queue);
+			}
+			afree(mq->mem, amultiqueue_memsize(nshards));
+			return -1;
+		}
+		ak_init(&mq->shards[i].size, 0);
+	}
+	mq->nshards = nshards;
+	return 0;
+}
+
+int amultiqueue_enq(amultiqueue_t *mq, struct arcp_region *item) {
+	struct amultiqueue_shard *shard;
+	if (unlikely(amultiqueue_thread == 0)) {
+		amultiqueue_thread =
+			ak_ldadd(&amultiqueue_nthreads, 1, mo_relaxed) + 1;
+	}
+	/* the same thread always uses the same shard, so that its own items
+	 * stay in order */
+	shard = &mq->shards[(amultiqueue_thread - 1) % mq->nshards];
+	/* count the item first, so that size is never short */
+	ak_ldadd(&shard->size, 1, mo_relaxed);
+	if (unlikely(afaaq_enq(&shard->queue, item) != 0)) {
+		ak_ldsub(&shard->size, 1, mo_relaxed);
+		return -1;
+	}
+	return 0;
+}
+
+/* Dequeue from one shard. */
+static inline struct arcp_region *amultiqueue_deq_shard(
+	struct amultiqueue_shard *shard) {
+	struct arcp_region *item;
+	if (ak_load(&shard->size, mo_relaxed) == 0) {
+		return NULL;
+	}
+	item = afaaq_deq(&shard->queue);
+	if (item != NULL) {
+		ak_ldsub(&shard->size, 1, mo_relaxed);
+	}
+	return item;
+}
+
+struct arcp_region *amultiqueue_deq(amultiqueue_t *mq) {
+	struct amultiqueue_shard *a;
+	struct amultiqueue_shard *b;
+	struct arcp_region *item;
+	size_t i, n, start;
+	n = mq->nshards;
+	if (unlikely(amultiqueue_rand == 0)) {
+		/* any nonzero seed will do, but different threads should
+		 * differ */
+		amultiqueue_rand = (uint32_t) (uintptr_t) &amultiqueue_rand | 1;
+	}
+	amultiqueue_rand ^= amultiqueue_rand << 13;
+	amultiqueue_rand ^= amultiqueue_rand >> 17;
+	amultiqueue_rand ^= amultiqueue_rand << 5;
+	start = amultiqueue_rand % n;
+	a = &mq->shards[start];
+	b = &mq->shards[(amultiqueue_rand >> 16) % n];
+	/* take from the fuller of two */
+	if (ak_load(&b->size, mo_relaxed) > ak_load(&a->size, mo_relaxed)) {
+		item = amultiqueue_deq_shard(b);
+		if (item == NULL) {
+			item = amultiqueue_deq_shard(a);
+		}
+	} else {
+		item = amultiqueue_deq_shard(a);
+		if (item == NULL && b != a) {
+			item = amultiqueue_deq_shard(b);
+		}
+	}
+	if (likely(item != NULL)) {
+		return item;
+	}
+	/* both were empty; look everywhere before saying so */
+	for (i = 1; i < n; i++) {
+		item = amultiqueue_deq_shard(&mq->shards[(start + i) % n]);
+		if (item != NULL) {
+			return item;
+		}
+	}
+	return NULL;
+}
+
+void amultiqueue_destroy(amultiqueue_t *mq) {
+	size_t i;
+	for (i = 0; i < mq->nshards; i++) {
+		afaaq_destroy(&mq->shards[i].queue);
+	}
+	afree(mq->mem, amultiqueue_memsize(mq->nshards));
+}
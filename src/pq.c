@@ -0,0 +1,386 @@
+/*
+ * pq.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "atomickit/atomic.h"
+#include "atomickit/malloc.h"
+#include "atomickit/rcp.h"
+#include "atomickit/pq.h"
+
+/* Regions whose release has been put off until the region which was
+ * released first on this thread is finished; see apq_reap.  A node may be
+ * linked from several others at once, so unlike aqueue the list can't be
+ * threaded through the nodes themselves. */
+static _Thread_local struct arcp_region **apq_reap_stack;
+static _Thread_local size_t apq_reap_len;
+static _Thread_local size_t apq_reap_cap;
+static _Thread_local bool apq_reaping;
+
+/* State for choosing the levels of new nodes */
+static _Thread_local uint32_t apq_rand;
+
+/* Release region, which may be NULL.  Releasing a node might destroy it, and
+ * so on down the list, which could be long enough to overflow the stack;
+ * anything released while that is happening is left to the outermost
+ * call. */
+static void apq_reap(struct arcp_region *region) {
+	struct arcp_region **stack;
+	size_t cap;
+	if (region == NULL) {
+		return;
+	}
+	if (apq_reaping) {
+		if (unlikely(apq_reap_len == apq_reap_cap)) {
+			cap = apq_reap_cap == 0 ? 64 : apq_reap_cap * 2;
+			stack = amalloc(sizeof(struct arcp_region *) * cap);
+			if (unlikely(stack == NULL)) {
+				/* no memory to defer with; recurse after all */
+				arcp_release(region);
+				return;
+			}
+			if (apq_reap_cap != 0) {
+				memcpy(stack, apq_reap_stack,
+				       sizeof(struct arcp_region *)
+				       * apq_reap_len);
+				afree(apq_reap_stack,
+				      sizeof(struct arcp_region *)
+				      * apq_reap_cap);
+			}
+			apq_reap_stack = stack;
+			apq_reap_cap = cap;
+		}
+		apq_reap_stack[apq_reap_len++] = region;
+		return;
+	}
+	apq_reaping = true;
+	arcp_release(region);
+	while (apq_reap_len > 0) {
+		arcp_release(apq_reap_stack[--apq_reap_len]);
+	}
+	if (apq_reap_cap != 0) {
+		afree(apq_reap_stack,
+		      sizeof(struct arcp_region *) * apq_reap_cap);
+		apq_reap_stack = NULL;
+		apq_reap_cap = 0;
+	}
+	apq_reaping = false;
+}
+
+static void apq_marker_finalize(struct apq_marker *marker) {
+	apq_reap(arcp_swap(&marker->next, NULL));
+}
+
+static void apq_node_finalize(struct apq_node *node) {
+	struct arcp_region *next;
+	int i;
+	arcp_store(&node->item, NULL);
+	for (i = node->level - 1; i > 0; i--) {
+		apq_reap(arcp_swap(&node->next[i], NULL));
+	}
+	next = arcp_swap(&node->next[0], NULL);
+	if (next == (struct arcp_region *) &node->marker) {
+		/* the marker lives in node, so it has to be finished with
+		 * here and now */
+		arcp_release(next);
+	} else {
+		apq_reap(next);
+	}
+	arcp_release(&node->marker);
+}
+
+static struct apq_node *apq_node_new(uint64_t prio, struct arcp_region *item,
+				     int level) {
+	struct apq_node *node;
+	int i;
+	node = arcp_alloc(sizeof(struct apq_node) + sizeof(arcp_t) * level,
+			  (arcp_destroy_f) apq_node_finalize);
+	if (node == NULL) {
+		return NULL;
+	}
+	node->prio = prio;
+	arcp_init(&node->item, item);
+	ak_init(&node->deleted, false);
+	node->level = level;
+	/* the node holds the marker's only reference until it is
+	 * finalized */
+	arcp_region_init(&node->marker,
+			 (arcp_destroy_f) apq_marker_finalize);
+	arcp_init(&node->marker.next, NULL);
+	for (i = 0; i < level; i++) {
+		arcp_init(&node->next[i], NULL);
+	}
+	return node;
+}
+
+/* A random level for a new node, with each level half as likely as the one
+ * below it. */
+static int apq_random_level(void) {
+	uint32_t r;
+	int level;
+	if (unlikely(apq_rand == 0)) {
+		/* any nonzero seed will do, but different threads should
+		 * differ */
+		apq_rand = (uint32_t) (uintptr_t) &apq_rand | 1;
+	}
+	apq_rand ^= apq_rand << 13;
+	apq_rand ^= apq_rand >> 17;
+	apq_rand ^= apq_rand << 5;
+	r = apq_rand;
+	for (level = 1; (r & 1) && level < APQ_MAX_LEVEL; r >>= 1) {
+		level++;
+	}
+	return level;
+}
+
+/* Does node come before the position of (prio, key)?  Equal priorities are
+ * ordered by address, so that the order is total. */
+static inline bool apq_before(struct apq_node *node, uint64_t prio,
+			      struct apq_node *key) {
+	return node->prio < prio
+		|| (node->prio == prio
+		    && (uintptr_t) node < (uintptr_t) key);
+}
+
+/* Is next, loaded from node->next[0], node's marker? */
+static inline bool apq_marked(struct apq_node *node, struct apq_node *next) {
+	return (struct arcp_region *) next
+		== (struct arcp_region *) &node->marker;
+}
+
+/* If node, which has been claimed, is marked, put a reference to its
+ * successor in *afterp and return true; otherwise node can't be unlinked
+ * yet. */
+static bool apq_marked_next(struct apq_node *node, struct apq_node **afterp) {
+	struct apq_node *next;
+	next = (struct apq_node *) arcp_load(&node->next[0]);
+	if (!apq_marked(node, next)) {
+		arcp_release(next);
+		return false;
+	}
+	*afterp = (struct apq_node *) arcp_load(&node->marker.next);
+	arcp_release(next);
+	return true;
+}
+
+/* If node, which has been claimed, can be unlinked at level i, put a
+ * reference to its successor there in *afterp and return true.  Above level
+ * 0 nodes are only shortcuts, and a claimed node can go right away; at level
+ * 0 it has to be marked first. */
+static inline bool apq_unlinkable(struct apq_node *node, int i,
+				  struct apq_node **afterp) {
+	if (i > 0) {
+		*afterp = (struct apq_node *) arcp_load(&node->next[i]);
+		return true;
+	}
+	return apq_marked_next(node, afterp);
+}
+
+/* Link node, which this thread has claimed, to its marker, so that nothing
+ * more can be inserted after it. */
+static void apq_mark(struct apq_node *node) {
+	struct arcp_region *next;
+	for (;;) {
+		next = arcp_load(&node->next[0]);
+		/* nobody else touches the marker until it is linked */
+		arcp_store(&node->marker.next, next);
+		if (likely(arcp_cas(&node->next[0], next,
+				    (struct arcp_region *) &node->marker))) {
+			arcp_release(next);
+			return;
+		}
+		arcp_release(next);
+	}
+}
+
+/* Release the nodes found by apq_find from level i up to nlevels. */
+static void apq_release_levels(struct apq_node **preds,
+			       struct apq_node **succs, int i, int nlevels) {
+	for (; i < nlevels; i++) {
+		arcp_release(preds[i]);
+		arcp_release(succs[i]);
+	}
+}
+
+/* Find, at each of the bottom nlevels levels, the last node before (prio,
+ * key) and the node after it, with a reference to each, unlinking claimed
+ * nodes along the way. */
+static void apq_find(apq_t *pq, uint64_t prio, struct apq_node *key,
+		     struct apq_node **preds, struct apq_node **succs,
+		     int nlevels) {
+	struct apq_node *pred;
+	struct apq_node *succ;
+	struct apq_node *after;
+	int i;
+retry:
+	pred = (struct apq_node *) arcp_acquire(pq->head);
+	/* no node reaches above the level hint, so start there */
+	for (i = ak_load(&pq->level, mo_acquire) - 1; i >= 0; i--) {
+		for (;;) {
+			succ = (struct apq_node *) arcp_load(&pred->next[i]);
+			if (succ == NULL) {
+				break;
+			}
+			if (unlikely(apq_marked(pred, succ))) {
+				/* pred was claimed and marked under us */
+				arcp_release(succ);
+				arcp_release(pred);
+				apq_release_levels(preds, succs, i + 1,
+						   nlevels);
+				goto retry;
+			}
+			if (unlikely(ak_load(&succ->deleted, mo_acquire))
+			    && apq_unlinkable(succ, i, &after)) {
+				arcp_cas(&pred->next[i], succ, after);
+				arcp_release(after);
+				arcp_release(succ);
+				continue;
+			}
+			if (!apq_before(succ, prio, key)) {
+				break;
+			}
+			arcp_release(pred);
+			pred = succ;
+		}
+		if (i < nlevels) {
+			preds[i] = (struct apq_node *) arcp_acquire(pred);
+			succs[i] = succ;
+		} else {
+			arcp_release(succ);
+		}
+	}
+	arcp_release(pred);
+}
+
+int apq_init(apq_t *pq) {
+	pq->head = apq_node_new(0, NULL, APQ_MAX_LEVEL);
+	if (pq->head == NULL) {
+		return -1;
+	}
+	ak_init(&pq->level, 1);
+	return 0;
+}
+
+int apq_insert(apq_t *pq, uint64_t prio, struct arcp_region *item) {
+	struct apq_node *preds[APQ_MAX_LEVEL];
+	struct apq_node *succs[APQ_MAX_LEVEL];
+	struct apq_node *node;
+	int level;
+	int i;
+
+	node = apq_node_new(prio, item, apq_random_level());
+	if (node == NULL) {
+		return -1;
+	}
+	/* raise the level hint before node can be found at its top */
+	level = ak_load(&pq->level, mo_relaxed);
+	while (unlikely(level < node->level)
+	       && !ak_cas(&pq->level, &level, node->level,
+			  mo_release, mo_relaxed)) {
+		/* retry */
+	}
+	/* once node is at level 0 it is in the queue */
+	for (;;) {
+		apq_find(pq, prio, node, preds, succs, node->level);
+		arcp_store(&node->next[0], succs[0]);
+		if (likely(arcp_cas(&preds[0]->next[0], succs[0], node))) {
+			break;
+		}
+		apq_release_levels(preds, succs, 0, node->level);
+	}
+	/* the levels above are only shortcuts, so don't bother once node has
+	 * been claimed */
+	for (i = 1; i < node->level; i++) {
+		for (;;) {
+			if (ak_load(&node->deleted, mo_relaxed)) {
+				goto done;
+			}
+			arcp_store(&node->next[i], succs[i]);
+			if (likely(arcp_cas(&preds[i]->next[i], succs[i],
+					    node))) {
+				break;
+			}
+			apq_release_levels(preds, succs, 0, node->level);
+			apq_find(pq, prio, node, preds, succs, node->level);
+		}
+	}
+done:
+	apq_release_levels(preds, succs, 0, node->level);
+	arcp_release(node);
+	return 0;
+}
+
+struct arcp_region *apq_delete_min(apq_t *pq, uint64_t *priop) {
+	struct apq_node *pred;
+	struct apq_node *succ;
+	struct apq_node *after;
+	struct arcp_region *item;
+	bool expected;
+retry:
+	pred = (struct apq_node *) arcp_acquire(pq->head);
+	for (;;) {
+		succ = (struct apq_node *) arcp_load(&pred->next[0]);
+		if (succ == NULL) {
+			/* empty */
+			arcp_release(pred);
+			return NULL;
+		}
+		if (unlikely(apq_marked(pred, succ))) {
+			/* pred was claimed and marked under us */
+			arcp_release(succ);
+			arcp_release(pred);
+			goto retry;
+		}
+		expected = false;
+		if (likely(!ak_load(&succ->deleted, mo_relaxed))
+		    && likely(ak_cas_strong(&succ->deleted, &expected, true,
+					    mo_acq_rel, mo_relaxed))) {
+			break;
+		}
+		/* somebody else has claimed succ; unlink it if they've
+		 * marked it, or else step over it */
+		if (apq_marked_next(succ, &after)) {
+			arcp_cas(&pred->next[0], succ, after);
+			arcp_release(after);
+			arcp_release(succ);
+			continue;
+		}
+		arcp_release(pred);
+		pred = succ;
+	}
+	/* succ is ours */
+	item = arcp_swap(&succ->item, NULL);
+	if (priop != NULL) {
+		*priop = succ->prio;
+	}
+	apq_mark(succ);
+	after = (struct apq_node *) arcp_load(&succ->marker.next);
+	/* if this fails, somebody else will unlink succ later */
+	arcp_cas(&pred->next[0], succ, after);
+	arcp_release(after);
+	arcp_release(succ);
+	arcp_release(pred);
+	return item;
+}
+
+void apq_destroy(apq_t *pq) {
+	apq_reap((struct arcp_region *) pq->head);
+}
@@ -17,31 +17,77 @@
  * You should have received a copy of the GNU General Public License
  * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "atomickit/atomic.h"
 #include "atomickit/rcp.h"
-#include "atomickit/malloc.h"
 #include "atomickit/queue.h"
 
-static void aqueue_node_destroy(struct aqueue_node *node) {
-	arcp_store(&node->next, NULL);
+/* Nodes whose release has been put off until the node which was destroyed
+ * first on this thread is finished; see aqueue_node_finalize */
+static _Thread_local struct aqueue_node *aqueue_reap_list;
+static _Thread_local bool aqueue_reaping;
+
+static void aqueue_node_finalize(struct aqueue_node *node) {
+	struct aqueue_node *next;
 	arcp_store(&node->item, NULL);
-	afree(node, sizeof(struct aqueue_node));
+	next = (struct aqueue_node *) arcp_swap(&node->next, NULL);
+	if (next == NULL) {
+		return;
+	}
+	if (aqueue_reaping) {
+		/* releasing next might destroy it, and so on down the
+		 * chain, which could be long enough to overflow the stack;
+		 * leave it to the outermost call */
+		next->reap = aqueue_reap_list;
+		aqueue_reap_list = next;
+		return;
+	}
+	aqueue_reaping = true;
+	arcp_release(next);
+	while ((next = aqueue_reap_list) != NULL) {
+		aqueue_reap_list = next->reap;
+		arcp_release(next);
+	}
+	aqueue_reaping = false;
+}
+
+/* Wake up to n dequeuers waiting in aqueue_deq_wait, if there are any,
+ * after something has been enqueued with a successful arcp_cas. */
+static inline void aqueue_wake(aqueue_t *aqueue, int n) {
+	/* the arcp_cas which linked the node in is sequentially consistent,
+	 * so this load needs no fence to pair with the one in
+	 * aqueue_deq_wait: either we see the waiter, or the waiter sees what
+	 * we enqueued */
+	if (likely(ak_load(&aqueue->waiters, mo_seq_cst) == 0)) {
+		return;
+	}
+	ak_ldadd(&aqueue->seq, 1, mo_release);
+	syscall(SYS_futex, &aqueue->seq, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
 }
 
 int aqueue_init(aqueue_t *aqueue) {
 	struct aqueue_node *sentinel;
 	/* allocate and initialize a sentinel node */
-	sentinel = amalloc(sizeof(struct aqueue_node));
+	sentinel = arcp_alloc(sizeof(struct aqueue_node),
+			      (arcp_destroy_f) aqueue_node_finalize);
 	if (sentinel == NULL) {
 		return -1;
 	}
 	arcp_init(&sentinel->item, NULL);
 	arcp_init(&sentinel->next, NULL);
-	arcp_region_init(sentinel, (arcp_destroy_f) aqueue_node_destroy);
 
 	/* set both head and tail to the sentinel */
 	arcp_init(&aqueue->head, sentinel);
 	arcp_init(&aqueue->tail, sentinel);
+	ak_init(&aqueue->seq, 0);
+	ak_init(&aqueue->waiters, 0);
 	arcp_release(sentinel);
 	return 0;
 }
@@ -52,13 +98,13 @@ int aqueue_enq(aqueue_t *aqueue, struct arcp_region *item) {
 	struct aqueue_node *next;
 
 	/* allocate and initialize a new node */
-	node = amalloc(sizeof(struct aqueue_node));
+	node = arcp_alloc(sizeof(struct aqueue_node),
+			  (arcp_destroy_f) aqueue_node_finalize);
 	if (node == NULL) {
 		return -1;
 	}
 	arcp_init(&node->item, item);
 	arcp_init(&node->next, NULL);
-	arcp_region_init(node, (arcp_destroy_f) aqueue_node_destroy);
 
 	for (;;) {
 		/* acquire tail and tail->next */
@@ -75,6 +121,7 @@ int aqueue_enq(aqueue_t *aqueue, struct arcp_region *item) {
 			 * that somebody else has set the tail further
 			 * along. */
 			arcp_cas_release(&aqueue->tail, tail, node);
+			aqueue_wake(aqueue, 1);
 			return 0;
 		} else {
 			/* couldn't add something on the end; release and
@@ -84,6 +131,198 @@ int aqueue_enq(aqueue_t *aqueue, struct arcp_region *item) {
 	}
 }
 
+int aqueue_enq_n(aqueue_t *aqueue, struct arcp_region **items, size_t n) {
+	struct aqueue_node *first;
+	struct aqueue_node *last;
+	struct aqueue_node *node;
+	struct aqueue_node *tail;
+	struct aqueue_node *next;
+	size_t i;
+
+	if (n == 0) {
+		return 0;
+	}
+
+	/* allocate the nodes and link them together; we keep a reference to
+	 * the first and the last */
+	first = arcp_alloc(sizeof(struct aqueue_node),
+			   (arcp_destroy_f) aqueue_node_finalize);
+	if (first == NULL) {
+		return -1;
+	}
+	arcp_init(&first->item, items[0]);
+	arcp_init(&first->next, NULL);
+	last = first;
+	for (i = 1; i < n; i++) {
+		node = arcp_alloc(sizeof(struct aqueue_node),
+				  (arcp_destroy_f) aqueue_node_finalize);
+		if (node == NULL) {
+			/* the chain is private, so this just frees it */
+			if (last != first) {
+				arcp_release(last);
+			}
+			arcp_release(first);
+			return -1;
+		}
+		arcp_init(&node->item, items[i]);
+		arcp_init(&node->next, NULL);
+		arcp_store(&last->next, node);
+		if (last != first) {
+			arcp_release(last);
+		}
+		last = node;
+	}
+
+	for (;;) {
+		/* acquire tail and tail->next */
+		tail = (struct aqueue_node *) arcp_load(&aqueue->tail);
+		next = (struct aqueue_node *) arcp_load(&tail->next);
+		if (unlikely(next != NULL)) {
+			/* help the tail along, as in aqueue_enq */
+			arcp_cas_release(&aqueue->tail, tail, next);
+		} else if (likely(arcp_cas(&tail->next, NULL, first))) {
+			/* the whole chain is in; try to move the tail to the
+			 * end of it */
+			if (last != first) {
+				arcp_release(first);
+			}
+			arcp_cas_release(&aqueue->tail, tail, last);
+			aqueue_wake(aqueue, n < INT_MAX ? (int) n : INT_MAX);
+			return 0;
+		} else {
+			arcp_release(tail);
+		}
+	}
+}
+
+struct arcp_region *aqueue_deq_wait(aqueue_t *aqueue,
+				    const struct timespec *timeout) {
+	struct arcp_region *item;
+	struct timespec deadline;
+	struct timespec remaining;
+	unsigned int seq;
+	int i;
+	for (i = 0; i < AQUEUE_WAIT_SPINS; i++) {
+		item = aqueue_deq(aqueue);
+		if (item != NULL) {
+			return item;
+		}
+		cpu_yield();
+	}
+	if (timeout != NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout->tv_sec;
+		deadline.tv_nsec += timeout->tv_nsec;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+	for (;;) {
+		ak_ldadd(&aqueue->waiters, 1, mo_relaxed);
+		/* pairs with the load of waiters in aqueue_wake */
+		ak_fence(mo_seq_cst);
+		seq = ak_load(&aqueue->seq, mo_acquire);
+		item = aqueue_deq(aqueue);
+		if (item != NULL) {
+			break;
+		}
+		if (timeout != NULL) {
+			clock_gettime(CLOCK_MONOTONIC, &remaining);
+			remaining.tv_sec = deadline.tv_sec - remaining.tv_sec;
+			remaining.tv_nsec = deadline.tv_nsec
+				- remaining.tv_nsec;
+			if (remaining.tv_nsec < 0) {
+				remaining.tv_sec--;
+				remaining.tv_nsec += 1000000000;
+			}
+			if (remaining.tv_sec < 0) {
+				break;
+			}
+		}
+		/* sleeps unless an enqueuer has advanced seq since we
+		 * read it */
+		syscall(SYS_futex, &aqueue->seq, FUTEX_WAIT_PRIVATE, seq,
+			timeout == NULL ? NULL : &remaining, NULL, 0);
+		ak_ldsub(&aqueue->waiters, 1, mo_relaxed);
+	}
+	ak_ldsub(&aqueue->waiters, 1, mo_relaxed);
+	return item;
+}
+
+/* Detach up to n nodes from the head of the queue.  Returns the number
+ * detached, and a reference to the old head in *headp; the detached nodes
+ * follow it, and stay alive as long as it does. */
+static size_t aqueue_detach(aqueue_t *aqueue, size_t n,
+			    struct aqueue_node **headp) {
+	struct aqueue_node *head;
+	struct aqueue_node *last;
+	struct aqueue_node *next;
+	size_t i;
+	for (;;) {
+		head = (struct aqueue_node *) arcp_load(&aqueue->head);
+		/* each node holds the next, so while we hold head we may walk
+		 * the chain without taking references */
+		last = head;
+		for (i = 0; i < n; i++) {
+			next = (struct aqueue_node *)
+				arcp_load_phantom(&last->next);
+			if (next == NULL) {
+				break;
+			}
+			last = next;
+		}
+		if (i == 0) {
+			/* empty (sentinel is all there is) */
+			arcp_release(head);
+			return 0;
+		}
+		if (likely(arcp_cas(&aqueue->head, head, last))) {
+			*headp = head;
+			return i;
+		}
+		/* the head of the queue moved out from under us */
+		arcp_release(head);
+	}
+}
+
+size_t aqueue_deq_n(aqueue_t *aqueue, struct arcp_region **items, size_t n) {
+	struct aqueue_node *head;
+	struct aqueue_node *node;
+	size_t i;
+	n = aqueue_detach(aqueue, n, &head);
+	if (n == 0) {
+		return 0;
+	}
+	node = head;
+	for (i = 0; i < n; i++) {
+		node = (struct aqueue_node *) arcp_load_phantom(&node->next);
+		items[i] = arcp_swap(&node->item, NULL);
+	}
+	arcp_release(head);
+	return n;
+}
+
+size_t aqueue_drain(aqueue_t *aqueue,
+		    void (*fn)(struct arcp_region *item, void *arg),
+		    void *arg) {
+	struct aqueue_node *head;
+	struct aqueue_node *node;
+	size_t i;
+	size_t n;
+	n = aqueue_detach(aqueue, SIZE_MAX, &head);
+	if (n == 0) {
+		return 0;
+	}
+	node = head;
+	for (i = 0; i < n; i++) {
+		node = (struct aqueue_node *) arcp_load_phantom(&node->next);
+		fn(arcp_swap(&node->item, NULL), arg);
+	}
+	arcp_release(head);
+	return n;
+}
+
 struct arcp_region *aqueue_deq(aqueue_t *aqueue) {
 	struct aqueue_node *head;
 	struct aqueue_node *next;
@@ -117,19 +356,19 @@ struct arcp_region *aqueue_peek(aqueue_t *aqueue) {
 	struct aqueue_node *next;
 	struct arcp_region *item;
 	for (;;) {
-		/* get head and head->next */
-		head = (struct aqueue_node *) arcp_load(&aqueue->head);
-		next = (struct aqueue_node *) arcp_load(&head->next);
+		/* borrow head and head->next */
+		head = (struct aqueue_node *) arcp_borrow(&aqueue->head);
+		next = (struct aqueue_node *) arcp_borrow(&head->next);
 		if (next == NULL) {
 			/* empty (sentinel is all there is) */
-			arcp_release(head);
+			arcp_unborrow(head);
 			return NULL;
 		}
 		/* grab a reference to item */
 		item = arcp_load(&next->item);
-		/* release stuff */
-		arcp_release(head);
-		arcp_release(next);
+		/* return the borrowed nodes */
+		arcp_unborrow(next);
+		arcp_unborrow(head);
 		if (item == NULL) {
 			/* either item was snatched up from under us, or it
 			 * really is NULL. Compare head w/ aqueue->head to
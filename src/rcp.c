@@ -20,22 +20,196 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdalign.h>
+#include <pthread.h>
 #include "atomickit/atomic.h"
 #include "atomickit/malloc.h"
 #include "atomickit/rcp.h"
+#include "atomickit/txn.h"
 
-#define __ARCP_HOHDEL __ARCP_COUNTMASK
-#define __ARCP_WEAKMAX (__ARCP_COUNTMASK - 1)
+#define __ARCP_HOHDEL __ARCP_COUNTMAX
+#define __ARCP_WEAKMAX (__ARCP_COUNTMAX - 1)
 
-/* Update the references for the region, adding storedelta to storecount and
- * usedelta to usecount. Returns true when the region should be deleted. */
-static inline bool __arcp_urefs(struct arcp_region *region,
-				int16_t storedelta, int16_t usedelta) {
+/* Size of the unit of memory sharing between cores */
+#define __ARCP_CACHELINE 64
+
+/* States of a sharded region's subcounters */
+enum {
+	__ARCP_SHARDS_IDLE = 0,		/* counts go to the region */
+	__ARCP_SHARDS_ACTIVATING,	/* subcounters are being reset */
+	__ARCP_SHARDS_ACTIVE,		/* use counts go to the subcounters */
+	__ARCP_SHARDS_DRAINING		/* subcounters are being folded back */
+};
+
+/* Value swapped into a subcounter when it is folded into the region; any
+ * value below __ARCP_SHARD_DEAD / 2 belongs to a folded subcounter. */
+#define __ARCP_SHARD_DEAD (INTPTR_MIN / 2)
+
+struct arcp_shards {
+	alignas(__ARCP_CACHELINE) atomic_int state;
+	struct {
+		alignas(__ARCP_CACHELINE) atomic_intptr_t count;
+	} shard[ARCP_NSHARDS];
+};
+
+/* Precedes a region allocated with arcp_alloc */
+struct arcp_alloc_header {
+	alignas(max_align_t) size_t size;	/* of the whole allocation */
+	arcp_destroy_f finalize;
+};
+
+/* Precedes a region allocated with arcp_alloc_weak, which shares the
+ * allocation with its weak reference; whichever of the two is destroyed
+ * last frees it. */
+struct arcp_alloc_weak_header {
+	struct arcp_alloc_header;
+	atomic_int parts;		/* of region and stub, still alive */
+	struct arcp_weakref stub;
+};
+
+/* The next subcounter to hand out to a thread */
+static atomic_uint __arcp_shard_next = ATOMIC_VAR_INIT(0);
+
+/* This thread's subcounter, plus one; zero until first used */
+static _Thread_local unsigned int __arcp_shard_hint;
+
+/* The regions a thread has borrowed */
+struct arcp_hazards {
+	alignas(__ARCP_CACHELINE)
+	_Atomic(struct arcp_region *) slot[ARCP_NBORROWS];
+	atomic_bool in_use;		/* claimed by a live thread */
+	int nactive;			/* slots holding a borrow; owner only */
+	struct arcp_hazards *next;	/* immutable once published */
+};
+
+/* A region whose destruction has been deferred because it was borrowed */
+struct arcp_retired {
+	struct arcp_retired *next;
+	struct arcp_region *region;
+};
+
+/* All borrow slots ever handed out; these are reused but never freed */
+static _Atomic(struct arcp_hazards *) __arcp_hazards_list
+	= ATOMIC_VAR_INIT(NULL);
+
+/* Regions awaiting destruction */
+static _Atomic(struct arcp_retired *) __arcp_retired_list
+	= ATOMIC_VAR_INIT(NULL);
+
+/* The number of threads with anything borrowed right now */
+static atomic_uint __arcp_borrowers = ATOMIC_VAR_INIT(0);
+
+/* This thread's borrow slots */
+static _Thread_local struct arcp_hazards *__arcp_my_hazards;
+
+/* A transformation queued by arcp_update for a combining writer */
+struct arcp_update_req {
+	struct arcp_update_req *next;
+	arcp_t *rcp;
+	arcp_update_f fn;
+	void *arg;
+	int result;
+	atomic_bool done;		/* result is set; no longer touched by
+					 * the combiner */
+};
+
+/* Number of combining queues; pointers share them by hash */
+#define __ARCP_NCOMBINERS 64
+
+/* Longest backoff between attempts in arcp_update, in yields */
+#define __ARCP_BACKOFF_MAX 1024
+
+/* Transformations waiting for a combining writer */
+struct arcp_combiner {
+	alignas(__ARCP_CACHELINE) atomic_bool lock;
+	_Atomic(struct arcp_update_req *) pending;
+};
+
+static struct arcp_combiner __arcp_combiners[__ARCP_NCOMBINERS];
+
+/* Key used to give back the borrow slots when a thread exits */
+static pthread_key_t __arcp_hazards_key;
+static pthread_once_t __arcp_hazards_once = PTHREAD_ONCE_INIT;
+
+#if ARCP_INSTRUMENT
+/* Number of locations for which contention can be counted */
+#define __ARCP_STATS_BITS 10
+#define __ARCP_STATS_SIZE (1 << __ARCP_STATS_BITS)
+
+/* Contention counted at one location; addr is 0 while unclaimed */
+struct arcp_stats_entry {
+	atomic_uintptr_t addr;
+	atomic_ulong count[ARCP_STAT_NKINDS];
+};
+
+static struct arcp_stats_entry __arcp_stats[__ARCP_STATS_SIZE];
+
+/* Only one of every __arcp_stats_rate events is counted */
+static atomic_uint __arcp_stats_rate = ATOMIC_VAR_INIT(1);
+
+/* Events this thread has yet to skip before counting another */
+static _Thread_local unsigned int __arcp_stats_skip;
+
+/* Count an event of the given kind at addr. */
+static void __arcp_stat(const void *addr, enum arcp_stat_kind kind) {
+	uintptr_t key, o_key;
+	unsigned int rate;
+	size_t h, i;
+	if (__arcp_stats_skip != 0) {
+		__arcp_stats_skip--;
+		return;
+	}
+	rate = ak_load(&__arcp_stats_rate, mo_relaxed);
+	__arcp_stats_skip = rate - 1;
+	key = (uintptr_t) addr;
+	h = (size_t) (((uint64_t) (key >> 3) * UINT64_C(0x9e3779b97f4a7c15))
+		      >> (64 - __ARCP_STATS_BITS));
+	/* find or claim the entry by linear probing */
+	for (i = 0; i < __ARCP_STATS_SIZE; i++) {
+		struct arcp_stats_entry *entry;
+		entry = &__arcp_stats[(h + i) & (__ARCP_STATS_SIZE - 1)];
+		o_key = ak_load(&entry->addr, mo_relaxed);
+		if (o_key == 0
+		    && ak_cas_strong(&entry->addr, &o_key, key,
+				     mo_relaxed, mo_relaxed)) {
+			o_key = key;
+		}
+		if (o_key == key) {
+			ak_ldadd(&entry->count[kind], rate, mo_relaxed);
+			return;
+		}
+	}
+	/* the table is full, so the event goes uncounted */
+}
+
+# define __ARCP_STAT(addr, kind) __arcp_stat((const void *) (addr), (kind))
+#else
+# define __ARCP_STAT(addr, kind) ((void) 0)
+#endif
+
+/* Update the references for the region itself, adding storedelta to
+ * storecount and usedelta to usecount. Returns true when the region should be
+ * deleted. If result is not NULL, the new refcount is stored there. */
+static inline bool __arcp_urefs_region(struct arcp_region *region,
+				       int storedelta, int usedelta,
+				       arcp_refcount_t *result) {
 	arcp_refcount_t count, o_count;
 	bool destroy;
 	/* load o_count via the pun */
 	o_count.p = ak_load(&region->refcount, mo_consume);
-	do {
+	for (;;) {
+		if (unlikely(o_count.p == 0 && storedelta == 0
+			     && usedelta > 0)) {
+			/* a weak reference is reviving the region just as
+			 * arcp_release's fast path took the count to zero;
+			 * let that release take the destroy lock first, so
+			 * that it never touches the region after we might
+			 * have destroyed it */
+			__ARCP_STAT(region, ARCP_STAT_UREFS_RETRY);
+			cpu_yield();
+			o_count.p = ak_load(&region->refcount, mo_consume);
+			continue;
+		}
 		/* set count to o_count via the pun */
 		count.p = o_count.p;
 		/* alter count */
@@ -53,11 +227,255 @@ static inline bool __arcp_urefs(struct arcp_region *region,
 			 * lock is set */
 			destroy = false;
 		}
-	} while (unlikely(!ak_cas(&region->refcount, &o_count.p, count.p,
-				  mo_acq_rel, mo_consume)));
+		if (likely(ak_cas(&region->refcount, &o_count.p, count.p,
+				  mo_acq_rel, mo_consume))) {
+			break;
+		}
+		__ARCP_STAT(region, ARCP_STAT_UREFS_RETRY);
+	}
+	if (result != NULL) {
+		*result = count;
+	}
+	return destroy;
+}
+
+/* Add delta to this thread's subcounter. Returns false if the subcounter has
+ * been folded into the region, in which case the count goes to the region. */
+static inline bool __arcp_shard_add(struct arcp_shards *shards, int delta) {
+	if (unlikely(__arcp_shard_hint == 0)) {
+		__arcp_shard_hint = (ak_ldadd(&__arcp_shard_next, 1, mo_relaxed)
+				     & (ARCP_NSHARDS - 1)) + 1;
+	}
+	return likely(ak_ldadd(&shards->shard[__arcp_shard_hint - 1].count,
+			       delta, mo_acq_rel)
+		      >= __ARCP_SHARD_DEAD / 2);
+}
+
+/* Fold the subcounters back into the region. Returns true when the region
+ * should be deleted. */
+static bool __arcp_shards_drain(struct arcp_region *region) {
+	struct arcp_shards *shards = region->shards;
+	int state = __ARCP_SHARDS_ACTIVE;
+	intptr_t sum;
+	bool destroy;
+	int i;
+
+	if (!ak_cas_strong(&shards->state, &state, __ARCP_SHARDS_DRAINING,
+			   mo_acq_rel, mo_relaxed)) {
+		/* somebody else is folding or has folded the subcounters */
+		return false;
+	}
+	sum = 0;
+	for (i = 0; i < ARCP_NSHARDS; i++) {
+		sum += ak_swap(&shards->shard[i].count, __ARCP_SHARD_DEAD,
+			       mo_acq_rel);
+	}
+	/* transfer the use counts and drop the bias in one step */
+	destroy = __arcp_urefs_region(region, -1, (int) sum, NULL);
+	ak_store(&shards->state, __ARCP_SHARDS_IDLE, mo_release);
 	return destroy;
 }
 
+/* Start using the subcounters of a region. The caller must hold a
+ * reference. */
+static void __arcp_shards_activate(struct arcp_region *region) {
+	struct arcp_shards *shards = region->shards;
+	int state = __ARCP_SHARDS_IDLE;
+	arcp_refcount_t count;
+	int i;
+
+	if (!ak_cas_strong(&shards->state, &state, __ARCP_SHARDS_ACTIVATING,
+			   mo_acq_rel, mo_relaxed)) {
+		return;
+	}
+	for (i = 0; i < ARCP_NSHARDS; i++) {
+		ak_store(&shards->shard[i].count, 0, mo_relaxed);
+	}
+	/* hold a bias store reference so that the region cannot reach zero
+	 * while its use count is spread across the subcounters */
+	__arcp_urefs_region(region, 1, 0, NULL);
+	ak_store(&shards->state, __ARCP_SHARDS_ACTIVE, mo_seq_cst);
+	count.p = ak_load(&region->refcount, mo_seq_cst);
+	if (count.v.storecount == 1) {
+		/* the last store went away while we were activating; as the
+		 * caller holds a reference this can't destroy the region */
+		__arcp_shards_drain(region);
+	}
+}
+
+/* Update the references for a region with sharded use counts. */
+static bool __arcp_urefs_sharded(struct arcp_region *region,
+				 int storedelta, int usedelta) {
+	struct arcp_shards *shards = region->shards;
+	arcp_refcount_t count;
+	bool destroy;
+
+	if (storedelta == 0) {
+		switch (ak_load(&shards->state, mo_acquire)) {
+		case __ARCP_SHARDS_IDLE:
+			/* only shard while the region is stored somewhere */
+			count.p = ak_load(&region->refcount, mo_relaxed);
+			if (count.v.storecount == 0) {
+				break;
+			}
+			__arcp_shards_activate(region);
+			/* fall through */
+		case __ARCP_SHARDS_ACTIVE:
+			if (likely(__arcp_shard_add(shards, usedelta))) {
+				return false;
+			}
+			break;
+		}
+		return __arcp_urefs_region(region, 0, usedelta, NULL);
+	}
+	destroy = __arcp_urefs_region(region, storedelta, usedelta, &count);
+	if (storedelta < 0 && count.v.storecount == 1
+	    && ak_load(&shards->state, mo_seq_cst) == __ARCP_SHARDS_ACTIVE) {
+		/* only the bias is left */
+		destroy = __arcp_shards_drain(region);
+	}
+	return destroy;
+}
+
+/* Update the references for the region, adding storedelta to storecount and
+ * usedelta to usecount. Returns true when the region should be deleted. */
+static inline bool __arcp_urefs(struct arcp_region *region,
+				int storedelta, int usedelta) {
+	if (unlikely(region->shards != NULL)) {
+		return __arcp_urefs_sharded(region, storedelta, usedelta);
+	}
+	return __arcp_urefs_region(region, storedelta, usedelta, NULL);
+}
+
+/* Destruction function for regions allocated with arcp_alloc */
+static void __arcp_alloc_destroy(struct arcp_region *region) {
+	struct arcp_alloc_header *header;
+	header = ((struct arcp_alloc_header *) region) - 1;
+	if (header->finalize != NULL) {
+		header->finalize(region);
+	}
+	afree(header, header->size);
+}
+
+/* Free an arcp_alloc_weak allocation once both its parts are gone. */
+static void __arcp_alloc_weak_put(struct arcp_alloc_weak_header *header) {
+	if (ak_ldsub(&header->parts, 1, mo_acq_rel) == 1) {
+		afree(header, header->size);
+	}
+}
+
+/* Destruction function for regions allocated with arcp_alloc_weak */
+static void __arcp_alloc_weak_destroy(struct arcp_region *region) {
+	struct arcp_alloc_weak_header *header;
+	header = ((struct arcp_alloc_weak_header *) region) - 1;
+	if (header->finalize != NULL) {
+		header->finalize(region);
+	}
+	__arcp_alloc_weak_put(header);
+}
+
+/* Destruction function for the weak reference of such a region */
+static void __arcp_alloc_weak_destroy_stub(struct arcp_region *stub) {
+	__arcp_alloc_weak_put((struct arcp_alloc_weak_header *)
+			      ((char *) stub
+			       - offsetof(struct arcp_alloc_weak_header,
+					  stub)));
+}
+
+/* Run the destruction function of a region whose references are gone. */
+static void __arcp_destroy_now(struct arcp_region *region) {
+	__ARCP_STAT((uintptr_t) region->destroy, ARCP_STAT_DESTROY);
+	if (region->shards != NULL) {
+		afree(region->shards, sizeof(struct arcp_shards));
+	}
+	if (region->destroy == __arcp_alloc_destroy) {
+		/* call it directly */
+		__arcp_alloc_destroy(region);
+	} else if (region->destroy != NULL) {
+		region->destroy(region);
+	}
+}
+
+/* Is the region borrowed by any thread? */
+static bool __arcp_borrowed(struct arcp_region *region) {
+	struct arcp_hazards *hazards;
+	int i;
+
+	/* order the removal of the last reference before the scan */
+	ak_fence(mo_seq_cst);
+	for (hazards = ak_load(&__arcp_hazards_list, mo_acquire);
+	     hazards != NULL;
+	     hazards = hazards->next) {
+		for (i = 0; i < ARCP_NBORROWS; i++) {
+			if (ak_load(&hazards->slot[i], mo_seq_cst) == region) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/* Destroy whichever retired regions are no longer borrowed. */
+static void __arcp_reclaim(void) {
+	struct arcp_retired *retired, *next;
+
+	retired = ak_swap(&__arcp_retired_list, NULL, mo_acq_rel);
+	while (retired != NULL) {
+		next = retired->next;
+		if (__arcp_borrowed(retired->region)) {
+			/* still borrowed; put it back */
+			retired->next = ak_load(&__arcp_retired_list,
+						mo_relaxed);
+			while (unlikely(!ak_cas(&__arcp_retired_list,
+						&retired->next, retired,
+						mo_acq_rel, mo_relaxed))) {
+				/* retry */
+			}
+		} else {
+			__arcp_destroy_now(retired->region);
+			afree(retired, sizeof(struct arcp_retired));
+		}
+		retired = next;
+	}
+}
+
+/* Destroy a region whose references are gone, unless it is borrowed, in
+ * which case defer its destruction until it has been returned. */
+static void __arcp_finalize(struct arcp_region *region) {
+	struct arcp_retired *retired;
+
+	/* pairs with arcp_borrow: either it sees the region gone from the
+	 * pointer, or we see it counted among the borrowers */
+	ak_fence(mo_seq_cst);
+	if (likely(ak_load(&__arcp_borrowers, mo_relaxed) == 0)) {
+		/* nothing is borrowed anywhere */
+		__arcp_destroy_now(region);
+		return;
+	}
+	if (unlikely(__arcp_borrowed(region))) {
+		retired = amalloc(sizeof(struct arcp_retired));
+		if (likely(retired != NULL)) {
+			retired->region = region;
+			retired->next = ak_load(&__arcp_retired_list,
+						mo_relaxed);
+			while (unlikely(!ak_cas(&__arcp_retired_list,
+						&retired->next, retired,
+						mo_acq_rel, mo_relaxed))) {
+				/* retry */
+			}
+			return;
+		}
+		/* no memory to defer with; wait out the borrow */
+		do {
+			cpu_yield();
+		} while (__arcp_borrowed(region));
+	}
+	__arcp_destroy_now(region);
+	if (unlikely(ak_load(&__arcp_retired_list, mo_relaxed) != NULL)) {
+		__arcp_reclaim();
+	}
+}
+
 /* Try to release the destroy lock for the region. Returns true if the lock
  * has been released, false if the destroy lock could not be released. */
 static bool __arcp_try_release_destroy_lock(struct arcp_region *region) {
@@ -92,9 +510,7 @@ static void __arcp_try_destroy(struct arcp_region *region) {
 		(struct arcp_weakref *) ak_load(&region->weakref, mo_consume);
 	if (weakref == NULL) {
 		/* if there's no weakref, just run the destruction function */
-		if (region->destroy != NULL) {
-			region->destroy(region);
-		}
+		__arcp_finalize(region);
 		return;
 	}
 	/* load the weakref target pointer to get any count which potentially
@@ -160,9 +576,7 @@ retry:
 		__arcp_try_destroy(weakref);
 	}
 	/* destroy region */
-	if (region->destroy != NULL) {
-		region->destroy(region);
-	}
+	__arcp_finalize(region);
 }
 
 static void __arcp_destroy_weakref(struct arcp_weakref *stub) {
@@ -175,6 +589,46 @@ void arcp_region_init(struct arcp_region *region,
 	ak_init(&region->refcount, __ARCP_REFCOUNT_INIT(0, 1));
 	region->destroy = destroy;
 	ak_init(&region->weakref, NULL);
+	region->shards = NULL;
+}
+
+void *arcp_alloc(size_t size, arcp_destroy_f finalize) {
+	struct arcp_alloc_header *header;
+	struct arcp_region *region;
+	header = amalloc(sizeof(struct arcp_alloc_header) + size);
+	if (header == NULL) {
+		return NULL;
+	}
+	header->size = sizeof(struct arcp_alloc_header) + size;
+	header->finalize = finalize;
+	region = (struct arcp_region *) (header + 1);
+	arcp_region_init(region, __arcp_alloc_destroy);
+	return region;
+}
+
+void arcp_alloc_free(void *region) {
+	struct arcp_alloc_header *header;
+	header = ((struct arcp_alloc_header *) region) - 1;
+	afree(header, header->size);
+}
+
+int arcp_region_init_sharded(struct arcp_region *region,
+			     void (*destroy)(struct arcp_region *)) {
+	struct arcp_shards *shards;
+	int i;
+
+	arcp_region_init(region, destroy);
+	shards = amalloc(sizeof(struct arcp_shards));
+	if (shards == NULL) {
+		return -1;
+	}
+	/* the subcounters only come alive once the region is stored */
+	ak_init(&shards->state, __ARCP_SHARDS_IDLE);
+	for (i = 0; i < ARCP_NSHARDS; i++) {
+		ak_init(&shards->shard[i].count, __ARCP_SHARD_DEAD);
+	}
+	region->shards = shards;
+	return 0;
 }
 
 int arcp_region_init_weakref(struct arcp_region *region) {
@@ -202,6 +656,7 @@ int arcp_region_init_weakref(struct arcp_region *region) {
 	ak_init(&stub->refcount, __ARCP_REFCOUNT_INIT(1, 0));
 	stub->destroy = (arcp_destroy_f) __arcp_destroy_weakref;
 	ak_init(&stub->weakref, NULL);
+	stub->shards = NULL;
 	if (unlikely(!ak_cas(&region->weakref, &nostub, stub,
 			     mo_acq_rel, mo_relaxed))) {
 		/* someone else set the weakref */
@@ -210,27 +665,186 @@ int arcp_region_init_weakref(struct arcp_region *region) {
 	return 0;
 }
 
+void *arcp_alloc_weak(size_t size, arcp_destroy_f finalize) {
+	struct arcp_alloc_weak_header *header;
+	struct arcp_region *region;
+	header = amalloc(sizeof(struct arcp_alloc_weak_header) + size);
+	if (header == NULL) {
+		return NULL;
+	}
+	header->size = sizeof(struct arcp_alloc_weak_header) + size;
+	header->finalize = finalize;
+	ak_init(&header->parts, 2);
+	region = (struct arcp_region *) (header + 1);
+	/* initialize the weakref as arcp_region_init_weakref would */
+	ak_init(&header->stub.target, region);
+	ak_init(&header->stub.refcount, __ARCP_REFCOUNT_INIT(1, 0));
+	header->stub.destroy = __arcp_alloc_weak_destroy_stub;
+	ak_init(&header->stub.weakref, NULL);
+	header->stub.shards = NULL;
+	arcp_region_init(region, __arcp_alloc_weak_destroy);
+	ak_init(&region->weakref, (struct arcp_region *) &header->stub);
+	return region;
+}
+
 void arcp_region_destroy_weakref(struct arcp_region *region) {
 	arcp_store(&region->weakref, NULL);
 }
 
-struct arcp_region *__arcp_acquire(struct arcp_region *region) {
-	if (region != NULL) {
-		__arcp_urefs(region, 0, 1);
-	}
-	return region;
+void __arcp_acquire_slow(struct arcp_region *region) {
+	__arcp_urefs(region, 0, 1);
 }
 
 struct arcp_weakref *arcp_weakref(struct arcp_region *region) {
 	return (struct arcp_weakref *) arcp_load(&region->weakref);
 }
 
-void arcp_release(struct arcp_region *region) {
-	if (region != NULL) {
-		if (__arcp_urefs(region, 0, -1)) {
-			__arcp_try_destroy(region);
+void __arcp_release_slow(struct arcp_region *region) {
+	if (__arcp_urefs(region, 0, -1)) {
+		__arcp_try_destroy(region);
+	}
+}
+
+/* The count reached zero without the destroy lock being taken. Take it now.
+ * Nothing else can change a count of zero without the lock: nobody holds a
+ * reference, and __arcp_urefs_region makes a weak reference which would
+ * revive the region wait for this. */
+static bool __arcp_lock_zero(struct arcp_region *region) {
+	arcp_refcount_t count, o_count;
+	o_count.p = 0;
+	count.p = 0;
+	count.v.destroy_lock = 1;
+	return ak_cas_strong(&region->refcount, &o_count.p, count.p,
+			     mo_acq_rel, mo_relaxed);
+}
+
+void __arcp_release_last(struct arcp_region *region) {
+	if (__arcp_lock_zero(region)) {
+		__arcp_try_destroy(region);
+	}
+}
+
+/* Number of distinct regions with pending count updates in a bulk update */
+#define __ARCP_BULK_SLOTS 16
+/* Largest update which is accumulated for a single region before it is
+ * applied; this fits in any usecount */
+#define __ARCP_BULK_MAX 0x4000
+/* Distance ahead of the current element at which refcounts are prefetched */
+#define __ARCP_BULK_AHEAD 8
+/* Number of released regions collected before they are destroyed */
+#define __ARCP_BULK_DEAD 32
+
+/* State of an `arcp_acquire_n` or `arcp_release_n` */
+struct arcp_bulk {
+	struct arcp_region *region[__ARCP_BULK_SLOTS];
+	int count[__ARCP_BULK_SLOTS];
+	size_t ndead;
+	struct arcp_region *dead[__ARCP_BULK_DEAD];
+};
+
+static inline size_t __arcp_bulk_hash(struct arcp_region *region) {
+	uintptr_t p;
+	p = (uintptr_t) region;
+	return ((p >> 4) ^ (p >> 10)) % __ARCP_BULK_SLOTS;
+}
+
+/* Destroy the regions collected by the bulk update. */
+static void __arcp_bulk_destroy(struct arcp_bulk *bulk) {
+	size_t i;
+	for (i = 0; i < bulk->ndead; i++) {
+		__arcp_try_destroy(bulk->dead[i]);
+	}
+	bulk->ndead = 0;
+}
+
+/* Apply an accumulated update of `count` references to `region`. */
+static void __arcp_bulk_apply(struct arcp_bulk *bulk,
+			      struct arcp_region *region, int count,
+			      bool release) {
+	arcp_refcount_t o_count;
+	if (!release) {
+		if (likely(region->shards == NULL)) {
+			ak_ldadd(&region->refcount,
+				 __ARCP_USECOUNT_ONE * count, mo_relaxed);
+		} else {
+			__arcp_urefs(region, 0, count);
 		}
+		return;
+	}
+	if (likely(region->shards == NULL
+		   && __ARCP_PTRDECOUNT(ak_load(&region->weakref, mo_relaxed))
+		   == NULL)) {
+		o_count.p = ak_ldsub(&region->refcount,
+				     __ARCP_USECOUNT_ONE * count, mo_acq_rel);
+		if (o_count.p != __ARCP_USECOUNT_ONE * count
+		   || !__arcp_lock_zero(region)) {
+			return;
+		}
+	} else if (!__arcp_urefs(region, 0, -count)) {
+		/* as in arcp_release, a region which a weak reference could
+		 * revive goes straight to a locked zero */
+		return;
+	}
+	/* we hold the destroy lock; destroy it with the others */
+	if (bulk->ndead == __ARCP_BULK_DEAD) {
+		__arcp_bulk_destroy(bulk);
 	}
+	bulk->dead[bulk->ndead++] = region;
+}
+
+static void __arcp_bulk_update(struct arcp_region **regions, size_t n,
+			       bool release) {
+	struct arcp_bulk bulk;
+	struct arcp_region *region;
+	size_t i, h;
+	for (h = 0; h < __ARCP_BULK_SLOTS; h++) {
+		bulk.region[h] = NULL;
+	}
+	bulk.ndead = 0;
+	for (i = 0; i < n; i++) {
+		if (i + __ARCP_BULK_AHEAD < n) {
+			region = regions[i + __ARCP_BULK_AHEAD];
+			if (region != NULL) {
+				__builtin_prefetch(&region->refcount, 1);
+			}
+		}
+		region = regions[i];
+		if (region == NULL) {
+			continue;
+		}
+		/* accumulate repeated regions and apply the update for
+		 * whatever region is displaced */
+		h = __arcp_bulk_hash(region);
+		if (bulk.region[h] != region) {
+			if (bulk.region[h] != NULL) {
+				__arcp_bulk_apply(&bulk, bulk.region[h],
+						  bulk.count[h], release);
+			}
+			bulk.region[h] = region;
+			bulk.count[h] = 0;
+		}
+		if (++bulk.count[h] == __ARCP_BULK_MAX) {
+			__arcp_bulk_apply(&bulk, region, bulk.count[h],
+					  release);
+			bulk.region[h] = NULL;
+		}
+	}
+	/* apply whatever remains */
+	for (h = 0; h < __ARCP_BULK_SLOTS; h++) {
+		if (bulk.region[h] != NULL) {
+			__arcp_bulk_apply(&bulk, bulk.region[h],
+					  bulk.count[h], release);
+		}
+	}
+	__arcp_bulk_destroy(&bulk);
+}
+
+void arcp_acquire_n(struct arcp_region **regions, size_t n) {
+	__arcp_bulk_update(regions, n, false);
+}
+
+void arcp_release_n(struct arcp_region **regions, size_t n) {
+	__arcp_bulk_update(regions, n, true);
 }
 
 struct arcp_region *arcp_weakref_load(struct arcp_weakref *weakref) {
@@ -249,6 +863,7 @@ struct arcp_region *arcp_weakref_load(struct arcp_weakref *weakref) {
 		case __ARCP_WEAKMAX:
 			/* spinlock if too many threads are accessing this at
 			 * once. */
+			__ARCP_STAT(&weakref->target, ARCP_STAT_TAG_SPIN);
 			cpu_yield();
 			ptr = ak_load(&weakref->target, mo_consume);
 			goto retry;
@@ -300,7 +915,10 @@ void arcp_init(arcp_t *rcp, struct arcp_region *region) {
 	ak_store(rcp, region, mo_release);
 }
 
-struct arcp_region *arcp_load(arcp_t *rcp) {
+/* Load the contents of a pointer with a reference, without looking through
+ * a transaction descriptor.  If the result is marked with __ARCP_TXNBIT, the
+ * reference is to the descriptor. */
+static struct arcp_region *__arcp_load_raw(arcp_t *rcp) {
 	/* YURI
 	 * We saw a sample of your manhood on the way. A place called Mink.
 	 *
@@ -322,9 +940,10 @@ struct arcp_region *arcp_load(arcp_t *rcp) {
 
 	ptr = ak_load(rcp, mo_acquire);
 	do {
-		while (unlikely(__ARCP_PTR2COUNT(ptr) == __ARCP_COUNTMASK)) {
+		while (unlikely(__ARCP_PTR2COUNT(ptr) == __ARCP_COUNTMAX)) {
 			/* Spinlock if too many threads are accessing this
 			 * at once. */
+			__ARCP_STAT(rcp, ARCP_STAT_TAG_SPIN);
 			cpu_yield();
 			ptr = ak_load(rcp, mo_consume);
 		}
@@ -334,27 +953,82 @@ struct arcp_region *arcp_load(arcp_t *rcp) {
 	/* We have one reference */
 	ret = __ARCP_PTRDECOUNT(ptr);
 	if (ret != NULL) {
-		__arcp_urefs(ret, 0, 1);
+		__arcp_urefs(__ARCP_PTRDETXN(ret), 0, 1);
 	}
 	/* We have two references, try and remove the one stored on the
-	 * pointer. */
-	while (unlikely(!ak_cas(rcp, &ptr, __ARCP_PTRDEC(ptr),
-				mo_acq_rel, mo_acquire))) {
-		/* Is the pointer still valid? */
-		if ((__ARCP_PTRDECOUNT(ptr) != ret)
-		    /* The second test will prevent a/b/a errors */
-		    || (__ARCP_PTR2COUNT(ptr) == 0)) {
-			/* Somebody else has transferred / will transfer the
-			 * count. */
-			if (ret != NULL) {
-				__arcp_urefs(ret, 0, -1);
-			}
-			break;
+	 * pointer.  This fails if the pointer has changed, or if its count
+	 * has gone to zero, which prevents a/b/a errors. */
+	if (unlikely(!aptr_lddec(rcp, &ptr, __ARCP_COUNTSHIFT,
+				 __ARCP_COUNTMAX, mo_acq_rel))) {
+		/* Somebody else has transferred / will transfer the
+		 * count. */
+		if (ret != NULL) {
+			__arcp_urefs(__ARCP_PTRDETXN(ret), 0, -1);
 		}
 	}
 	return ret;
 }
 
+/* Trade a reference to a transaction descriptor for a reference to the value
+ * it gives the pointer. */
+static struct arcp_region *__arcp_resolve_txn(arcp_t *rcp,
+					      struct arcp_region *txn) {
+	struct arcp_region *ret;
+	txn = __ARCP_PTRDETXN(txn);
+	ret = arcp_acquire(__atxn_value(txn, rcp));
+	arcp_release(txn);
+	return ret;
+}
+
+struct arcp_region *arcp_load(arcp_t *rcp) {
+	struct arcp_region *ret;
+	ret = __arcp_load_raw(rcp);
+	if (unlikely(__ARCP_PTR2TXN(ret))) {
+		ret = __arcp_resolve_txn(rcp, ret);
+	}
+	return ret;
+}
+
+struct arcp_region *__arcp_load_phantom_txn(arcp_t *rcp) {
+	struct arcp_region *ret;
+	/* the descriptor holds a reference to the value, but may go away as
+	 * soon as we release it; the caller has promised that something else
+	 * keeps the value alive */
+	ret = arcp_load(rcp);
+	arcp_release(ret);
+	return ret;
+}
+
+void __arcp_refs(struct arcp_region *region, int storedelta, int usedelta) {
+	if (__arcp_urefs(region, storedelta, usedelta)) {
+		__arcp_try_destroy(region);
+	}
+}
+
+void __arcp_settle(arcp_t *rcp) {
+	struct arcp_region *region;
+	region = __arcp_load_raw(rcp);
+	if (__ARCP_PTR2TXN(region)) {
+		region = __ARCP_PTRDETXN(region);
+		__atxn_abort_wait(region, rcp);
+	}
+	arcp_release(region);
+}
+
+/* Load the contents of a pointer, first settling any transaction which has
+ * installed its descriptor there.  A compare and swap must not replace a
+ * descriptor directly, or the transaction could succeed without it seeing
+ * so; arcp_store and arcp_swap instead abort what they replace. */
+static struct arcp_region *__arcp_load_settled(arcp_t *rcp) {
+	struct arcp_region *ptr;
+	ptr = ak_load(rcp, mo_acquire);
+	while (unlikely(__ARCP_PTR2TXN(ptr))) {
+		__arcp_settle(rcp);
+		ptr = ak_load(rcp, mo_acquire);
+	}
+	return ptr;
+}
+
 void arcp_store(arcp_t *rcp, struct arcp_region *region) {
 	struct arcp_region *ptr;
 	struct arcp_region *oldregion;
@@ -363,6 +1037,13 @@ void arcp_store(arcp_t *rcp, struct arcp_region *region) {
 		__arcp_urefs(region, 1, 0);
 	}
 	ptr = ak_swap(rcp, region, mo_seq_cst);
+	if (unlikely(__ARCP_PTR2TXN(ptr))) {
+		/* we took out a transaction descriptor */
+		arcp_release(__atxn_displace(
+			__ARCP_PTRDETXN(__ARCP_PTRDECOUNT(ptr)), rcp,
+			__ARCP_PTR2COUNT(ptr)));
+		return;
+	}
 	oldregion = __ARCP_PTRDECOUNT(ptr);
 	if (oldregion != NULL) {
 		if (__arcp_urefs(oldregion, -1, __ARCP_PTR2COUNT(ptr))) {
@@ -371,6 +1052,234 @@ void arcp_store(arcp_t *rcp, struct arcp_region *region) {
 	}
 }
 
+/* Count this thread among the borrowers while it has a slot in use; the
+ * shared count is only touched when the first slot is taken and the last
+ * is given back.  Taking must come before the slot is published. */
+static inline void __arcp_hazards_take(struct arcp_hazards *hazards) {
+	if (hazards->nactive++ == 0) {
+		ak_ldadd(&__arcp_borrowers, 1, mo_seq_cst);
+	}
+}
+
+/* Undo __arcp_hazards_take, after the slot has been cleared. */
+static inline void __arcp_hazards_give(struct arcp_hazards *hazards) {
+	if (--hazards->nactive == 0) {
+		ak_ldsub(&__arcp_borrowers, 1, mo_release);
+	}
+}
+
+/* Give back a thread's borrow slots when it exits. */
+static void __arcp_hazards_exit(void *arg) {
+	struct arcp_hazards *hazards = arg;
+	int i;
+
+	for (i = 0; i < ARCP_NBORROWS; i++) {
+		ak_store(&hazards->slot[i], NULL, mo_release);
+	}
+	if (hazards->nactive != 0) {
+		hazards->nactive = 0;
+		ak_ldsub(&__arcp_borrowers, 1, mo_release);
+	}
+	ak_store(&hazards->in_use, false, mo_release);
+	if (ak_load(&__arcp_retired_list, mo_relaxed) != NULL) {
+		__arcp_reclaim();
+	}
+}
+
+static void __arcp_hazards_key_init(void) {
+	pthread_key_create(&__arcp_hazards_key, __arcp_hazards_exit);
+}
+
+/* Get this thread's borrow slots, claiming some if needed. Returns NULL if
+ * no slots could be had. */
+static struct arcp_hazards *__arcp_hazards_get(void) {
+	struct arcp_hazards *hazards;
+	bool in_use;
+	int i;
+
+	hazards = __arcp_my_hazards;
+	if (likely(hazards != NULL)) {
+		return hazards;
+	}
+	pthread_once(&__arcp_hazards_once, __arcp_hazards_key_init);
+	/* try to reuse the slots of a thread which has exited */
+	for (hazards = ak_load(&__arcp_hazards_list, mo_acquire);
+	     hazards != NULL;
+	     hazards = hazards->next) {
+		in_use = false;
+		if (!ak_load(&hazards->in_use, mo_relaxed)
+		    && ak_cas_strong(&hazards->in_use, &in_use, true,
+				     mo_acq_rel, mo_relaxed)) {
+			goto claimed;
+		}
+	}
+	/* allocate new slots */
+	hazards = amalloc(sizeof(struct arcp_hazards));
+	if (hazards == NULL) {
+		return NULL;
+	}
+	for (i = 0; i < ARCP_NBORROWS; i++) {
+		ak_init(&hazards->slot[i], NULL);
+	}
+	ak_init(&hazards->in_use, true);
+	hazards->nactive = 0;
+	hazards->next = ak_load(&__arcp_hazards_list, mo_relaxed);
+	while (unlikely(!ak_cas(&__arcp_hazards_list, &hazards->next, hazards,
+				mo_acq_rel, mo_relaxed))) {
+		/* retry */
+	}
+claimed:
+	pthread_setspecific(__arcp_hazards_key, hazards);
+	__arcp_my_hazards = hazards;
+	return hazards;
+}
+
+struct arcp_region *arcp_borrow(arcp_t *rcp) {
+	struct arcp_hazards *hazards;
+	struct arcp_region *region;
+	struct arcp_region *check;
+	int i;
+
+	hazards = __arcp_hazards_get();
+	if (likely(hazards != NULL)) {
+		for (i = 0; i < ARCP_NBORROWS; i++) {
+			if (ak_load(&hazards->slot[i], mo_relaxed) != NULL) {
+				continue;
+			}
+			__arcp_hazards_take(hazards);
+			region = __ARCP_PTRDECOUNT(ak_load(rcp, mo_seq_cst));
+			while (region != NULL) {
+				if (unlikely(__ARCP_PTR2TXN(region))) {
+					/* a descriptor can't be borrowed */
+					ak_store(&hazards->slot[i], NULL,
+						 mo_release);
+					__arcp_hazards_give(hazards);
+					return arcp_load(rcp);
+				}
+				/* publish the borrow, then make sure the
+				 * region was still stored after it became
+				 * visible */
+				ak_store(&hazards->slot[i], region,
+					 mo_seq_cst);
+				check = __ARCP_PTRDECOUNT(ak_load(rcp,
+								  mo_seq_cst));
+				if (likely(check == region)) {
+					return region;
+				}
+				region = check;
+			}
+			ak_store(&hazards->slot[i], NULL, mo_release);
+			__arcp_hazards_give(hazards);
+			return NULL;
+		}
+	}
+	/* out of slots; take an ordinary reference */
+	return arcp_load(rcp);
+}
+
+void arcp_unborrow(struct arcp_region *region) {
+	struct arcp_hazards *hazards;
+	int i;
+
+	if (region == NULL) {
+		return;
+	}
+	hazards = __arcp_my_hazards;
+	if (likely(hazards != NULL)) {
+		for (i = 0; i < ARCP_NBORROWS; i++) {
+			if (ak_load(&hazards->slot[i], mo_relaxed) == region) {
+				ak_store(&hazards->slot[i], NULL, mo_release);
+				__arcp_hazards_give(hazards);
+				if (unlikely(ak_load(&__arcp_retired_list,
+						     mo_relaxed) != NULL)) {
+					__arcp_reclaim();
+				}
+				return;
+			}
+		}
+	}
+	/* this was an ordinary reference */
+	arcp_release(region);
+}
+
+/* Loads a versioned pointer at a version with no store in progress, and
+ * returns that version. */
+static uintptr_t __arcp_load_stable(arcp_versioned_t *vrcp,
+				    struct arcp_region **region) {
+	uintptr_t version;
+	version = ak_load(&vrcp->version, mo_seq_cst);
+	while (unlikely(__ARCP_VERSION_WRITERS(version) != 0)) {
+		cpu_yield();
+		version = ak_load(&vrcp->version, mo_seq_cst);
+	}
+	*region = arcp_load(&vrcp->rcp);
+	return version;
+}
+
+void arcp_versioned_init(arcp_versioned_t *vrcp, struct arcp_region *region) {
+	arcp_init(&vrcp->rcp, region);
+	ak_init(&vrcp->version, 1);
+}
+
+void arcp_versioned_store(arcp_versioned_t *vrcp,
+			  struct arcp_region *region) {
+	/* count the store in progress before making it, so that a snapshot
+	 * which might load the new region sees the version disturbed */
+	ak_ldadd(&vrcp->version, __ARCP_VERSION_WRITER, mo_seq_cst);
+	arcp_store(&vrcp->rcp, region);
+	/* finish it only once the region is visible, so that a reader which
+	 * sees the new version also sees the new region; versions stay odd
+	 * so that they never match an empty cache */
+	ak_ldadd(&vrcp->version, __ARCP_VERSION_STORED - __ARCP_VERSION_WRITER,
+		 mo_release);
+}
+
+void arcp_load_snapshot(arcp_versioned_t **vrcps, size_t n,
+			struct arcp_region **regions, uintptr_t *versions) {
+	size_t i;
+	for (i = 0; i < n; i++) {
+		versions[i] = __arcp_load_stable(vrcps[i], &regions[i]);
+	}
+	/* Each region was loaded while no store to its pointer was in
+	 * progress, and a store which starts later changes the version for
+	 * good.  If the check finds every version unchanged, each pointer
+	 * held its region from its load to its check, and every load came
+	 * before every check. */
+	ak_fence(mo_seq_cst);
+	i = 0;
+	while (i < n) {
+		if (likely(ak_load(&vrcps[i]->version, mo_relaxed)
+			   == versions[i])) {
+			i++;
+			continue;
+		}
+		arcp_release(regions[i]);
+		versions[i] = __arcp_load_stable(vrcps[i], &regions[i]);
+		ak_fence(mo_seq_cst);
+		i = 0;
+	}
+}
+
+struct arcp_region *__arcp_cache_refresh(arcp_versioned_t *vrcp,
+					 struct arcp_cache *cache) {
+	struct arcp_region *region;
+	uintptr_t version;
+	/* read the version first: the region loaded after it is at least
+	 * that new, and any later store will advance the version again */
+	version = ak_load(&vrcp->version, mo_acquire);
+	region = arcp_load(&vrcp->rcp);
+	arcp_release(cache->region);
+	cache->region = region;
+	cache->version = version;
+	return region;
+}
+
+void arcp_cache_release(struct arcp_cache *cache) {
+	arcp_release(cache->region);
+	cache->region = NULL;
+	cache->version = 0;
+}
+
 struct arcp_region *arcp_swap(arcp_t *rcp, struct arcp_region *region) {
 	struct arcp_region *ptr;
 	struct arcp_region *oldregion;
@@ -379,6 +1288,11 @@ struct arcp_region *arcp_swap(arcp_t *rcp, struct arcp_region *region) {
 		__arcp_urefs(region, 1, 0);
 	}
 	ptr = ak_swap(rcp, region, mo_acq_rel);
+	if (unlikely(__ARCP_PTR2TXN(ptr))) {
+		/* we took out a transaction descriptor */
+		return __atxn_displace(__ARCP_PTRDETXN(__ARCP_PTRDECOUNT(ptr)),
+				       rcp, __ARCP_PTR2COUNT(ptr));
+	}
 	oldregion = __ARCP_PTRDECOUNT(ptr);
 	if (oldregion != NULL) {
 		__arcp_urefs(oldregion, -1, __ARCP_PTR2COUNT(ptr) + 1);
@@ -393,17 +1307,21 @@ bool arcp_cas(arcp_t *rcp, struct arcp_region *oldregion,
 	if (newregion != NULL) {
 		__arcp_urefs(newregion, 1, 0);
 	}
-	ptr = ak_load(rcp, mo_acquire);
+	ptr = __arcp_load_settled(rcp);
 	do {
+		if (unlikely(__ARCP_PTR2TXN(ptr))) {
+			ptr = __arcp_load_settled(rcp);
+		}
 		if (__ARCP_PTRDECOUNT(ptr) != oldregion) {
 			/* fail */
+			__ARCP_STAT(rcp, ARCP_STAT_CAS_FAIL);
 			if (newregion != NULL) {
 				__arcp_urefs(newregion, -1, 0);
 			}
 			return false;
 		}
 	} while (unlikely(!ak_cas(rcp, &ptr, newregion,
-				  mo_acq_rel, mo_acquire)));
+				  mo_seq_cst, mo_acquire)));
 	/* success! */
 	if (oldregion != NULL) {
 		/* Transfer count */
@@ -421,10 +1339,14 @@ bool arcp_cas_release(arcp_t *rcp, struct arcp_region *oldregion,
 	if (newregion != NULL) {
 		__arcp_urefs(newregion, 1, -1);
 	}
-	ptr = ak_load(rcp, mo_acquire);
+	ptr = __arcp_load_settled(rcp);
 	do {
+		if (unlikely(__ARCP_PTR2TXN(ptr))) {
+			ptr = __arcp_load_settled(rcp);
+		}
 		if (__ARCP_PTRDECOUNT(ptr) != oldregion) {
 			/* fail */
+			__ARCP_STAT(rcp, ARCP_STAT_CAS_FAIL);
 			if (newregion != NULL) {
 				if (__arcp_urefs(newregion, -1, 0)) {
 					__arcp_try_destroy(newregion);
@@ -444,3 +1366,221 @@ bool arcp_cas_release(arcp_t *rcp, struct arcp_region *oldregion,
 	}
 	return true;
 }
+
+#if ARCP_INSTRUMENT
+static unsigned long __arcp_stat_total(struct arcp_stat *stat) {
+	unsigned long total;
+	int k;
+	total = 0;
+	for (k = 0; k < ARCP_STAT_NKINDS; k++) {
+		total += stat->count[k];
+	}
+	return total;
+}
+#endif
+
+void arcp_stats_sample(unsigned int rate) {
+#if ARCP_INSTRUMENT
+	ak_store(&__arcp_stats_rate, rate == 0 ? 1 : rate, mo_relaxed);
+#else
+	(void) rate;
+#endif
+}
+
+size_t arcp_stats_top(struct arcp_stat *stats, size_t n) {
+#if ARCP_INSTRUMENT
+	struct arcp_stat stat;
+	unsigned long total;
+	size_t nstats, i, j;
+	int k;
+	nstats = 0;
+	for (i = 0; i < __ARCP_STATS_SIZE; i++) {
+		stat.addr = (const void *) ak_load(&__arcp_stats[i].addr,
+						   mo_relaxed);
+		if (stat.addr == NULL) {
+			continue;
+		}
+		for (k = 0; k < ARCP_STAT_NKINDS; k++) {
+			stat.count[k] = ak_load(&__arcp_stats[i].count[k],
+						mo_relaxed);
+		}
+		total = __arcp_stat_total(&stat);
+		if (total == 0) {
+			continue;
+		}
+		/* insert into the sorted top n, dropping whatever falls off
+		 * the end */
+		for (j = nstats;
+		     j > 0 && __arcp_stat_total(&stats[j - 1]) < total; j--) {
+			if (j < n) {
+				stats[j] = stats[j - 1];
+			}
+		}
+		if (j < n) {
+			stats[j] = stat;
+			if (nstats < n) {
+				nstats++;
+			}
+		}
+	}
+	return nstats;
+#else
+	(void) stats;
+	(void) n;
+	return 0;
+#endif
+}
+
+void arcp_stats_reset(void) {
+#if ARCP_INSTRUMENT
+	size_t i;
+	int k;
+	for (i = 0; i < __ARCP_STATS_SIZE; i++) {
+		for (k = 0; k < ARCP_STAT_NKINDS; k++) {
+			ak_store(&__arcp_stats[i].count[k], 0, mo_relaxed);
+		}
+		ak_store(&__arcp_stats[i].addr, 0, mo_relaxed);
+	}
+#endif
+}
+
+/* Wait for a while, waiting longer each time. */
+static void __arcp_backoff(unsigned int *delay) {
+	unsigned int i;
+	for (i = 0; i < *delay; i++) {
+		cpu_yield();
+	}
+	if (*delay < __ARCP_BACKOFF_MAX) {
+		*delay *= 2;
+	}
+}
+
+/* Apply a group of transformations for one pointer in order, storing only
+ * the final result, and mark them done. */
+static void __arcp_combine_group(arcp_t *rcp, struct arcp_update_req *group) {
+	struct arcp_region *oldregion, *region, *newregion;
+	struct arcp_update_req *req, *next;
+	unsigned int delay;
+	delay = 1;
+	for (;;) {
+		oldregion = arcp_load(rcp);
+		region = arcp_acquire(oldregion);
+		for (req = group; req != NULL; req = req->next) {
+			req->result = req->fn(region, &newregion, req->arg);
+			if (req->result == 0) {
+				arcp_release(region);
+				region = newregion;
+			}
+		}
+		if (region == oldregion) {
+			arcp_release(region);
+			arcp_release(oldregion);
+			break;
+		}
+		if (arcp_cas_release(rcp, oldregion, region)) {
+			break;
+		}
+		/* a writer which isn't combining got in first */
+		__ARCP_STAT(rcp, ARCP_STAT_UPDATE_RETRY);
+		__arcp_backoff(&delay);
+	}
+	for (req = group; req != NULL; req = next) {
+		next = req->next;
+		ak_store(&req->done, true, mo_release);
+	}
+}
+
+/* Apply everything queued on a combiner, holding its lock. */
+static void __arcp_combine(struct arcp_combiner *combiner) {
+	struct arcp_update_req *reqs, *req, *next, *group;
+	struct arcp_update_req **link, **tail;
+	arcp_t *rcp;
+	reqs = ak_swap(&combiner->pending, NULL, mo_acquire);
+	/* put the requests in the order they arrived */
+	next = NULL;
+	while (reqs != NULL) {
+		req = reqs;
+		reqs = req->next;
+		req->next = next;
+		next = req;
+	}
+	reqs = next;
+	while (reqs != NULL) {
+		/* split off the requests for the same pointer as the
+		 * first */
+		rcp = reqs->rcp;
+		group = NULL;
+		tail = &group;
+		link = &reqs;
+		while (*link != NULL) {
+			req = *link;
+			if (req->rcp == rcp) {
+				*link = req->next;
+				req->next = NULL;
+				*tail = req;
+				tail = &req->next;
+			} else {
+				link = &req->next;
+			}
+		}
+		__arcp_combine_group(rcp, group);
+	}
+}
+
+/* Queue a transformation and wait until some writer has applied it. */
+static int __arcp_update_combining(arcp_t *rcp, arcp_update_f fn,
+				   void *arg) {
+	struct arcp_update_req req;
+	struct arcp_combiner *combiner;
+	bool unlocked;
+	req.rcp = rcp;
+	req.fn = fn;
+	req.arg = arg;
+	ak_init(&req.done, false);
+	combiner = &__arcp_combiners[((uintptr_t) rcp / sizeof(arcp_t))
+				     % __ARCP_NCOMBINERS];
+	req.next = ak_load(&combiner->pending, mo_relaxed);
+	while (unlikely(!ak_cas(&combiner->pending, &req.next, &req,
+				mo_release, mo_relaxed))) {
+		/* retry */
+	}
+	while (!ak_load(&req.done, mo_acquire)) {
+		unlocked = false;
+		if (ak_cas_strong(&combiner->lock, &unlocked, true,
+				  mo_acquire, mo_relaxed)) {
+			/* become the combiner */
+			__arcp_combine(combiner);
+			ak_store(&combiner->lock, false, mo_release);
+		} else {
+			cpu_yield();
+		}
+	}
+	return req.result;
+}
+
+int arcp_update(arcp_t *rcp, arcp_update_f fn, void *arg) {
+	struct arcp_region *oldregion, *newregion;
+	unsigned int delay;
+	int tries;
+	int r;
+	delay = 1;
+	for (tries = 0; tries < ARCP_UPDATE_TRIES; tries++) {
+		oldregion = arcp_load(rcp);
+		r = fn(oldregion, &newregion, arg);
+		if (r != 0) {
+			arcp_release(oldregion);
+			return r;
+		}
+		if (newregion == oldregion) {
+			arcp_release(newregion);
+			arcp_release(oldregion);
+			return 0;
+		}
+		if (arcp_cas_release(rcp, oldregion, newregion)) {
+			return 0;
+		}
+		__ARCP_STAT(rcp, ARCP_STAT_UPDATE_RETRY);
+		__arcp_backoff(&delay);
+	}
+	return __arcp_update_combining(rcp, fn, arg);
+}
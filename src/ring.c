@@ -0,0 +1,119 @@
+/*
+ * ring.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "atomickit/atomic.h"
+#include "atomickit/malloc.h"
+#include "atomickit/rcp.h"
+#include "atomickit/ring.h"
+
+int aring_init(aring_t *ring, size_t size) {
+	size_t nslots;
+	size_t i;
+	/* round up to a power of two, so that positions wrap cleanly */
+	for (nslots = 2; nslots < size; nslots <<= 1) {
+		if (nslots > SIZE_MAX / 2 / sizeof(struct aring_slot)) {
+			return -1;
+		}
+	}
+	ring->slots = amalloc(sizeof(struct aring_slot) * nslots);
+	if (ring->slots == NULL) {
+		return -1;
+	}
+	for (i = 0; i < nslots; i++) {
+		ak_init(&ring->slots[i].seq, i);
+		ring->slots[i].item = NULL;
+	}
+	ring->mask = nslots - 1;
+	ak_init(&ring->enq, 0);
+	ak_init(&ring->deq, 0);
+	return 0;
+}
+
+bool aring_try_enq(aring_t *ring, struct arcp_region *item) {
+	struct aring_slot *slot;
+	size_t pos;
+	size_t seq;
+	intptr_t dif;
+	pos = ak_load(&ring->enq, mo_relaxed);
+	for (;;) {
+		slot = &ring->slots[pos & ring->mask];
+		seq = ak_load(&slot->seq, mo_acquire);
+		dif = (intptr_t) seq - (intptr_t) pos;
+		if (likely(dif == 0)) {
+			/* the slot is empty; claim it */
+			if (likely(ak_cas(&ring->enq, &pos, pos + 1,
+					  mo_relaxed, mo_relaxed))) {
+				break;
+			}
+		} else if (dif < 0) {
+			/* the slot still holds the item from one lap ago */
+			return false;
+		} else {
+			/* another producer claimed this position */
+			pos = ak_load(&ring->enq, mo_relaxed);
+		}
+	}
+	slot->item = arcp_acquire(item);
+	/* publish the item to the consumer of this position */
+	ak_store(&slot->seq, pos + 1, mo_release);
+	return true;
+}
+
+struct arcp_region *aring_try_deq(aring_t *ring) {
+	struct aring_slot *slot;
+	struct arcp_region *item;
+	size_t pos;
+	size_t seq;
+	intptr_t dif;
+	pos = ak_load(&ring->deq, mo_relaxed);
+	for (;;) {
+		slot = &ring->slots[pos & ring->mask];
+		seq = ak_load(&slot->seq, mo_acquire);
+		dif = (intptr_t) seq - (intptr_t) (pos + 1);
+		if (likely(dif == 0)) {
+			/* the slot is full; claim it */
+			if (likely(ak_cas(&ring->deq, &pos, pos + 1,
+					  mo_relaxed, mo_relaxed))) {
+				break;
+			}
+		} else if (dif < 0) {
+			/* nothing has been enqueued here yet */
+			return NULL;
+		} else {
+			/* another consumer claimed this position */
+			pos = ak_load(&ring->deq, mo_relaxed);
+		}
+	}
+	item = slot->item;
+	slot->item = NULL;
+	/* hand the slot to the producer one lap ahead */
+	ak_store(&slot->seq, pos + ring->mask + 1, mo_release);
+	return item;
+}
+
+void aring_destroy(aring_t *ring) {
+	struct arcp_region *item;
+	while ((item = aring_try_deq(ring)) != NULL) {
+		arcp_release(item);
+	}
+	afree(ring->slots, sizeof(struct aring_slot) * (ring->mask + 1));
+}
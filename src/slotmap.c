@@ -0,0 +1,263 @@
+/*
+ * slotmap.c
+ *
+ * Copyright 2014 Evan Buswell
+ * 
+ * This file is part of Atomic Kit.
+ * 
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ * 
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "atomickit/atomic.h"
+#include "atomickit/rcp.h"
+#include "atomickit/malloc.h"
+#include "atomickit/slotmap.h"
+
+#define ASLOT_INDEX(handle) ((uint32_t) (handle))
+#define ASLOT_GEN(handle) ((uint32_t) ((handle) >> 32))
+#define ASLOT_HANDLE(index, gen) ((((aslot_t) (gen)) << 32) | (index))
+
+/* The number of slots in all the segments together */
+#define ASLOTMAP_MAXSLOTS						\
+	((uint32_t) (((UINT64_C(1) << ASLOTMAP_NSEGMENTS) - 1)		\
+		     * ASLOTMAP_SEGMENT0))
+
+/* The number of slots in a segment */
+#define ASLOTMAP_SEGSIZE(seg) (((size_t) ASLOTMAP_SEGMENT0) << (seg))
+
+/* Builds a free list head from the old head's tag and a new index plus
+ * one. */
+#define ASLOTMAP_FREEHEAD(o_head, next)					\
+	(((((o_head) >> 32) + 1) << 32) | (next))
+
+/* Finds the segment containing a slot index and the offset of the slot
+ * within it. */
+static inline int aslotmap_segment(uint32_t index, size_t *offset) {
+	uint64_t n;
+	int seg;
+	n = (uint64_t) index + ASLOTMAP_SEGMENT0;
+	seg = (63 - __builtin_clzll(n)) - __builtin_ctz(ASLOTMAP_SEGMENT0);
+	*offset = (size_t) (n - ((uint64_t) ASLOTMAP_SEGMENT0 << seg));
+	return seg;
+}
+
+/* Gets the slot for an index, or NULL if there is no such slot. */
+static struct aslot *aslotmap_slot(aslotmap_t *map, uint32_t index) {
+	struct aslot *segment;
+	size_t offset;
+	int seg;
+	seg = aslotmap_segment(index, &offset);
+	if (seg >= ASLOTMAP_NSEGMENTS) {
+		return NULL;
+	}
+	segment = ak_load(&map->segment[seg], mo_acquire);
+	if (segment == NULL) {
+		return NULL;
+	}
+	return &segment[offset];
+}
+
+/* Makes sure the given segment exists, returning it, or NULL on allocation
+ * failure. */
+static struct aslot *aslotmap_grow(aslotmap_t *map, int seg) {
+	struct aslot *segment;
+	struct aslot *nosegment;
+	size_t i;
+	segment = ak_load(&map->segment[seg], mo_acquire);
+	if (segment != NULL) {
+		return segment;
+	}
+	segment = amalloc(sizeof(struct aslot) * ASLOTMAP_SEGSIZE(seg));
+	if (segment == NULL) {
+		return NULL;
+	}
+	for (i = 0; i < ASLOTMAP_SEGSIZE(seg); i++) {
+		ak_init(&segment[i].gen, 0);
+		ak_init(&segment[i].next, 0);
+		arcp_init(&segment[i].region, NULL);
+	}
+	nosegment = NULL;
+	if (!ak_cas_strong(&map->segment[seg], &nosegment, segment,
+			   mo_acq_rel, mo_acquire)) {
+		/* someone else grew it first */
+		afree(segment, sizeof(struct aslot) * ASLOTMAP_SEGSIZE(seg));
+		segment = nosegment;
+	}
+	return segment;
+}
+
+/* Takes a slot from the free list. */
+static struct aslot *aslotmap_pop(aslotmap_t *map, uint32_t *index) {
+	uint_least64_t head;
+	uint_least64_t newhead;
+	uint32_t top;
+	struct aslot *slot;
+	head = ak_load(&map->free, mo_acquire);
+	do {
+		top = (uint32_t) head;
+		if (top == 0) {
+			return NULL;
+		}
+		/* slots are never freed, so this is safe even if the slot
+		 * has been taken in the meantime; the tag will then have
+		 * changed */
+		slot = aslotmap_slot(map, top - 1);
+		newhead = ASLOTMAP_FREEHEAD(head, ak_load(&slot->next,
+							  mo_relaxed));
+	} while (unlikely(!ak_cas(&map->free, &head, newhead,
+				  mo_acq_rel, mo_acquire)));
+	*index = top - 1;
+	return slot;
+}
+
+/* Returns a slot to the free list. */
+static void aslotmap_push(aslotmap_t *map, struct aslot *slot,
+			  uint32_t index) {
+	uint_least64_t head;
+	head = ak_load(&map->free, mo_relaxed);
+	do {
+		ak_store(&slot->next, (uint32_t) head, mo_relaxed);
+	} while (unlikely(!ak_cas(&map->free, &head,
+				  ASLOTMAP_FREEHEAD(head, index + 1),
+				  mo_acq_rel, mo_relaxed)));
+}
+
+/* Takes a slot which has never been used. */
+static struct aslot *aslotmap_fresh(aslotmap_t *map, uint32_t *index) {
+	uint_least32_t top;
+	struct aslot *segment;
+	size_t offset;
+	int seg;
+	top = ak_load(&map->top, mo_relaxed);
+	do {
+		if (top >= ASLOTMAP_MAXSLOTS) {
+			return NULL;
+		}
+		/* make sure the slot exists before claiming its index: an
+		 * index without a slot can't be put on the free list, so
+		 * claiming first would lose it if the allocation failed */
+		seg = aslotmap_segment(top, &offset);
+		segment = aslotmap_grow(map, seg);
+		if (segment == NULL) {
+			return NULL;
+		}
+	} while (unlikely(!ak_cas(&map->top, &top, top + 1,
+				  mo_relaxed, mo_relaxed)));
+	*index = top;
+	return &segment[offset];
+}
+
+int aslotmap_init(aslotmap_t *map) {
+	int i;
+	for (i = 0; i < ASLOTMAP_NSEGMENTS; i++) {
+		ak_init(&map->segment[i], NULL);
+	}
+	ak_init(&map->top, 0);
+	ak_init(&map->free, 0);
+	/* allocate the first segment up front */
+	if (aslotmap_grow(map, 0) == NULL) {
+		return -1;
+	}
+	return 0;
+}
+
+void aslotmap_destroy(aslotmap_t *map) {
+	struct aslot *segment;
+	size_t i;
+	int seg;
+	for (seg = 0; seg < ASLOTMAP_NSEGMENTS; seg++) {
+		segment = ak_load(&map->segment[seg], mo_acquire);
+		if (segment == NULL) {
+			continue;
+		}
+		for (i = 0; i < ASLOTMAP_SEGSIZE(seg); i++) {
+			arcp_store(&segment[i].region, NULL);
+		}
+		afree(segment, sizeof(struct aslot) * ASLOTMAP_SEGSIZE(seg));
+		ak_store(&map->segment[seg], NULL, mo_relaxed);
+	}
+}
+
+aslot_t aslotmap_insert(aslotmap_t *map, struct arcp_region *region) {
+	struct aslot *slot;
+	uint32_t index;
+	uint32_t gen;
+	slot = aslotmap_pop(map, &index);
+	if (slot == NULL) {
+		slot = aslotmap_fresh(map, &index);
+		if (slot == NULL) {
+			return ASLOT_NULL;
+		}
+	}
+	/* the slot is ours alone until its generation becomes odd */
+	arcp_store(&slot->region, region);
+	gen = ak_load(&slot->gen, mo_relaxed) + 1;
+	ak_store(&slot->gen, gen, mo_release);
+	return ASLOT_HANDLE(index, gen);
+}
+
+bool aslotmap_remove(aslotmap_t *map, aslot_t handle) {
+	struct aslot *slot;
+	uint_least32_t gen;
+	gen = ASLOT_GEN(handle);
+	if ((gen & 1) == 0) {
+		return false;
+	}
+	slot = aslotmap_slot(map, ASLOT_INDEX(handle));
+	if (slot == NULL) {
+		return false;
+	}
+	/* only one remover can advance the generation */
+	if (!ak_cas_strong(&slot->gen, &gen, gen + 1,
+			   mo_acq_rel, mo_relaxed)) {
+		return false;
+	}
+	arcp_store(&slot->region, NULL);
+	aslotmap_push(map, slot, ASLOT_INDEX(handle));
+	return true;
+}
+
+bool aslotmap_valid(aslotmap_t *map, aslot_t handle) {
+	struct aslot *slot;
+	uint32_t gen;
+	gen = ASLOT_GEN(handle);
+	if ((gen & 1) == 0) {
+		return false;
+	}
+	slot = aslotmap_slot(map, ASLOT_INDEX(handle));
+	return slot != NULL && ak_load(&slot->gen, mo_acquire) == gen;
+}
+
+struct arcp_region *aslotmap_get(aslotmap_t *map, aslot_t handle) {
+	struct aslot *slot;
+	struct arcp_region *region;
+	uint32_t gen;
+	gen = ASLOT_GEN(handle);
+	if ((gen & 1) == 0) {
+		return NULL;
+	}
+	slot = aslotmap_slot(map, ASLOT_INDEX(handle));
+	if (slot == NULL || ak_load(&slot->gen, mo_acquire) != gen) {
+		return NULL;
+	}
+	region = arcp_load(&slot->region);
+	/* if the generation is unchanged, the item was not removed before
+	 * we loaded it */
+	if (unlikely(ak_load(&slot->gen, mo_acquire) != gen)) {
+		arcp_release(region);
+		return NULL;
+	}
+	return region;
+}
@@ -0,0 +1,153 @@
+/*
+ * spsc.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "atomickit/atomic.h"
+#include "atomickit/malloc.h"
+#include "atomickit/rcp.h"
+#include "atomickit/spsc.h"
+
+int aspsc_init(aspsc_t *spsc, size_t size, size_t elsize) {
+	size_t nels;
+	if (elsize == 0) {
+		return -1;
+	}
+	/* round up to a power of two, so that positions wrap cleanly */
+	for (nels = 1; nels < size; nels <<= 1) {
+		if (nels > SIZE_MAX / 2 / elsize) {
+			return -1;
+		}
+	}
+	spsc->buf = amalloc(nels * elsize);
+	if (spsc->buf == NULL) {
+		return -1;
+	}
+	spsc->mask = nels - 1;
+	spsc->elsize = elsize;
+	ak_init(&spsc->head, 0);
+	ak_init(&spsc->tail, 0);
+	spsc->tail_cache = 0;
+	spsc->head_cache = 0;
+	return 0;
+}
+
+void aspsc_destroy(aspsc_t *spsc) {
+	afree(spsc->buf, (spsc->mask + 1) * spsc->elsize);
+}
+
+/* The number of elements, up to n, that the producer may push; leaves the
+ * tail in *tailp. */
+static inline size_t aspsc_room(aspsc_t *spsc, size_t n, size_t *tailp) {
+	size_t tail;
+	size_t room;
+	tail = ak_load(&spsc->tail, mo_relaxed);
+	room = spsc->head_cache + spsc->mask + 1 - tail;
+	if (room < n) {
+		/* only look at the consumer's cache line when the cached
+		 * position says there isn't enough room */
+		spsc->head_cache = ak_load(&spsc->head, mo_acquire);
+		room = spsc->head_cache + spsc->mask + 1 - tail;
+	}
+	*tailp = tail;
+	return room < n ? room : n;
+}
+
+/* The number of elements, up to n, that the consumer may pop; leaves the
+ * head in *headp. */
+static inline size_t aspsc_ready(aspsc_t *spsc, size_t n, size_t *headp) {
+	size_t head;
+	size_t ready;
+	head = ak_load(&spsc->head, mo_relaxed);
+	ready = spsc->tail_cache - head;
+	if (ready < n) {
+		spsc->tail_cache = ak_load(&spsc->tail, mo_acquire);
+		ready = spsc->tail_cache - head;
+	}
+	*headp = head;
+	return ready < n ? ready : n;
+}
+
+/* Copy n elements into the ring at pos, which may wrap. */
+static inline void aspsc_copyin(aspsc_t *spsc, size_t pos, const char *els,
+				size_t n) {
+	size_t i;
+	size_t first;
+	i = pos & spsc->mask;
+	first = spsc->mask + 1 - i;
+	if (first > n) {
+		first = n;
+	}
+	memcpy(spsc->buf + i * spsc->elsize, els, first * spsc->elsize);
+	memcpy(spsc->buf, els + first * spsc->elsize,
+	       (n - first) * spsc->elsize);
+}
+
+/* Copy n elements out of the ring from pos, which may wrap. */
+static inline void aspsc_copyout(aspsc_t *spsc, size_t pos, char *els,
+				 size_t n) {
+	size_t i;
+	size_t first;
+	i = pos & spsc->mask;
+	first = spsc->mask + 1 - i;
+	if (first > n) {
+		first = n;
+	}
+	memcpy(els, spsc->buf + i * spsc->elsize, first * spsc->elsize);
+	memcpy(els + first * spsc->elsize, spsc->buf,
+	       (n - first) * spsc->elsize);
+}
+
+size_t aspsc_push_n(aspsc_t *spsc, const void *els, size_t n) {
+	size_t tail;
+	n = aspsc_room(spsc, n, &tail);
+	if (n == 0) {
+		return 0;
+	}
+	aspsc_copyin(spsc, tail, els, n);
+	ak_store(&spsc->tail, tail + n, mo_release);
+	return n;
+}
+
+size_t aspsc_pop_n(aspsc_t *spsc, void *els, size_t n) {
+	size_t head;
+	n = aspsc_ready(spsc, n, &head);
+	if (n == 0) {
+		return 0;
+	}
+	aspsc_copyout(spsc, head, els, n);
+	ak_store(&spsc->head, head + n, mo_release);
+	return n;
+}
+
+size_t aspsc_push_region_n(aspsc_t *spsc, struct arcp_region **regions,
+			   size_t n) {
+	size_t tail;
+	n = aspsc_room(spsc, n, &tail);
+	if (n == 0) {
+		return 0;
+	}
+	/* the references must be taken before the consumer can see the
+	 * regions */
+	arcp_acquire_n(regions, n);
+	aspsc_copyin(spsc, tail, (const char *) regions, n);
+	ak_store(&spsc->tail, tail + n, mo_release);
+	return n;
+}
@@ -22,7 +22,7 @@
 #define _GNU_SOURCE
 #include <string.h>
 #undef _GNU_SOURCE
-#include "atomickit/malloc.h"
+#include "atomickit/rcp.h"
 #include "atomickit/string.h"
 
 struct astrstr {
@@ -37,33 +37,29 @@ void astr_init(struct astr *str, size_t len, char *data,
 	str->data = data;
 }
 
-static void __astr_destroystr(struct astr *str) {
-	afree(str, sizeof(struct astrstr) + str->len + 1);
-}
-
-static void __astr_destroy(struct astr *str) {
-	afree(str, sizeof(struct astr));
-}
-
 struct astr *astr_create(size_t len, char *data) {
 	struct astr *str;
-	str = amalloc(sizeof(struct astr));
+	str = arcp_alloc(sizeof(struct astr), NULL);
 	if (str == NULL) {
 		return NULL;
 	}
 
-	astr_init(str, len, data, __astr_destroy);
+	str->len = len;
+	str->data = data;
 	return str;
 }
 
 struct astr *astr_alloc(size_t len) {
 	struct astrstr *str;
-	str = amalloc(sizeof(struct astrstr) + len + 1);
+	/* the allocated size is recorded, so it doesn't matter that the
+	 * string's length may later change */
+	str = arcp_alloc(sizeof(struct astrstr) + len + 1, NULL);
 	if (str == NULL) {
 		return NULL;
 	}
 
-	astr_init(str, 0, str->data_start, __astr_destroystr);
+	str->len = 0;
+	str->data = str->data_start;
 	return str;
 }
 
@@ -0,0 +1,354 @@
+/*
+ * txn.c
+ *
+ * Copyright 2014 Evan Buswell
+ * 
+ * This file is part of Atomic Kit.
+ * 
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ * 
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include "atomickit/atomic.h"
+#include "atomickit/malloc.h"
+#include "atomickit/rcp.h"
+#include "atomickit/txn.h"
+
+/* The number of entries a transaction holds without allocating */
+#define ATXN_NINLINE 4
+
+/* States of a transaction */
+enum {
+	ATXN_UNDECIDED = 0,
+	ATXN_SUCCEEDED,
+	ATXN_FAILED
+};
+
+/* One pointer taking part in a transaction.  The transaction holds a
+ * reference to both regions. */
+struct atxn_entry {
+	arcp_t *rcp;
+	struct arcp_region *expected;
+	struct arcp_region *desired;
+};
+
+/* The transaction is its own descriptor.  Entries are sorted by address, and
+ * are not changed once the transaction is committed. */
+struct atxn {
+	struct arcp_region;
+	atomic_int status;
+	bool broken;			/* will fail whatever happens */
+	size_t n;
+	size_t cap;
+	struct atxn_entry *entries;
+	struct atxn_entry inline_entries[ATXN_NINLINE];
+};
+
+static void atxn_finalize(struct atxn *txn) {
+	size_t i;
+	for (i = 0; i < txn->n; i++) {
+		arcp_release(txn->entries[i].expected);
+		arcp_release(txn->entries[i].desired);
+	}
+	if (txn->entries != txn->inline_entries) {
+		afree(txn->entries, sizeof(struct atxn_entry) * txn->cap);
+	}
+}
+
+/* Finds the entry for rcp, or where it would go. */
+static size_t atxn_search(struct atxn *txn, arcp_t *rcp) {
+	size_t lo, hi, mid;
+	lo = 0;
+	hi = txn->n;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((uintptr_t) txn->entries[mid].rcp < (uintptr_t) rcp) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static struct atxn_entry *atxn_find(struct atxn *txn, arcp_t *rcp) {
+	size_t i;
+	i = atxn_search(txn, rcp);
+	if (i < txn->n && txn->entries[i].rcp == rcp) {
+		return &txn->entries[i];
+	}
+	return NULL;
+}
+
+/* Adds an entry for a pointer not yet in the transaction, or returns NULL if
+ * it could not be added. */
+static struct atxn_entry *atxn_add(struct atxn *txn, arcp_t *rcp,
+				   struct arcp_region *expected,
+				   struct arcp_region *desired) {
+	struct atxn_entry *entries;
+	struct atxn_entry *entry;
+	size_t cap;
+	size_t i;
+	if (txn->n == txn->cap) {
+		cap = txn->cap * 2;
+		if (txn->entries == txn->inline_entries) {
+			entries = amalloc(sizeof(struct atxn_entry) * cap);
+			if (entries != NULL) {
+				memcpy(entries, txn->entries,
+				       sizeof(struct atxn_entry) * txn->n);
+			}
+		} else {
+			entries = arealloc(txn->entries,
+					   sizeof(struct atxn_entry) * txn->cap,
+					   sizeof(struct atxn_entry) * cap);
+		}
+		if (entries == NULL) {
+			txn->broken = true;
+			return NULL;
+		}
+		txn->entries = entries;
+		txn->cap = cap;
+	}
+	i = atxn_search(txn, rcp);
+	memmove(&txn->entries[i + 1], &txn->entries[i],
+		sizeof(struct atxn_entry) * (txn->n - i));
+	txn->n++;
+	entry = &txn->entries[i];
+	entry->rcp = rcp;
+	entry->expected = arcp_acquire(expected);
+	entry->desired = arcp_acquire(desired);
+	return entry;
+}
+
+struct atxn *atxn_begin(void) {
+	struct atxn *txn;
+	if (!ATXN_AVAILABLE) {
+		/* there is no bit to mark a descriptor with */
+		errno = ENOSYS;
+		return NULL;
+	}
+	txn = arcp_alloc(sizeof(struct atxn),
+			 (arcp_destroy_f) atxn_finalize);
+	if (txn == NULL) {
+		return NULL;
+	}
+	ak_init(&txn->status, ATXN_UNDECIDED);
+	txn->broken = false;
+	txn->n = 0;
+	txn->cap = ATXN_NINLINE;
+	txn->entries = txn->inline_entries;
+	return txn;
+}
+
+struct arcp_region *atxn_load(struct atxn *txn, arcp_t *rcp) {
+	struct atxn_entry *entry;
+	struct arcp_region *region;
+	entry = atxn_find(txn, rcp);
+	if (entry != NULL) {
+		return arcp_acquire(entry->desired);
+	}
+	region = arcp_load(rcp);
+	atxn_add(txn, rcp, region, region);
+	return region;
+}
+
+void atxn_store(struct atxn *txn, arcp_t *rcp, struct arcp_region *region) {
+	struct atxn_entry *entry;
+	struct arcp_region *oldregion;
+	entry = atxn_find(txn, rcp);
+	if (entry == NULL) {
+		oldregion = arcp_load(rcp);
+		entry = atxn_add(txn, rcp, oldregion, oldregion);
+		arcp_release(oldregion);
+		if (entry == NULL) {
+			return;
+		}
+	}
+	arcp_release(entry->desired);
+	entry->desired = arcp_acquire(region);
+}
+
+void atxn_cas(struct atxn *txn, arcp_t *rcp, struct arcp_region *oldregion,
+	      struct arcp_region *newregion) {
+	struct atxn_entry *entry;
+	entry = atxn_find(txn, rcp);
+	if (entry == NULL) {
+		atxn_add(txn, rcp, oldregion, newregion);
+		return;
+	}
+	if (entry->desired != oldregion) {
+		txn->broken = true;
+		return;
+	}
+	arcp_release(entry->desired);
+	entry->desired = arcp_acquire(newregion);
+}
+
+/* Replaces the descriptor in an entry's pointer with the value the decided
+ * transaction gives it.  Either the owner or a writer which found the
+ * descriptor in its way may do this; whoever gets there first wins. */
+static void atxn_uninstall(struct atxn *txn, struct atxn_entry *entry) {
+	struct arcp_region *ptr;
+	struct arcp_region *value;
+	bool succeeded;
+	succeeded = ak_load(&txn->status, mo_acquire) == ATXN_SUCCEEDED;
+	/* while installed, the descriptor keeps the expected value's store
+	 * reference for the pointer */
+	value = succeeded ? entry->desired : entry->expected;
+	if (succeeded && value != NULL) {
+		__arcp_refs(value, 1, 0);
+	}
+	ptr = ak_load(entry->rcp, mo_acquire);
+	do {
+		if (__ARCP_PTRDECOUNT(ptr) != __ARCP_PTRSETTXN(txn)) {
+			/* already done */
+			if (succeeded && value != NULL) {
+				/* can't reach 0, as the transaction holds a
+				 * reference */
+				__arcp_refs(value, -1, 0);
+			}
+			return;
+		}
+	} while (unlikely(!ak_cas(entry->rcp, &ptr, value,
+				  mo_acq_rel, mo_acquire)));
+	if (succeeded && entry->expected != NULL) {
+		__arcp_refs(entry->expected, -1, 0);
+	}
+	/* transfer the count of loads in progress; the caller holds a
+	 * reference, so this won't destroy the transaction */
+	__arcp_refs(txn, -1, __ARCP_PTR2COUNT(ptr));
+}
+
+/* Installs the descriptor in an entry's pointer.  Returns false if the
+ * pointer did not hold the expected value or the transaction was aborted. */
+static bool atxn_install(struct atxn *txn, struct atxn_entry *entry) {
+	struct arcp_region *ptr;
+	struct arcp_region *region;
+	/* the store reference held by the pointer */
+	__arcp_refs(txn, 1, 0);
+	ptr = ak_load(entry->rcp, mo_acquire);
+	do {
+		while (unlikely(__ARCP_PTR2TXN(ptr))) {
+			__arcp_settle(entry->rcp);
+			ptr = ak_load(entry->rcp, mo_acquire);
+		}
+		if (__ARCP_PTRDECOUNT(ptr) != entry->expected
+		    || ak_load(&txn->status, mo_acquire) != ATXN_UNDECIDED) {
+			__arcp_refs(txn, -1, 0);
+			return false;
+		}
+	} while (unlikely(!ak_cas(entry->rcp, &ptr, __ARCP_PTRSETTXN(txn),
+				  mo_acq_rel, mo_acquire)));
+	/* the expected value keeps its store reference, now on behalf of the
+	 * descriptor, and takes over the count of loads in progress */
+	region = __ARCP_PTRDECOUNT(ptr);
+	if (region != NULL && __ARCP_PTR2COUNT(ptr) != 0) {
+		__arcp_refs(region, 0, __ARCP_PTR2COUNT(ptr));
+	}
+	return true;
+}
+
+bool atxn_commit(struct atxn *txn) {
+	int status;
+	size_t i, j;
+	if (txn->broken) {
+		ak_store(&txn->status, ATXN_FAILED, mo_relaxed);
+		arcp_release(txn);
+		return false;
+	}
+	for (i = 0; i < txn->n; i++) {
+		if (!atxn_install(txn, &txn->entries[i])) {
+			break;
+		}
+	}
+	/* decide; if this fails, a writer has already aborted us */
+	status = ATXN_UNDECIDED;
+	if (ak_cas_strong(&txn->status, &status,
+			  i == txn->n ? ATXN_SUCCEEDED : ATXN_FAILED,
+			  mo_acq_rel, mo_acquire)) {
+		status = i == txn->n ? ATXN_SUCCEEDED : ATXN_FAILED;
+	}
+	/* take down the descriptors we installed */
+	for (j = 0; j < i; j++) {
+		atxn_uninstall(txn, &txn->entries[j]);
+	}
+	arcp_release(txn);
+	return status == ATXN_SUCCEEDED;
+}
+
+void atxn_abort(struct atxn *txn) {
+	ak_store(&txn->status, ATXN_FAILED, mo_relaxed);
+	arcp_release(txn);
+}
+
+struct arcp_region *__atxn_value(struct arcp_region *region, arcp_t *rcp) {
+	struct atxn *txn;
+	struct atxn_entry *entry;
+	txn = (struct atxn *) region;
+	entry = atxn_find(txn, rcp);
+	if (ak_load(&txn->status, mo_acquire) == ATXN_SUCCEEDED) {
+		return entry->desired;
+	}
+	return entry->expected;
+}
+
+struct arcp_region *__atxn_displace(struct arcp_region *region, arcp_t *rcp,
+				   uintptr_t count) {
+	struct atxn *txn;
+	struct atxn_entry *entry;
+	struct arcp_region *value;
+	int status;
+	txn = (struct atxn *) region;
+	entry = atxn_find(txn, rcp);
+	/* the transaction can no longer have rcp; if it already decided,
+	 * the store which displaced it comes after */
+	status = ATXN_UNDECIDED;
+	if (ak_cas_strong(&txn->status, &status, ATXN_FAILED,
+			  mo_seq_cst, mo_acquire)) {
+		status = ATXN_FAILED;
+	}
+	value = arcp_acquire(status == ATXN_SUCCEEDED
+			     ? entry->desired : entry->expected);
+	/* give back the store reference the descriptor kept for the expected
+	 * value; the transaction still holds a reference, so this won't
+	 * destroy it */
+	if (entry->expected != NULL) {
+		__arcp_refs(entry->expected, -1, 0);
+	}
+	/* and the pointer's own reference to the descriptor, transferring the
+	 * count of loads in progress */
+	__arcp_refs(txn, -1, (int) count);
+	return value;
+}
+
+void __atxn_abort_wait(struct arcp_region *region, arcp_t *rcp) {
+	struct atxn *txn;
+	int status;
+	int i;
+	txn = (struct atxn *) region;
+	for (i = 0; i < ATXN_PATIENCE; i++) {
+		if (ak_load(&txn->status, mo_acquire) != ATXN_UNDECIDED) {
+			break;
+		}
+		cpu_yield();
+	}
+	/* rather than finish the installs of an owner which may have
+	 * stalled, give up on its transaction */
+	status = ATXN_UNDECIDED;
+	ak_cas_strong(&txn->status, &status, ATXN_FAILED,
+		      mo_acq_rel, mo_acquire);
+	atxn_uninstall(txn, atxn_find(txn, rcp));
+}
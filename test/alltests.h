@@ -7,7 +7,18 @@ int run_float_h_test_suite(void);
 int run_pointer_h_test_suite(void);
 int run_rcp_h_test_suite(void);
 int run_queue_h_test_suite(void);
+int run_iqueue_h_test_suite(void);
+int run_faaq_h_test_suite(void);
+int run_multiqueue_h_test_suite(void);
+int run_ring_h_test_suite(void);
+int run_spsc_h_test_suite(void);
+int run_deque_h_test_suite(void);
+int run_exec_h_test_suite(void);
+int run_pq_h_test_suite(void);
 int run_malloc_h_test_suite(void);
 int run_array_h_test_suite(void);
+int run_slotmap_h_test_suite(void);
+int run_txn_h_test_suite(void);
+int run_atomickit_hpp_test_suite(void);
 
 #endif
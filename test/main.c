@@ -38,6 +38,11 @@ main(int argc __attribute__((unused)),
 		fprintf(stderr, "Failed to run tests");
 		exit(EXIT_FAILURE);
 	}
+	r = run_pointer_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
 	r = run_rcp_h_test_suite();
 	if (r != 0) {
 		fprintf(stderr, "Failed to run tests");
@@ -48,6 +53,46 @@ main(int argc __attribute__((unused)),
 		fprintf(stderr, "Failed to run tests");
 		exit(EXIT_FAILURE);
 	}
+	r = run_iqueue_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
+	r = run_faaq_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
+	r = run_multiqueue_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
+	r = run_ring_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
+	r = run_spsc_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
+	r = run_deque_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
+	r = run_exec_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
+	r = run_pq_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
 	r = run_malloc_h_test_suite();
 	if (r != 0) {
 		fprintf(stderr, "Failed to run tests");
@@ -58,6 +103,21 @@ main(int argc __attribute__((unused)),
 		fprintf(stderr, "Failed to run tests");
 		exit(EXIT_FAILURE);
 	}
+	r = run_slotmap_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
+	r = run_txn_h_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
+	r = run_atomickit_hpp_test_suite();
+	if (r != 0) {
+		fprintf(stderr, "Failed to run tests");
+		exit(EXIT_FAILURE);
+	}
 	r = print_test_results();
 	if (r != 0) {
 		fprintf(stderr, "Failed to print test results");
@@ -671,6 +671,34 @@ static void test_aary_set_contains() {
 	ASSERT(!aary_set_contains(array, region3));
 }
 
+static void test_aary_rcp_load() {
+	struct arcp_test_region *rg;
+	arcp_t rcp;
+	CHECKPOINT();
+	arcp_init(&rcp, array);
+	arcp_release(array);
+	CHECKPOINT();
+	rg = (struct arcp_test_region *) aary_rcp_load(&rcp, 1);
+	ASSERT(rg == region2);
+	ASSERT(strcmp(rg->data, ptrtest.string2) == 0);
+	CHECKPOINT();
+	ASSERT(aary_rcp_load(&rcp, 2) == NULL);
+	CHECKPOINT();
+	aary_sortx((struct aary *) arcp_load_phantom(&rcp));
+	ASSERT(aary_rcp_set_contains(&rcp, region1));
+	ASSERT(!aary_rcp_set_contains(&rcp, region3));
+	CHECKPOINT();
+	arcp_release(region2);
+	arcp_store(&rcp, NULL);
+	ASSERT(!region2_destroyed);
+	CHECKPOINT();
+	arcp_release(rg);
+	ASSERT(region2_destroyed);
+	CHECKPOINT();
+	ASSERT(aary_rcp_load(&rcp, 0) == NULL);
+	ASSERT(!aary_rcp_set_contains(&rcp, region1));
+}
+
 /*************************/
 static void test_aary_populate_full_fixture(void (*test)()) {
 	region1_destroyed = false;
@@ -1126,7 +1154,8 @@ int run_array_h_test_suite() {
 					    test_aary_dup_set_add2,
 					    test_aary_set_remove1,
 					    test_aary_dup_set_remove1,
-					    test_aary_set_contains, NULL };
+					    test_aary_set_contains,
+					    test_aary_rcp_load, NULL };
 	char *populate_part_test_names[] = { "aary_load", "aary_last",
 					     "aary_first",
 					     "aary_load_phantom",
@@ -1142,7 +1171,8 @@ int run_array_h_test_suite() {
 					     "aary_dup_set_add2",
 					     "aary_set_remove1",
 					     "aary_dup_set_remove1",
-					     "aary_set_contains", NULL };
+					     "aary_set_contains",
+					     "aary_rcp_load", NULL };
 
 	void (*populate_full_tests[])() = { test_aary_remove, test_aary_pop,
 					    test_aary_shift,
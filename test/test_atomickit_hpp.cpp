@@ -0,0 +1,269 @@
+/*
+ * test_atomickit_hpp.cpp
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <atomickit/atomickit.hpp>
+extern "C" {
+#include "alltests.h"
+#include "test.h"
+}
+
+/* the test functions take file names and explanations as char * */
+#pragma GCC diagnostic ignored "-Wwrite-strings"
+
+using namespace atomickit;
+
+static int ndestroyed;
+
+struct counter : arcp_region {
+	long value;
+	explicit counter(long value) : value(value) {}
+	~counter() {
+		ndestroyed++;
+	}
+};
+
+struct refuser : arcp_region {
+	explicit refuser(int) {
+		throw 42;
+	}
+	~refuser() {
+		ndestroyed++;
+	}
+};
+
+static void test_layout() {
+	ref<aary> array;
+	CHECKPOINT();
+	/* the C library and the C++ compiler agree where the fields are */
+	array = ref<aary>::adopt(aary_create(3));
+	ASSERT(array);
+	ASSERT(aary_len(array.get()) == 3);
+	ASSERT(array->len == 3);
+	ASSERT(static_cast<arcp_region *>(array.get())
+	       == reinterpret_cast<arcp_region *>(array.get()));
+}
+
+static void test_ref() {
+	CHECKPOINT();
+	ndestroyed = 0;
+	{
+		ref<counter> a = make_ref<counter>(42);
+		ASSERT(a->value == 42);
+		ASSERT(arcp_usecount(a.get()) == 1);
+		CHECKPOINT();
+		ref<counter> b = a;
+		ASSERT(b == a);
+		ASSERT(arcp_usecount(a.get()) == 2);
+		ref<counter> c = std::move(b);
+		ASSERT(!b);
+		ASSERT(arcp_usecount(a.get()) == 2);
+		CHECKPOINT();
+		ref<> d = std::move(c);
+		ASSERT(!c);
+		ASSERT(d == a);
+		ASSERT(arcp_usecount(a.get()) == 2);
+		d = a;
+		ASSERT(arcp_usecount(a.get()) == 2);
+		d = d;
+		ASSERT(arcp_usecount(a.get()) == 2);
+		d.reset();
+		ASSERT(arcp_usecount(a.get()) == 1);
+		ASSERT(ndestroyed == 0);
+		CHECKPOINT();
+		/* a constructor which throws leaves nothing behind */
+		try {
+			make_ref<refuser>(1);
+			ASSERT(false);
+		} catch (int e) {
+			ASSERT(e == 42);
+		}
+		ASSERT(ndestroyed == 0);
+	}
+	ASSERT(ndestroyed == 1);
+}
+
+static void test_rcp() {
+	CHECKPOINT();
+	ndestroyed = 0;
+	{
+		ref<counter> a = make_ref<counter>(1);
+		ref<counter> b = make_ref<counter>(2);
+		rcp<counter> p(a);
+		ASSERT(arcp_storecount(a.get()) == 1);
+		ASSERT(p.load_phantom() == a.get());
+		ASSERT(p.load()->value == 1);
+		ASSERT(arcp_usecount(a.get()) == 1);
+		CHECKPOINT();
+		ASSERT(!p.cas(b.get(), b));
+		ASSERT(p.cas(a.get(), b));
+		ASSERT(p.swap(a) == b);
+		ASSERT(arcp_usecount(b.get()) == 1);
+		ASSERT(arcp_storecount(b.get()) == 0);
+		{
+			borrowed<counter> borrow = p.borrow();
+			ASSERT(borrow->value == 1);
+		}
+		CHECKPOINT();
+		rcp<counter> q(b);
+		{
+			versioned_rcp<counter> vp(a);
+			versioned_rcp<counter> vq(b);
+			auto both = load_snapshot(vp, vq);
+			ASSERT(std::get<0>(both) == a);
+			ASSERT(std::get<1>(both) == b);
+			vq.store(a);
+			ASSERT(vq.load_phantom() == a.get());
+		}
+		CHECKPOINT();
+		rcp<counter> r(std::move(p));
+		ASSERT(p.load_phantom() == nullptr);
+		ASSERT(r.load_phantom() == a.get());
+		ASSERT(arcp_storecount(a.get()) == 1);
+		p = std::move(q);
+		ASSERT(p.load_phantom() == b.get());
+		ASSERT(arcp_storecount(b.get()) == 1);
+		ASSERT(ndestroyed == 0);
+	}
+	ASSERT(ndestroyed == 2);
+}
+
+static void test_queue() {
+	CHECKPOINT();
+	ndestroyed = 0;
+	{
+		queue<counter> q1;
+		ref<counter> item;
+		int i;
+		for (i = 0; i < 10; i++) {
+			q1.enq(make_ref<counter>(i));
+		}
+		ASSERT(ndestroyed == 0);
+		ASSERT(q1.peek()->value == 0);
+		ASSERT(q1.deq()->value == 0);
+		ASSERT(ndestroyed == 1);
+		CHECKPOINT();
+		queue<counter> q2(std::move(q1));
+		item = q2.peek();
+		ASSERT(item->value == 1);
+		ASSERT(q2.cmpdeq(item.get()));
+		item.reset();
+		ASSERT(ndestroyed == 2);
+		for (i = 2; i < 5; i++) {
+			ASSERT(q2.deq()->value == i);
+		}
+		ASSERT(ndestroyed == 5);
+	}
+	ASSERT(ndestroyed == 10);
+}
+
+static void test_array() {
+	CHECKPOINT();
+	ndestroyed = 0;
+	{
+		array<counter> building;
+		rcp<aary> p;
+		long sum;
+		int i;
+		for (i = 0; i < 10; i++) {
+			building.append(make_ref<counter>(i));
+		}
+		building.shift();
+		building.pop();
+		ASSERT(building.size() == 8);
+		ASSERT(ndestroyed == 2);
+		p.store(std::move(building).share());
+		CHECKPOINT();
+		array_snapshot<counter> snapshot(p);
+		ASSERT(snapshot.size() == 8);
+		sum = 0;
+		for (counter *c : snapshot) {
+			/* only the array holds a reference */
+			ASSERT(arcp_usecount(c) == 1);
+			sum += c->value;
+		}
+		ASSERT(sum == 1 + 2 + 3 + 4 + 5 + 6 + 7 + 8);
+		ASSERT(snapshot[0]->value == 1);
+		ASSERT(snapshot.at(7)->value == 8);
+		CHECKPOINT();
+		array<counter> copy(snapshot);
+		copy.store(0, make_ref<counter>(100));
+		ASSERT(ndestroyed == 2);
+		ASSERT(copy[0]->value == 100);
+		ASSERT(snapshot[0]->value == 1);
+		p.store(std::move(copy).share());
+		ASSERT(ndestroyed == 2);
+	}
+	ASSERT(ndestroyed == 11);
+}
+
+static void test_dict() {
+	CHECKPOINT();
+	ndestroyed = 0;
+	{
+		dict<counter> building;
+		rcp<adict> p;
+		int n;
+		building.put("one", make_ref<counter>(1));
+		building.put("two", make_ref<counter>(2));
+		building.put("three", make_ref<counter>(3));
+		building.put("two", make_ref<counter>(22));
+		ASSERT(ndestroyed == 1);
+		ASSERT(building.del("one"));
+		ASSERT(!building.del("one"));
+		ASSERT(ndestroyed == 2);
+		p.store(std::move(building).share());
+		CHECKPOINT();
+		dict_snapshot<counter> snapshot(p);
+		ASSERT(snapshot.size() == 2);
+		ASSERT(snapshot.has("two"));
+		ASSERT(!snapshot.get("one"));
+		ASSERT(snapshot.get("two")->value == 22);
+		n = 0;
+		for (auto entry : snapshot) {
+			ASSERT(arcp_usecount(entry.value) == 1);
+			if (entry.key->len == 5
+			    && memcmp(entry.key->data, "three", 5) == 0) {
+				ASSERT(entry.value->value == 3);
+			} else {
+				ASSERT(entry.value->value == 22);
+			}
+			n++;
+		}
+		ASSERT(n == 2);
+	}
+	ASSERT(ndestroyed == 4);
+}
+
+int run_atomickit_hpp_test_suite() {
+	int r;
+	void (*hpp_tests[])() = { test_layout, test_ref, test_rcp,
+				  test_queue, test_array, test_dict, NULL };
+	const char *hpp_test_names[] = { "hpp_layout", "hpp_ref", "hpp_rcp",
+					 "hpp_queue", "hpp_array", "hpp_dict",
+					 NULL };
+
+	r = run_test_suite(NULL, const_cast<char **>(hpp_test_names),
+			   hpp_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * test_deque_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include <alloca.h>
+#include <atomickit/rcp.h>
+#include <atomickit/deque.h>
+#include "alltests.h"
+#include "test.h"
+
+static struct {
+	char string1[14];
+	char string2[14];
+} ptrtest = { "Test String 1", "Test String 2" };
+
+static bool region1_destroyed;
+static bool region2_destroyed;
+
+static void destroy_region1(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region1_destroyed = true;
+}
+
+static void destroy_region2(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region2_destroyed = true;
+}
+
+struct arcp_test_region {
+	struct arcp_region;
+	char data[];
+};
+
+static struct arcp_test_region *region1;
+static struct arcp_test_region *region2;
+
+static adeque_t deque;
+
+#define NTHREADS 8
+#define NITEMS 4000
+#define DEQUE_SIZE 4
+
+struct adeque_test_item {
+	struct arcp_region;
+	atomic_bool taken;
+};
+
+static struct adeque_test_item items[NITEMS];
+
+/****************************/
+static void test_adeque_init() {
+	int r;
+	CHECKPOINT();
+	r = adeque_init(&deque, 5);
+	ASSERT(r == 0);
+	ASSERT(adeque_size(&deque) == 0);
+	ASSERT(adeque_pop(&deque) == NULL);
+	ASSERT(adeque_steal(&deque) == NULL);
+	CHECKPOINT();
+	adeque_destroy(&deque);
+}
+
+/****************************/
+
+static void test_adeque_init_fixture(void (*test)()) {
+	int r;
+	CHECKPOINT();
+	region1_destroyed = false;
+	region2_destroyed = false;
+	region1 = alloca(sizeof(struct arcp_test_region) + 14);
+	region2 = alloca(sizeof(struct arcp_test_region) + 14);
+	strcpy(region1->data, ptrtest.string1);
+	strcpy(region2->data, ptrtest.string2);
+	arcp_region_init(region1, destroy_region1);
+	arcp_region_init(region2, destroy_region2);
+	CHECKPOINT();
+	r = adeque_init(&deque, DEQUE_SIZE);
+	if (r != 0) {
+		UNRESOLVED("adeque_init failed");
+	}
+	test();
+}
+
+static void test_adeque_push() {
+	CHECKPOINT();
+	ASSERT(adeque_push(&deque, region1) == 0);
+	ASSERT(adeque_push(&deque, region2) == 0);
+	ASSERT(adeque_size(&deque) == 2);
+	ASSERT(arcp_usecount(region1) == 2);
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	CHECKPOINT();
+	/* the owner gets the last item pushed */
+	region2 = (struct arcp_test_region *) adeque_pop(&deque);
+	ASSERT(strcmp(region2->data, ptrtest.string2) == 0);
+	ASSERT(adeque_push(&deque, region2) == 0);
+	/* a thief gets the first */
+	region1 = (struct arcp_test_region *) adeque_steal(&deque);
+	ASSERT(strcmp(region1->data, ptrtest.string1) == 0);
+	ASSERT(adeque_steal(&deque) == (struct arcp_region *) region2);
+	ASSERT(adeque_pop(&deque) == NULL);
+	ASSERT(adeque_steal(&deque) == NULL);
+	CHECKPOINT();
+	arcp_release(region1);
+	ASSERT(region1_destroyed);
+	/* region2 was pushed twice */
+	arcp_release(region2);
+	ASSERT(!region2_destroyed);
+	arcp_release(region2);
+	ASSERT(region2_destroyed);
+	adeque_destroy(&deque);
+}
+
+static void test_adeque_grow() {
+	int i;
+	CHECKPOINT();
+	/* wrap around the first array before growing it */
+	for (i = 0; i < DEQUE_SIZE - 1; i++) {
+		ASSERT(adeque_push(&deque, region1) == 0);
+		ASSERT(adeque_steal(&deque) == (struct arcp_region *) region1);
+		arcp_release(region1);
+	}
+	CHECKPOINT();
+	for (i = 0; i < 5 * DEQUE_SIZE; i++) {
+		ASSERT(adeque_push(&deque, i % 2 ? region2 : region1) == 0);
+	}
+	ASSERT(adeque_size(&deque) == 5 * DEQUE_SIZE);
+	ASSERT(arcp_usecount(region1) == 1 + 5 * DEQUE_SIZE / 2);
+	CHECKPOINT();
+	/* everything is still there, in order */
+	ASSERT(adeque_steal(&deque) == (struct arcp_region *) region1);
+	arcp_release(region1);
+	ASSERT(adeque_steal(&deque) == (struct arcp_region *) region2);
+	arcp_release(region2);
+	for (i = 5 * DEQUE_SIZE - 1; i >= 4; i--) {
+		ASSERT(adeque_pop(&deque)
+		       == (struct arcp_region *) (i % 2 ? region2 : region1));
+		arcp_release(i % 2 ? region2 : region1);
+	}
+	CHECKPOINT();
+	/* the rest are released along with the deque */
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	adeque_destroy(&deque);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+}
+
+static void test_adeque_multithread() {
+	atomic_int ntaken = ATOMIC_VAR_INIT(0);
+	int i;
+	CHECKPOINT();
+	for (i = 0; i < NITEMS; i++) {
+		arcp_region_init(&items[i], NULL);
+		ak_init(&items[i].taken, false);
+	}
+	CHECKPOINT();
+	/* thread 0 owns the deque, pushing everything and popping some of
+	 * it back, while the rest steal */
+	WITH_THREADS(NTHREADS) {
+		struct adeque_test_item *item;
+		int k;
+		if (thread_number == 0) {
+			for (k = 0; k < NITEMS; k++) {
+				ASSERT(adeque_push(&deque, &items[k]) == 0);
+				if (k % 3 != 0) {
+					continue;
+				}
+				item = (struct adeque_test_item *)
+					adeque_pop(&deque);
+				if (item != NULL) {
+					ak_ldadd(&ntaken, 1, mo_relaxed);
+					ASSERT(!ak_swap(&item->taken, true,
+							mo_relaxed));
+					arcp_release(item);
+				}
+			}
+		}
+		while (ak_load(&ntaken, mo_relaxed) < NITEMS) {
+			item = (struct adeque_test_item *)
+				(thread_number == 0 ? adeque_pop(&deque)
+				 : adeque_steal(&deque));
+			if (item == NULL) {
+				cpu_yield();
+				continue;
+			}
+			ak_ldadd(&ntaken, 1, mo_relaxed);
+			ASSERT(!ak_swap(&item->taken, true, mo_relaxed));
+			arcp_release(item);
+		}
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(ak_load(&ntaken, mo_relaxed) == NITEMS);
+	ASSERT(adeque_pop(&deque) == NULL);
+	for (i = 0; i < NITEMS; i++) {
+		ASSERT(ak_load(&items[i].taken, mo_relaxed));
+		ASSERT(arcp_usecount(&items[i]) == 1);
+	}
+	arcp_release(region1);
+	arcp_release(region2);
+	adeque_destroy(&deque);
+}
+
+int run_deque_h_test_suite() {
+	int r;
+	void (*void_tests[])() = { test_adeque_init, NULL };
+	char *void_test_names[] = { "adeque_init", NULL };
+
+	void (*adeque_init_tests[])() = { test_adeque_push, test_adeque_grow,
+					  test_adeque_multithread, NULL };
+	char *adeque_init_test_names[] = { "adeque_push", "adeque_grow",
+					   "adeque_multithread", NULL };
+
+	r = run_test_suite(NULL, void_test_names, void_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	r = run_test_suite(test_adeque_init_fixture,
+			   adeque_init_test_names, adeque_init_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
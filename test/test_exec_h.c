@@ -0,0 +1,210 @@
+/*
+ * test_exec_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <time.h>
+#include <atomickit/atomic.h>
+#include <atomickit/exec.h>
+#include "alltests.h"
+#include "test.h"
+
+static aexec_t exec;
+
+#define NWORKERS 4
+#define NTASKS 1000
+#define NSUM 100000
+#define LEAF 100
+#define NSTACKGROUPS 10000
+#define CANARY 0x5a5a5a5au
+
+static atomic_int count;
+
+static void count_task(void *arg __attribute__((unused))) {
+	ak_ldadd(&count, 1, mo_relaxed);
+}
+
+struct sum_args {
+	int start;
+	int end;
+	long sum;
+};
+
+/* Sums start through end - 1 by splitting the range in half until it is
+ * small, running one half as a subtask. */
+static void sum_task(void *arg) {
+	struct sum_args *args = arg;
+	struct sum_args left, right;
+	aexec_group_t group;
+	int i;
+	if (args->end - args->start <= LEAF) {
+		args->sum = 0;
+		for (i = args->start; i < args->end; i++) {
+			args->sum += i;
+		}
+		return;
+	}
+	left.start = args->start;
+	left.end = args->start + (args->end - args->start) / 2;
+	right.start = left.end;
+	right.end = args->end;
+	aexec_group_init(&group);
+	ASSERT(aexec_submit(&exec, &group, sum_task, &left) == 0);
+	sum_task(&right);
+	aexec_wait_group(&exec, &group);
+	args->sum = left.sum + right.sum;
+}
+
+/* Waits on a group in this frame, which the next call reuses. */
+static void __attribute__((noinline)) wait_stack_group() {
+	aexec_group_t group = AEXEC_GROUP_VAR_INIT;
+	ASSERT(aexec_submit(&exec, &group, count_task, NULL) == 0);
+	aexec_wait_group(&exec, &group);
+}
+
+/* Fills a frame like wait_stack_group's and checks that a late task
+ * doesn't write to it. */
+static int __attribute__((noinline)) check_stack_canary() {
+	volatile unsigned int canary[16];
+	int i;
+	for (i = 0; i < 16; i++) {
+		canary[i] = CANARY;
+	}
+	cpu_yield();
+	for (i = 0; i < 16; i++) {
+		if (canary[i] != CANARY) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/****************************/
+static void test_aexec_init() {
+	int r;
+	CHECKPOINT();
+	r = aexec_init(&exec, NWORKERS);
+	ASSERT(r == 0);
+	ASSERT(exec.nworkers == NWORKERS);
+	CHECKPOINT();
+	aexec_destroy(&exec);
+}
+
+/****************************/
+
+static void test_aexec_init_fixture(void (*test)()) {
+	int r;
+	CHECKPOINT();
+	ak_init(&count, 0);
+	r = aexec_init(&exec, NWORKERS);
+	if (r != 0) {
+		UNRESOLVED("aexec_init failed");
+	}
+	test();
+}
+
+static void test_aexec_submit() {
+	aexec_group_t group = AEXEC_GROUP_VAR_INIT;
+	int i;
+	CHECKPOINT();
+	for (i = 0; i < NTASKS; i++) {
+		ASSERT(aexec_submit(&exec, &group, count_task, NULL) == 0);
+	}
+	aexec_wait_group(&exec, &group);
+	ASSERT(ak_load(&group.state, mo_relaxed) == 0);
+	ASSERT(ak_load(&count, mo_relaxed) == NTASKS);
+	CHECKPOINT();
+	/* an empty group is done already */
+	aexec_wait_group(&exec, &group);
+	aexec_destroy(&exec);
+}
+
+static void test_aexec_fork_join() {
+	aexec_group_t group = AEXEC_GROUP_VAR_INIT;
+	struct sum_args args = { 0, NSUM, 0 };
+	CHECKPOINT();
+	ASSERT(aexec_submit(&exec, &group, sum_task, &args) == 0);
+	aexec_wait_group(&exec, &group);
+	ASSERT(args.sum == (long) NSUM * (NSUM - 1) / 2);
+	aexec_destroy(&exec);
+}
+
+static void test_aexec_stack_group() {
+	int i;
+	CHECKPOINT();
+	/* the group is gone as soon as the wait returns */
+	for (i = 0; i < NSTACKGROUPS; i++) {
+		wait_stack_group();
+		ASSERT(check_stack_canary());
+	}
+	ASSERT(ak_load(&count, mo_relaxed) == NSTACKGROUPS);
+	aexec_destroy(&exec);
+}
+
+static void test_aexec_wake() {
+	aexec_group_t group = AEXEC_GROUP_VAR_INIT;
+	struct timespec idle = { 0, 20000000 };
+	int i;
+	CHECKPOINT();
+	/* give the workers time to fall asleep, more than once */
+	for (i = 0; i < 3; i++) {
+		nanosleep(&idle, NULL);
+		ASSERT(aexec_submit(&exec, &group, count_task, NULL) == 0);
+		aexec_wait_group(&exec, &group);
+		ASSERT(ak_load(&count, mo_relaxed) == i + 1);
+	}
+	aexec_destroy(&exec);
+}
+
+static void test_aexec_destroy() {
+	int i;
+	CHECKPOINT();
+	/* tasks submitted before destruction all run */
+	for (i = 0; i < NTASKS; i++) {
+		ASSERT(aexec_submit(&exec, NULL, count_task, NULL) == 0);
+	}
+	aexec_destroy(&exec);
+	ASSERT(ak_load(&count, mo_relaxed) == NTASKS);
+}
+
+int run_exec_h_test_suite() {
+	int r;
+	void (*void_tests[])() = { test_aexec_init, NULL };
+	char *void_test_names[] = { "aexec_init", NULL };
+
+	void (*aexec_init_tests[])() = { test_aexec_submit,
+					 test_aexec_fork_join,
+					 test_aexec_stack_group,
+					 test_aexec_wake, test_aexec_destroy,
+					 NULL };
+	char *aexec_init_test_names[] = { "aexec_submit", "aexec_fork_join",
+					  "aexec_stack_group", "aexec_wake",
+					  "aexec_destroy", NULL };
+
+	r = run_test_suite(NULL, void_test_names, void_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	r = run_test_suite(test_aexec_init_fixture,
+			   aexec_init_test_names, aexec_init_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * test_faaq_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include <alloca.h>
+#include <atomickit/rcp.h>
+#include <atomickit/faaq.h>
+#include "alltests.h"
+#include "test.h"
+
+static struct {
+	char string1[14];
+	char string2[14];
+} ptrtest = { "Test String 1", "Test String 2" };
+
+static bool region1_destroyed;
+static bool region2_destroyed;
+
+static void destroy_region1(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region1_destroyed = true;
+}
+
+static void destroy_region2(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region2_destroyed = true;
+}
+
+struct arcp_test_region {
+	struct arcp_region;
+	char data[];
+};
+
+static struct arcp_test_region *region1;
+static struct arcp_test_region *region2;
+
+static afaaq_t faaq;
+
+#define NTHREADS 8
+#define NREPEATS 1000
+
+struct afaaq_test_item {
+	struct arcp_region;
+	int producer;
+	int seq;
+	atomic_bool dequeued;
+};
+
+static struct afaaq_test_item items[NTHREADS / 2][NREPEATS];
+
+/****************************/
+static void test_afaaq_init() {
+	int r;
+	CHECKPOINT();
+	r = afaaq_init(&faaq);
+	ASSERT(r == 0);
+	ASSERT(afaaq_deq(&faaq) == NULL);
+	CHECKPOINT();
+	afaaq_destroy(&faaq);
+}
+
+/****************************/
+
+static void test_afaaq_init_fixture(void (*test)()) {
+	int r;
+	CHECKPOINT();
+	region1_destroyed = false;
+	region2_destroyed = false;
+	region1 = alloca(sizeof(struct arcp_test_region) + 14);
+	region2 = alloca(sizeof(struct arcp_test_region) + 14);
+	strcpy(region1->data, ptrtest.string1);
+	strcpy(region2->data, ptrtest.string2);
+	arcp_region_init(region1, destroy_region1);
+	arcp_region_init(region2, destroy_region2);
+	CHECKPOINT();
+	r = afaaq_init(&faaq);
+	if (r != 0) {
+		UNRESOLVED("afaaq_init failed");
+	}
+	test();
+}
+
+static void test_afaaq_enq() {
+	CHECKPOINT();
+	ASSERT(afaaq_enq(&faaq, region1) == 0);
+	ASSERT(afaaq_enq(&faaq, region2) == 0);
+	ASSERT(arcp_usecount(region1) == 2);
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	CHECKPOINT();
+	region1 = (struct arcp_test_region *) afaaq_deq(&faaq);
+	region2 = (struct arcp_test_region *) afaaq_deq(&faaq);
+	ASSERT(strcmp(region1->data, ptrtest.string1) == 0);
+	ASSERT(strcmp(region2->data, ptrtest.string2) == 0);
+	ASSERT(afaaq_deq(&faaq) == NULL);
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+	afaaq_destroy(&faaq);
+}
+
+static void test_afaaq_segments() {
+	int i;
+	CHECKPOINT();
+	/* fill several segments */
+	for (i = 0; i < 3 * AFAAQ_SEGMENT_SIZE + 1; i++) {
+		ASSERT(afaaq_enq(&faaq, i % 2 ? region2 : region1) == 0);
+	}
+	ASSERT(arcp_usecount(region1) == 2 + 3 * AFAAQ_SEGMENT_SIZE / 2);
+	CHECKPOINT();
+	/* empty the first two, and part of the third */
+	for (i = 0; i < 2 * AFAAQ_SEGMENT_SIZE + 3; i++) {
+		ASSERT(afaaq_deq(&faaq)
+		       == (struct arcp_region *) (i % 2 ? region2 : region1));
+		arcp_release(i % 2 ? region2 : region1);
+	}
+	CHECKPOINT();
+	/* the rest are released along with the queue */
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	afaaq_destroy(&faaq);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+}
+
+static void test_afaaq_multithread() {
+	atomic_int ndequeued = ATOMIC_VAR_INIT(0);
+	int i, j;
+	CHECKPOINT();
+	for (i = 0; i < NTHREADS / 2; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			arcp_region_init(&items[i][j], NULL);
+			items[i][j].producer = i;
+			items[i][j].seq = j;
+			ak_init(&items[i][j].dequeued, false);
+		}
+	}
+	CHECKPOINT();
+	/* half the threads produce, and half consume */
+	WITH_THREADS(NTHREADS) {
+		struct afaaq_test_item *item;
+		int last[NTHREADS / 2];
+		int k;
+		if (thread_number % 2) {
+			for (k = 0; k < NREPEATS; k++) {
+				item = &items[thread_number / 2][k];
+				ASSERT(afaaq_enq(&faaq, item) == 0);
+			}
+		} else {
+			for (k = 0; k < NTHREADS / 2; k++) {
+				last[k] = -1;
+			}
+			while (ak_load(&ndequeued, mo_relaxed)
+			       < NTHREADS / 2 * NREPEATS) {
+				item = (struct afaaq_test_item *)
+					afaaq_deq(&faaq);
+				if (item == NULL) {
+					cpu_yield();
+					continue;
+				}
+				ak_ldadd(&ndequeued, 1, mo_relaxed);
+				/* each producer's items arrive in order */
+				ASSERT(item->seq > last[item->producer]);
+				last[item->producer] = item->seq;
+				ASSERT(!ak_swap(&item->dequeued, true,
+						mo_relaxed));
+				arcp_release(item);
+			}
+		}
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(ak_load(&ndequeued, mo_relaxed) == NTHREADS / 2 * NREPEATS);
+	ASSERT(afaaq_deq(&faaq) == NULL);
+	for (i = 0; i < NTHREADS / 2; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			ASSERT(ak_load(&items[i][j].dequeued, mo_relaxed));
+			ASSERT(arcp_usecount(&items[i][j]) == 1);
+		}
+	}
+	arcp_release(region1);
+	arcp_release(region2);
+	afaaq_destroy(&faaq);
+}
+
+int run_faaq_h_test_suite() {
+	int r;
+	void (*void_tests[])() = { test_afaaq_init, NULL };
+	char *void_test_names[] = { "afaaq_init", NULL };
+
+	void (*afaaq_init_tests[])() = { test_afaaq_enq, test_afaaq_segments,
+					 test_afaaq_multithread, NULL };
+	char *afaaq_init_test_names[] = { "afaaq_enq", "afaaq_segments",
+					  "afaaq_multithread", NULL };
+
+	r = run_test_suite(NULL, void_test_names, void_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	r = run_test_suite(test_afaaq_init_fixture,
+			   afaaq_init_test_names, afaaq_init_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
@@ -0,0 +1,368 @@
+/*
+ * test_iqueue_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <alloca.h>
+#include <atomickit/rcp.h>
+#include <atomickit/iqueue.h>
+#include "alltests.h"
+#include "test.h"
+
+static struct {
+	char string1[14];
+	char string2[14];
+} ptrtest = { "Test String 1", "Test String 2" };
+
+static bool region1_destroyed;
+static bool region2_destroyed;
+
+struct aiqueue_test_region {
+	struct aiqueue_node;
+	char data[];
+};
+
+static void destroy_region1(struct aiqueue_test_region *region) {
+	CHECKPOINT();
+	aiqueue_node_finalize(region);
+	region1_destroyed = true;
+}
+
+static void destroy_region2(struct aiqueue_test_region *region) {
+	CHECKPOINT();
+	aiqueue_node_finalize(region);
+	region2_destroyed = true;
+}
+
+static struct aiqueue_test_region *region1;
+static struct aiqueue_test_region *region2;
+
+static aiqueue_t aiqueue;
+
+#define NTHREADS 8
+#define NREPEATS 1000
+#define NCHAIN 100000
+
+struct aiqueue_test_item {
+	struct aiqueue_node;
+	int producer;
+	int seq;
+};
+
+#define NPRODUCERS (NTHREADS - 1)
+
+static struct aiqueue_test_item items[NPRODUCERS][NREPEATS];
+
+#define NPOOL 16
+
+static struct aiqueue_test_item pool[NPOOL];
+
+static void destroy_item(struct aiqueue_test_item *item) {
+	aiqueue_node_finalize(item);
+}
+
+/****************************/
+static void test_aiqueue_init() {
+	int r;
+	CHECKPOINT();
+	r = aiqueue_init(&aiqueue);
+	ASSERT(r == 0);
+	CHECKPOINT();
+	ASSERT(aiqueue_deq(&aiqueue) == NULL);
+	aiqueue_destroy(&aiqueue);
+}
+
+/****************************/
+
+static void test_aiqueue_fixture(void (*test)()) {
+	int r;
+	CHECKPOINT();
+	region1_destroyed = false;
+	region2_destroyed = false;
+	region1 = alloca(sizeof(struct aiqueue_test_region) + 14);
+	region2 = alloca(sizeof(struct aiqueue_test_region) + 14);
+	strcpy(region1->data, ptrtest.string1);
+	strcpy(region2->data, ptrtest.string2);
+	arcp_region_init(region1, (arcp_destroy_f) destroy_region1);
+	arcp_region_init(region2, (arcp_destroy_f) destroy_region2);
+	aiqueue_node_init(region1);
+	aiqueue_node_init(region2);
+	CHECKPOINT();
+	r = aiqueue_init(&aiqueue);
+	if (r != 0) {
+		UNRESOLVED("aiqueue_init failed");
+	}
+	test();
+}
+
+static void test_aiqueue_enq() {
+	CHECKPOINT();
+	aiqueue_enq(&aiqueue, region1);
+	aiqueue_enq(&aiqueue, region2);
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	CHECKPOINT();
+	region1 = (struct aiqueue_test_region *) aiqueue_deq(&aiqueue);
+	ASSERT(strcmp(region1->data, ptrtest.string1) == 0);
+	region2 = (struct aiqueue_test_region *) aiqueue_deq(&aiqueue);
+	ASSERT(strcmp(region2->data, ptrtest.string2) == 0);
+	ASSERT(aiqueue_deq(&aiqueue) == NULL);
+	CHECKPOINT();
+	/* region2 is still the sentinel */
+	arcp_release(region1);
+	ASSERT(region1_destroyed);
+	arcp_release(region2);
+	ASSERT(!region2_destroyed);
+	aiqueue_destroy(&aiqueue);
+	ASSERT(region2_destroyed);
+}
+
+static void test_aiqueue_reenq() {
+	int i;
+	CHECKPOINT();
+	aiqueue_enq(&aiqueue, region1);
+	aiqueue_enq(&aiqueue, region2);
+	ASSERT(aiqueue_deq(&aiqueue) == (struct aiqueue_node *) region1);
+	arcp_release(region1);
+	ASSERT(!aiqueue_done(&aiqueue, region1));
+	ASSERT(aiqueue_deq(&aiqueue) == (struct aiqueue_node *) region2);
+	arcp_release(region2);
+	ASSERT(aiqueue_done(&aiqueue, region1));
+	ASSERT(!aiqueue_done(&aiqueue, region2));
+	/* the old sentinel no longer holds on to the new one */
+	ASSERT(arcp_load_phantom(&region1->next) == NULL);
+	ASSERT(arcp_storecount(region2) == 2);
+	CHECKPOINT();
+	/* pass the two back and forth through the queue */
+	for (i = 0; i < 10; i++) {
+		aiqueue_enq(&aiqueue, i % 2 ? region2 : region1);
+		ASSERT(aiqueue_deq(&aiqueue)
+		       == (struct aiqueue_node *) (i % 2 ? region2 : region1));
+		arcp_release(i % 2 ? region2 : region1);
+		ASSERT(aiqueue_done(&aiqueue, i % 2 ? region1 : region2));
+	}
+	ASSERT(aiqueue_deq(&aiqueue) == NULL);
+	CHECKPOINT();
+	ASSERT(arcp_usecount(region1) == 1);
+	ASSERT(arcp_usecount(region2) == 1);
+	arcp_release(region1);
+	arcp_release(region2);
+	aiqueue_destroy(&aiqueue);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+}
+
+static void test_aiqueue_chain() {
+	struct aiqueue_test_item *chain;
+	int i;
+	CHECKPOINT();
+	chain = calloc(NCHAIN, sizeof(struct aiqueue_test_item));
+	if (chain == NULL) {
+		UNRESOLVED("calloc failed");
+	}
+	for (i = 0; i < NCHAIN; i++) {
+		arcp_region_init(&chain[i], (arcp_destroy_f) destroy_item);
+		aiqueue_node_init(&chain[i]);
+		aiqueue_enq(&aiqueue, &chain[i]);
+	}
+	CHECKPOINT();
+	/* releasing the whole queue at once must not recurse down it */
+	for (i = 0; i < NCHAIN; i++) {
+		arcp_release(&chain[i]);
+	}
+	aiqueue_destroy(&aiqueue);
+	free(chain);
+	arcp_release(region1);
+	arcp_release(region2);
+}
+
+static void test_aiqueue_multithread() {
+	int i, j;
+	CHECKPOINT();
+	for (i = 0; i < NPRODUCERS; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			arcp_region_init(&items[i][j],
+					 (arcp_destroy_f) destroy_item);
+			aiqueue_node_init(&items[i][j]);
+			items[i][j].producer = i;
+			items[i][j].seq = j;
+		}
+	}
+	CHECKPOINT();
+	/* every thread but one produces, and the last one consumes */
+	WITH_THREADS(NTHREADS) {
+		struct aiqueue_test_item *item;
+		int last[NPRODUCERS];
+		int k, n;
+		if (thread_number < NPRODUCERS) {
+			for (k = 0; k < NREPEATS; k++) {
+				aiqueue_enq(&aiqueue,
+					    &items[thread_number][k]);
+			}
+		} else {
+			for (k = 0; k < NPRODUCERS; k++) {
+				last[k] = -1;
+			}
+			for (n = 0; n < NPRODUCERS * NREPEATS; n++) {
+				while ((item = (struct aiqueue_test_item *)
+					aiqueue_deq(&aiqueue)) == NULL) {
+					cpu_yield();
+				}
+				/* each producer's items arrive in order */
+				ASSERT(item->seq > last[item->producer]);
+				last[item->producer] = item->seq;
+				arcp_release(item);
+			}
+		}
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(aiqueue_deq(&aiqueue) == NULL);
+	aiqueue_destroy(&aiqueue);
+	for (i = 0; i < NPRODUCERS; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			ASSERT(arcp_usecount(&items[i][j]) == 1);
+			arcp_release(&items[i][j]);
+		}
+	}
+	arcp_release(region1);
+	arcp_release(region2);
+}
+
+static void test_aiqueue_recycle() {
+	struct aiqueue_test_item *item;
+	int counts[NPOOL];
+	int i, j, n;
+	CHECKPOINT();
+	for (i = 0; i < NPOOL; i++) {
+		arcp_region_init(&pool[i], (arcp_destroy_f) destroy_item);
+		aiqueue_node_init(&pool[i]);
+		pool[i].producer = -1;
+		pool[i].seq = i;
+		aiqueue_enq(&aiqueue, &pool[i]);
+		arcp_release(&pool[i]);
+	}
+	for (i = 0; i < NPRODUCERS; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			arcp_region_init(&items[i][j],
+					 (arcp_destroy_f) destroy_item);
+			aiqueue_node_init(&items[i][j]);
+			items[i][j].producer = i;
+			items[i][j].seq = j;
+		}
+	}
+	CHECKPOINT();
+	/* the consumer sends the pool around the queue again and again,
+	 * while the producers enqueue fresh items alongside it */
+	WITH_THREADS(NTHREADS) {
+		struct aiqueue_test_item *pending[NPOOL + 1];
+		struct aiqueue_test_item *item;
+		int npending = 0;
+		int k, m, n;
+		if (thread_number < NPRODUCERS) {
+			for (k = 0; k < NREPEATS; k++) {
+				aiqueue_enq(&aiqueue,
+					    &items[thread_number][k]);
+			}
+		} else {
+			n = 0;
+			while (n < NPRODUCERS * NREPEATS) {
+				item = (struct aiqueue_test_item *)
+					aiqueue_deq(&aiqueue);
+				if (item == NULL) {
+					cpu_yield();
+				} else if (item->producer >= 0) {
+					n++;
+					arcp_release(item);
+				} else {
+					pending[npending++] = item;
+				}
+				for (k = 0, m = 0; k < npending; k++) {
+					item = pending[k];
+					if (aiqueue_done(&aiqueue, item)) {
+						aiqueue_enq(&aiqueue, item);
+						arcp_release(item);
+					} else {
+						pending[m++] = item;
+					}
+				}
+				npending = m;
+			}
+			/* whatever is left over must be the sentinel */
+			ASSERT(npending <= 1);
+			for (k = 0; k < npending; k++) {
+				arcp_release(pending[k]);
+			}
+		}
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	/* every pool item is in the queue exactly once, or is the
+	 * sentinel */
+	memset(counts, 0, sizeof(counts));
+	n = 0;
+	while ((item = (struct aiqueue_test_item *) aiqueue_deq(&aiqueue))
+	       != NULL) {
+		ASSERT(item >= pool && item < pool + NPOOL);
+		counts[item->seq]++;
+		n++;
+		arcp_release(item);
+		ASSERT(n <= NPOOL);
+	}
+	for (i = 0; i < NPOOL; i++) {
+		ASSERT(counts[i] <= 1);
+	}
+	ASSERT(n >= NPOOL - 1);
+	aiqueue_destroy(&aiqueue);
+	for (i = 0; i < NPRODUCERS; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			ASSERT(arcp_usecount(&items[i][j]) == 1);
+			arcp_release(&items[i][j]);
+		}
+	}
+	arcp_release(region1);
+	arcp_release(region2);
+}
+
+int run_iqueue_h_test_suite() {
+	int r;
+	void (*void_tests[])() = { test_aiqueue_init, NULL };
+	char *void_test_names[] = { "aiqueue_init", NULL };
+
+	void (*aiqueue_tests[])() = { test_aiqueue_enq, test_aiqueue_reenq,
+				      test_aiqueue_chain,
+				      test_aiqueue_multithread,
+				      test_aiqueue_recycle, NULL };
+	char *aiqueue_test_names[] = { "aiqueue_enq", "aiqueue_reenq",
+				       "aiqueue_chain", "aiqueue_multithread",
+				       "aiqueue_recycle", NULL };
+
+	r = run_test_suite(NULL, void_test_names, void_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	r = run_test_suite(test_aiqueue_fixture, aiqueue_test_names,
+			   aiqueue_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
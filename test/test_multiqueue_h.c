@@ -0,0 +1,254 @@
+/*
+ * test_multiqueue_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <alloca.h>
+#include <atomickit/rcp.h>
+#include <atomickit/multiqueue.h>
+#include "alltests.h"
+#include "test.h"
+
+static struct {
+	char string1[14];
+	char string2[14];
+} ptrtest = { "Test String 1", "Test String 2" };
+
+static bool region1_destroyed;
+static bool region2_destroyed;
+
+static void destroy_region1(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region1_destroyed = true;
+}
+
+static void destroy_region2(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region2_destroyed = true;
+}
+
+struct arcp_test_region {
+	struct arcp_region;
+	char data[];
+};
+
+static struct arcp_test_region *region1;
+static struct arcp_test_region *region2;
+
+static amultiqueue_t mq;
+
+#define NTHREADS 8
+#define NREPEATS 1000
+
+#define NSHARDS 4
+
+struct amultiqueue_test_item {
+	struct arcp_region;
+	int producer;
+	int seq;
+	atomic_bool dequeued;
+};
+
+static struct amultiqueue_test_item items[NTHREADS / 2][NREPEATS];
+
+/****************************/
+static void test_amultiqueue_init() {
+	int r;
+	CHECKPOINT();
+	r = amultiqueue_init(&mq, NSHARDS);
+	ASSERT(r == 0);
+	ASSERT(mq.nshards == NSHARDS);
+	ASSERT((uintptr_t) mq.shards % __AMULTIQUEUE_CACHELINE == 0);
+	ASSERT(amultiqueue_deq(&mq) == NULL);
+	CHECKPOINT();
+	amultiqueue_destroy(&mq);
+	CHECKPOINT();
+	/* one shard per processor */
+	r = amultiqueue_init(&mq, 0);
+	ASSERT(r == 0);
+	ASSERT(mq.nshards >= 1);
+	ASSERT(amultiqueue_deq(&mq) == NULL);
+	amultiqueue_destroy(&mq);
+}
+
+/****************************/
+
+static void test_amultiqueue_init_fixture(void (*test)()) {
+	int r;
+	CHECKPOINT();
+	region1_destroyed = false;
+	region2_destroyed = false;
+	region1 = alloca(sizeof(struct arcp_test_region) + 14);
+	region2 = alloca(sizeof(struct arcp_test_region) + 14);
+	strcpy(region1->data, ptrtest.string1);
+	strcpy(region2->data, ptrtest.string2);
+	arcp_region_init(region1, destroy_region1);
+	arcp_region_init(region2, destroy_region2);
+	CHECKPOINT();
+	r = amultiqueue_init(&mq, NSHARDS);
+	if (r != 0) {
+		UNRESOLVED("amultiqueue_init failed");
+	}
+	test();
+}
+
+static void test_amultiqueue_enq() {
+	CHECKPOINT();
+	/* one thread's items stay in order */
+	ASSERT(amultiqueue_enq(&mq, region1) == 0);
+	ASSERT(amultiqueue_enq(&mq, region2) == 0);
+	ASSERT(arcp_usecount(region1) == 2);
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	CHECKPOINT();
+	region1 = (struct arcp_test_region *) amultiqueue_deq(&mq);
+	region2 = (struct arcp_test_region *) amultiqueue_deq(&mq);
+	ASSERT(strcmp(region1->data, ptrtest.string1) == 0);
+	ASSERT(strcmp(region2->data, ptrtest.string2) == 0);
+	ASSERT(amultiqueue_deq(&mq) == NULL);
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+	amultiqueue_destroy(&mq);
+}
+
+static void test_amultiqueue_shards() {
+	int i;
+	CHECKPOINT();
+	/* threads started one after another land on different shards */
+	WITH_THREADS(NSHARDS) {
+		ASSERT(amultiqueue_enq(&mq, region1) == 0);
+	} END_WITH_THREADS(NSHARDS);
+	for (i = 0; i < NSHARDS; i++) {
+		ASSERT(ak_load(&mq.shards[i].size, mo_relaxed) == 1);
+	}
+	CHECKPOINT();
+	/* and a dequeuer finds them all */
+	for (i = 0; i < NSHARDS; i++) {
+		ASSERT(amultiqueue_deq(&mq) == (struct arcp_region *) region1);
+		arcp_release(region1);
+	}
+	ASSERT(amultiqueue_deq(&mq) == NULL);
+	CHECKPOINT();
+	/* the rest are released along with the queue */
+	ASSERT(amultiqueue_enq(&mq, region2) == 0);
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(region1_destroyed);
+	ASSERT(!region2_destroyed);
+	amultiqueue_destroy(&mq);
+	ASSERT(region2_destroyed);
+}
+
+static void test_amultiqueue_multithread() {
+	atomic_int ndequeued = ATOMIC_VAR_INIT(0);
+	int i, j;
+	CHECKPOINT();
+	for (i = 0; i < NTHREADS / 2; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			arcp_region_init(&items[i][j], NULL);
+			items[i][j].producer = i;
+			items[i][j].seq = j;
+			ak_init(&items[i][j].dequeued, false);
+		}
+	}
+	CHECKPOINT();
+	/* half the threads produce, and half consume */
+	WITH_THREADS(NTHREADS) {
+		struct amultiqueue_test_item *item;
+		int last[NTHREADS / 2];
+		int k;
+		if (thread_number % 2) {
+			for (k = 0; k < NREPEATS; k++) {
+				item = &items[thread_number / 2][k];
+				ASSERT(amultiqueue_enq(&mq, item) == 0);
+			}
+		} else {
+			for (k = 0; k < NTHREADS / 2; k++) {
+				last[k] = -1;
+			}
+			while (ak_load(&ndequeued, mo_relaxed)
+			       < NTHREADS / 2 * NREPEATS) {
+				item = (struct amultiqueue_test_item *)
+					amultiqueue_deq(&mq);
+				if (item == NULL) {
+					cpu_yield();
+					continue;
+				}
+				ak_ldadd(&ndequeued, 1, mo_relaxed);
+				/* each producer's items arrive in order */
+				ASSERT(item->seq > last[item->producer]);
+				last[item->producer] = item->seq;
+				ASSERT(!ak_swap(&item->dequeued, true,
+						mo_relaxed));
+				arcp_release(item);
+			}
+		}
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(ak_load(&ndequeued, mo_relaxed) == NTHREADS / 2 * NREPEATS);
+	ASSERT(amultiqueue_deq(&mq) == NULL);
+	for (i = 0; i < NSHARDS; i++) {
+		ASSERT(ak_load(&mq.shards[i].size, mo_relaxed) == 0);
+	}
+	for (i = 0; i < NTHREADS / 2; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			ASSERT(ak_load(&items[i][j].dequeued, mo_relaxed));
+			ASSERT(arcp_usecount(&items[i][j]) == 1);
+		}
+	}
+	arcp_release(region1);
+	arcp_release(region2);
+	amultiqueue_destroy(&mq);
+}
+
+int run_multiqueue_h_test_suite() {
+	int r;
+	void (*void_tests[])() = { test_amultiqueue_init, NULL };
+	char *void_test_names[] = { "amultiqueue_init", NULL };
+
+	void (*amultiqueue_init_tests[])() = { test_amultiqueue_enq,
+					       test_amultiqueue_shards,
+					       test_amultiqueue_multithread,
+					       NULL };
+	char *amultiqueue_init_test_names[] = { "amultiqueue_enq",
+						"amultiqueue_shards",
+						"amultiqueue_multithread",
+						NULL };
+
+	r = run_test_suite(NULL, void_test_names, void_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	r = run_test_suite(test_amultiqueue_init_fixture,
+			   amultiqueue_init_test_names,
+			   amultiqueue_init_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
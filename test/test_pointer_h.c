@@ -0,0 +1,171 @@
+/*
+ * test_pointer_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ * 
+ * This file is part of Atomic Kit.
+ * 
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ * 
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <stdalign.h>
+#include <atomickit/atomic.h>
+#include <atomickit/pointer.h>
+#include "alltests.h"
+#include "test.h"
+
+#define NTHREADS 8
+#define NREPEATS 10000
+
+static alignas(16) char object1[16];
+static alignas(16) char object2[16];
+
+#define SHIFT APTR_COUNTSHIFT(16)
+#define MAX APTR_COUNTMAX(16)
+
+static void test_aptr_low() {
+	char *ptr;
+	CHECKPOINT();
+	ptr = aptr_setlow(object1, 16, 5);
+	ASSERT(ptr != object1);
+	ASSERT(aptr_low(ptr, 16) == 5);
+	ASSERT(aptr_strip(ptr, 16) == object1);
+	ptr = aptr_setlow(ptr, 16, 15);
+	ASSERT(aptr_low(ptr, 16) == 15);
+	ASSERT(aptr_setlow(ptr, 16, 0) == object1);
+}
+
+static void test_aptr_high() {
+#if APTR_HIGHBITS > 0
+	char *ptr;
+#endif
+	CHECKPOINT();
+#if APTR_HIGHBITS == 0
+	ASSERT(APTR_HIGHMASK == 0);
+	UNSUPPORTED("no high bits on this architecture");
+#else
+	ASSERT(((uintptr_t) object1 & APTR_HIGHMASK) == 0);
+	ptr = aptr_sethigh(object1, 3);
+	ASSERT(aptr_high(ptr) == 3);
+	ASSERT(((uintptr_t) ptr & APTR_HIGHBIT(1)) != 0);
+	ASSERT(aptr_strip(ptr, 16) == object1);
+	/* both at once */
+	ptr = aptr_setlow(ptr, 16, 7);
+	ASSERT(aptr_high(ptr) == 3);
+	ASSERT(aptr_low(ptr, 16) == 7);
+	ASSERT(aptr_strip(ptr, 16) == object1);
+#endif
+}
+
+static void test_aptr_count() {
+	char *ptr;
+	CHECKPOINT();
+	ASSERT(MAX >= 15);
+	ptr = aptr_setcount(object1, SHIFT, MAX, MAX);
+	ASSERT(aptr_count(ptr, SHIFT, MAX) == MAX);
+	ASSERT(aptr_decount(ptr, SHIFT, MAX) == object1);
+	ptr = aptr_dec(ptr, SHIFT);
+	ASSERT(aptr_count(ptr, SHIFT, MAX) == MAX - 1);
+	ptr = aptr_inc(object1, SHIFT);
+	ASSERT(aptr_count(ptr, SHIFT, MAX) == 1);
+	ASSERT(aptr_decount(ptr, SHIFT, MAX) == object1);
+}
+
+static void test_aptr_ldinc() {
+	_Atomic(char *) aptr;
+	char *ptr;
+	CHECKPOINT();
+	ak_init(&aptr, object1);
+	ptr = aptr_ldinc(&aptr, SHIFT, MAX, mo_acq_rel);
+	ASSERT(aptr_count(ptr, SHIFT, MAX) == 1);
+	ASSERT(ak_load(&aptr, mo_relaxed) == ptr);
+	ASSERT(aptr_lddec(&aptr, &ptr, SHIFT, MAX, mo_acq_rel));
+	ASSERT(ak_load(&aptr, mo_relaxed) == object1);
+	CHECKPOINT();
+	/* no decrement once the pointer changes */
+	ptr = aptr_ldinc(&aptr, SHIFT, MAX, mo_acq_rel);
+	ak_store(&aptr, object2, mo_relaxed);
+	ASSERT(!aptr_lddec(&aptr, &ptr, SHIFT, MAX, mo_acq_rel));
+	ASSERT(ptr == object2);
+	CHECKPOINT();
+	/* no decrement once the count is gone */
+	ptr = aptr_ldinc(&aptr, SHIFT, MAX, mo_acq_rel);
+	ak_store(&aptr, object2, mo_relaxed);
+	ASSERT(!aptr_lddec(&aptr, &ptr, SHIFT, MAX, mo_acq_rel));
+	CHECKPOINT();
+	WITH_THREADS(NTHREADS) {
+		char *myptr;
+		REPEAT(NREPEATS) {
+			myptr = aptr_ldinc(&aptr, SHIFT, MAX, mo_acq_rel);
+			ASSERT(aptr_decount(myptr, SHIFT, MAX) == object2);
+			ASSERT(aptr_count(myptr, SHIFT, MAX) >= 1);
+			ASSERT(aptr_lddec(&aptr, &myptr, SHIFT, MAX,
+					  mo_acq_rel));
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	ASSERT(ak_load(&aptr, mo_relaxed) == object2);
+}
+
+static void test_aptr_pair() {
+	aptr_pair_t pair;
+	aptr_pair_t expected;
+	aptr_pair_t desired;
+	CHECKPOINT();
+	ASSERT(alignof(aptr_pair_t) == 2 * sizeof(uintptr_t));
+	aptr_pair_init(&pair, object1, 42);
+	expected = aptr_pair_load(&pair);
+	ASSERT(expected.ptr == object1);
+	ASSERT(expected.count == 42);
+	CHECKPOINT();
+	desired.ptr = object2;
+	desired.count = 43;
+	ASSERT(aptr_pair_cas(&pair, &expected, desired));
+	expected.ptr = object2;
+	expected.count = 42;
+	desired.ptr = object1;
+	ASSERT(!aptr_pair_cas(&pair, &expected, desired));
+	ASSERT(expected.ptr == object2);
+	ASSERT(expected.count == 43);
+	CHECKPOINT();
+	WITH_THREADS(NTHREADS) {
+		aptr_pair_t o, n;
+		REPEAT(NREPEATS) {
+			o = aptr_pair_load(&pair);
+			do {
+				n.ptr = o.ptr == object1 ? object2 : object1;
+				n.count = o.count + 1;
+			} while (!aptr_pair_cas(&pair, &o, n));
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	expected = aptr_pair_load(&pair);
+	ASSERT(expected.count == 43 + NTHREADS * NREPEATS);
+	/* an even number of flips */
+	ASSERT(expected.ptr == object2);
+}
+
+int run_pointer_h_test_suite() {
+	int r;
+	void (*void_tests[])() = { test_aptr_low, test_aptr_high,
+				   test_aptr_count, test_aptr_ldinc,
+				   test_aptr_pair, NULL };
+	char *void_test_names[] = { "aptr_low", "aptr_high",
+				    "aptr_count", "aptr_ldinc",
+				    "aptr_pair", NULL };
+
+	r = run_test_suite(NULL, void_test_names, void_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
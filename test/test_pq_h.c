@@ -0,0 +1,278 @@
+/*
+ * test_pq_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <alloca.h>
+#include <atomickit/rcp.h>
+#include <atomickit/pq.h>
+#include "alltests.h"
+#include "test.h"
+
+static struct {
+	char string1[14];
+	char string2[14];
+} ptrtest = { "Test String 1", "Test String 2" };
+
+static bool region1_destroyed;
+static bool region2_destroyed;
+
+static void destroy_region1(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region1_destroyed = true;
+}
+
+static void destroy_region2(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region2_destroyed = true;
+}
+
+struct arcp_test_region {
+	struct arcp_region;
+	char data[];
+};
+
+static struct arcp_test_region *region1;
+static struct arcp_test_region *region2;
+
+static apq_t pq;
+
+#define NTHREADS 8
+#define NREPEATS 1000
+#define NITEMS 20000
+
+struct apq_test_item {
+	struct arcp_region;
+	uint64_t prio;
+	atomic_bool deleted;
+};
+
+static struct apq_test_item items[NTHREADS / 2][NREPEATS];
+
+/* A fixed sequence of scattered priorities, with some repeats */
+static uint64_t test_prio(int i) {
+	return ((uint64_t) i * 7919) % (NITEMS / 2);
+}
+
+/****************************/
+static void test_apq_init() {
+	int r;
+	CHECKPOINT();
+	r = apq_init(&pq);
+	ASSERT(r == 0);
+	ASSERT(apq_delete_min(&pq, NULL) == NULL);
+	CHECKPOINT();
+	apq_destroy(&pq);
+}
+
+/****************************/
+
+static void test_apq_init_fixture(void (*test)()) {
+	int r;
+	CHECKPOINT();
+	region1_destroyed = false;
+	region2_destroyed = false;
+	region1 = alloca(sizeof(struct arcp_test_region) + 14);
+	region2 = alloca(sizeof(struct arcp_test_region) + 14);
+	strcpy(region1->data, ptrtest.string1);
+	strcpy(region2->data, ptrtest.string2);
+	arcp_region_init(region1, destroy_region1);
+	arcp_region_init(region2, destroy_region2);
+	CHECKPOINT();
+	r = apq_init(&pq);
+	if (r != 0) {
+		UNRESOLVED("apq_init failed");
+	}
+	test();
+}
+
+static void test_apq_insert() {
+	uint64_t prio;
+	CHECKPOINT();
+	ASSERT(apq_insert(&pq, 2, region2) == 0);
+	ASSERT(apq_insert(&pq, 1, region1) == 0);
+	ASSERT(arcp_storecount(region1) == 1);
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	CHECKPOINT();
+	region1 = (struct arcp_test_region *) apq_delete_min(&pq, &prio);
+	ASSERT(prio == 1);
+	ASSERT(strcmp(region1->data, ptrtest.string1) == 0);
+	region2 = (struct arcp_test_region *) apq_delete_min(&pq, &prio);
+	ASSERT(prio == 2);
+	ASSERT(strcmp(region2->data, ptrtest.string2) == 0);
+	ASSERT(apq_delete_min(&pq, &prio) == NULL);
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+	apq_destroy(&pq);
+}
+
+static void test_apq_order() {
+	struct arcp_region *item;
+	uint64_t prio, last;
+	uint64_t sum;
+	int i;
+	CHECKPOINT();
+	sum = 0;
+	for (i = 0; i < NITEMS; i++) {
+		ASSERT(apq_insert(&pq, test_prio(i),
+				  i % 2 ? region2 : region1) == 0);
+		sum += test_prio(i);
+	}
+	ASSERT(arcp_storecount(region1) == NITEMS / 2);
+	CHECKPOINT();
+	/* take out half, interleaved with putting some back */
+	last = 0;
+	for (i = 0; i < NITEMS / 2; i++) {
+		item = apq_delete_min(&pq, &prio);
+		ASSERT(item != NULL);
+		arcp_release(item);
+		ASSERT(prio >= last);
+		last = prio;
+		sum -= prio;
+		if (i % 4 == 0) {
+			/* reinserting at the lowest priority brings that
+			 * priority out next */
+			ASSERT(apq_insert(&pq, prio, region1) == 0);
+			item = apq_delete_min(&pq, &prio);
+			ASSERT(item != NULL);
+			arcp_release(item);
+			ASSERT(prio == last);
+		}
+	}
+	CHECKPOINT();
+	/* the rest come out in order too */
+	while ((item = apq_delete_min(&pq, &prio)) != NULL) {
+		arcp_release(item);
+		ASSERT(prio >= last);
+		last = prio;
+		sum -= prio;
+	}
+	ASSERT(sum == 0);
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+	apq_destroy(&pq);
+}
+
+static void test_apq_destroy() {
+	int i;
+	CHECKPOINT();
+	for (i = 0; i < NITEMS; i++) {
+		ASSERT(apq_insert(&pq, test_prio(i),
+				  i % 2 ? region2 : region1) == 0);
+	}
+	CHECKPOINT();
+	/* the queue's references go with it, without recursing down the
+	 * list */
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	apq_destroy(&pq);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+}
+
+static void test_apq_multithread() {
+	atomic_int ndeleted = ATOMIC_VAR_INIT(0);
+	int i, j;
+	CHECKPOINT();
+	for (i = 0; i < NTHREADS / 2; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			arcp_region_init(&items[i][j], NULL);
+			items[i][j].prio = test_prio(i * NREPEATS + j);
+			ak_init(&items[i][j].deleted, false);
+		}
+	}
+	CHECKPOINT();
+	/* half the threads insert, and half delete */
+	WITH_THREADS(NTHREADS) {
+		struct apq_test_item *item;
+		uint64_t prio;
+		int k;
+		if (thread_number % 2) {
+			for (k = 0; k < NREPEATS; k++) {
+				item = &items[thread_number / 2][k];
+				ASSERT(apq_insert(&pq, item->prio, item) == 0);
+			}
+		} else {
+			while (ak_load(&ndeleted, mo_relaxed)
+			       < NTHREADS / 2 * NREPEATS) {
+				item = (struct apq_test_item *)
+					apq_delete_min(&pq, &prio);
+				if (item == NULL) {
+					cpu_yield();
+					continue;
+				}
+				ak_ldadd(&ndeleted, 1, mo_relaxed);
+				ASSERT(prio == item->prio);
+				ASSERT(!ak_swap(&item->deleted, true,
+						mo_relaxed));
+				arcp_release(item);
+			}
+		}
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(ak_load(&ndeleted, mo_relaxed) == NTHREADS / 2 * NREPEATS);
+	ASSERT(apq_delete_min(&pq, NULL) == NULL);
+	apq_destroy(&pq);
+	for (i = 0; i < NTHREADS / 2; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			ASSERT(ak_load(&items[i][j].deleted, mo_relaxed));
+			ASSERT(arcp_usecount(&items[i][j]) == 1);
+		}
+	}
+	arcp_release(region1);
+	arcp_release(region2);
+}
+
+int run_pq_h_test_suite() {
+	int r;
+	void (*void_tests[])() = { test_apq_init, NULL };
+	char *void_test_names[] = { "apq_init", NULL };
+
+	void (*apq_init_tests[])() = { test_apq_insert, test_apq_order,
+				       test_apq_destroy,
+				       test_apq_multithread, NULL };
+	char *apq_init_test_names[] = { "apq_insert", "apq_order",
+					"apq_destroy", "apq_multithread",
+					NULL };
+
+	r = run_test_suite(NULL, void_test_names, void_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	r = run_test_suite(test_apq_init_fixture,
+			   apq_init_test_names, apq_init_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
@@ -18,6 +18,7 @@
  * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <string.h>
+#include <time.h>
 #include <alloca.h>
 #include <atomickit/rcp.h>
 #include <atomickit/queue.h>
@@ -54,6 +55,19 @@ static struct arcp_test_region *region2;
 
 static aqueue_t aqueue;
 
+#define NCHAIN 100000
+#define NTHREADS 8
+#define NREPEATS 1000
+#define NBATCH 7
+
+struct aqueue_test_item {
+	struct arcp_region;
+	int producer;
+	int seq;
+};
+
+static struct aqueue_test_item items[NTHREADS / 2][NREPEATS * NBATCH];
+
 /****************************/
 static void test_aqueue_init() {
 	int r;
@@ -112,6 +126,256 @@ static void test_aqueue_enq() {
 	ASSERT(strcmp(region2->data, ptrtest.string2) == 0);
 }
 
+static void test_aqueue_chain() {
+	struct aqueue_node *head;
+	int i;
+	CHECKPOINT();
+	/* a stalled reader keeps every node after head alive */
+	head = (struct aqueue_node *) arcp_load(&aqueue.head);
+	for (i = 0; i < NCHAIN; i++) {
+		ASSERT(aqueue_enq(&aqueue, region1) == 0);
+		ASSERT(aqueue_deq(&aqueue) == (struct arcp_region *) region1);
+		arcp_release(region1);
+	}
+	CHECKPOINT();
+	/* releasing them all must not recurse down the chain */
+	arcp_release(head);
+	ASSERT(arcp_usecount(region1) == 1);
+	arcp_release(region1);
+	ASSERT(region1_destroyed);
+	aqueue_destroy(&aqueue);
+}
+
+static void test_aqueue_enq_n() {
+	struct arcp_region *regions[3];
+	CHECKPOINT();
+	regions[0] = (struct arcp_region *) region1;
+	regions[1] = (struct arcp_region *) region2;
+	regions[2] = (struct arcp_region *) region1;
+	ASSERT(aqueue_enq_n(&aqueue, regions, 3) == 0);
+	ASSERT(aqueue_enq_n(&aqueue, regions, 0) == 0);
+	ASSERT(aqueue_enq(&aqueue, region2) == 0);
+	ASSERT(arcp_storecount(region1) == 2);
+	ASSERT(arcp_storecount(region2) == 2);
+	arcp_release(region1);
+	arcp_release(region2);
+	CHECKPOINT();
+	ASSERT(aqueue_deq(&aqueue) == (struct arcp_region *) region1);
+	ASSERT(aqueue_deq(&aqueue) == (struct arcp_region *) region2);
+	ASSERT(aqueue_deq(&aqueue) == (struct arcp_region *) region1);
+	ASSERT(aqueue_deq(&aqueue) == (struct arcp_region *) region2);
+	ASSERT(aqueue_deq(&aqueue) == NULL);
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	arcp_release(region1);
+	ASSERT(region1_destroyed);
+	ASSERT(!region2_destroyed);
+	arcp_release(region2);
+	ASSERT(region2_destroyed);
+	aqueue_destroy(&aqueue);
+}
+
+static void test_aqueue_deq_n() {
+	struct arcp_region *regions[4];
+	CHECKPOINT();
+	ASSERT(aqueue_deq_n(&aqueue, regions, 4) == 0);
+	ASSERT(aqueue_enq(&aqueue, region1) == 0);
+	ASSERT(aqueue_enq(&aqueue, region2) == 0);
+	ASSERT(aqueue_enq(&aqueue, region1) == 0);
+	arcp_release(region1);
+	arcp_release(region2);
+	CHECKPOINT();
+	ASSERT(aqueue_deq_n(&aqueue, regions, 2) == 2);
+	ASSERT(regions[0] == (struct arcp_region *) region1);
+	ASSERT(regions[1] == (struct arcp_region *) region2);
+	ASSERT(aqueue_peek(&aqueue) == (struct arcp_region *) region1);
+	arcp_release(region1);
+	ASSERT(aqueue_deq_n(&aqueue, &regions[2], 2) == 1);
+	ASSERT(regions[2] == (struct arcp_region *) region1);
+	ASSERT(aqueue_deq_n(&aqueue, regions, 4) == 0);
+	ASSERT(aqueue_deq(&aqueue) == NULL);
+	CHECKPOINT();
+	ASSERT(arcp_storecount(region1) == 0);
+	arcp_release_n(regions, 3);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+	aqueue_destroy(&aqueue);
+}
+
+static void count_region1(struct arcp_region *region, void *arg) {
+	if (region == (struct arcp_region *) region1) {
+		(*(int *) arg)++;
+	}
+	arcp_release(region);
+}
+
+static void test_aqueue_drain() {
+	int i, nregion1;
+	CHECKPOINT();
+	nregion1 = 0;
+	ASSERT(aqueue_drain(&aqueue, count_region1, &nregion1) == 0);
+	for (i = 0; i < 10; i++) {
+		ASSERT(aqueue_enq(&aqueue, i % 3 ? region2 : region1) == 0);
+	}
+	arcp_release(region1);
+	arcp_release(region2);
+	CHECKPOINT();
+	ASSERT(aqueue_drain(&aqueue, count_region1, &nregion1) == 10);
+	ASSERT(nregion1 == 4);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+	ASSERT(aqueue_deq(&aqueue) == NULL);
+	CHECKPOINT();
+	/* the queue still works afterwards */
+	region1_destroyed = false;
+	arcp_region_init(region1, destroy_region1);
+	ASSERT(aqueue_enq(&aqueue, region1) == 0);
+	arcp_release(region1);
+	ASSERT(aqueue_deq(&aqueue) == (struct arcp_region *) region1);
+	arcp_release(region1);
+	ASSERT(region1_destroyed);
+	aqueue_destroy(&aqueue);
+}
+
+static void test_aqueue_batch_multithread() {
+	atomic_int ndequeued = ATOMIC_VAR_INIT(0);
+	int i, j;
+	CHECKPOINT();
+	for (i = 0; i < NTHREADS / 2; i++) {
+		for (j = 0; j < NREPEATS * NBATCH; j++) {
+			arcp_region_init(&items[i][j], NULL);
+			items[i][j].producer = i;
+			items[i][j].seq = j;
+		}
+	}
+	CHECKPOINT();
+	/* half the threads produce in batches, and half consume in batches
+	 * of a different size */
+	WITH_THREADS(NTHREADS) {
+		struct arcp_region *regions[NBATCH];
+		struct aqueue_test_item *item;
+		int last[NTHREADS / 2];
+		size_t n, k;
+		int j;
+		if (thread_number % 2) {
+			for (j = 0; j < NREPEATS * NBATCH; j += NBATCH) {
+				for (k = 0; k < NBATCH; k++) {
+					item = &items[thread_number / 2][j + k];
+					regions[k] = (struct arcp_region *)
+						item;
+				}
+				ASSERT(aqueue_enq_n(&aqueue, regions, NBATCH)
+				       == 0);
+			}
+		} else {
+			for (k = 0; k < NTHREADS / 2; k++) {
+				last[k] = -1;
+			}
+			while (ak_load(&ndequeued, mo_relaxed)
+			       < NTHREADS / 2 * NREPEATS * NBATCH) {
+				n = aqueue_deq_n(&aqueue, regions, 3);
+				if (n == 0) {
+					cpu_yield();
+					continue;
+				}
+				ak_ldadd(&ndequeued, n, mo_relaxed);
+				for (k = 0; k < n; k++) {
+					item = (struct aqueue_test_item *)
+						regions[k];
+					/* each producer's items arrive in
+					 * order */
+					ASSERT(item->seq
+					       > last[item->producer]);
+					last[item->producer] = item->seq;
+				}
+				arcp_release_n(regions, n);
+			}
+		}
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(ak_load(&ndequeued, mo_relaxed)
+	       == NTHREADS / 2 * NREPEATS * NBATCH);
+	ASSERT(aqueue_deq(&aqueue) == NULL);
+	for (i = 0; i < NTHREADS / 2; i++) {
+		for (j = 0; j < NREPEATS * NBATCH; j++) {
+			ASSERT(arcp_usecount(&items[i][j]) == 1);
+			ASSERT(arcp_storecount(&items[i][j]) == 0);
+		}
+	}
+	arcp_release(region1);
+	arcp_release(region2);
+	aqueue_destroy(&aqueue);
+}
+
+static void test_aqueue_deq_wait() {
+	struct timespec timeout = { 0, 10000000 };
+	struct timespec start, end;
+	double elapsed;
+	CHECKPOINT();
+	/* an item which is already there is returned at once */
+	ASSERT(aqueue_enq(&aqueue, region1) == 0);
+	ASSERT(aqueue_deq_wait(&aqueue, &timeout)
+	       == (struct arcp_region *) region1);
+	arcp_release(region1);
+	CHECKPOINT();
+	/* on an empty queue the wait times out */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ASSERT(aqueue_deq_wait(&aqueue, &timeout) == NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec)
+		+ (end.tv_nsec - start.tv_nsec) / 1e9;
+	ASSERT(elapsed >= 0.01);
+	ASSERT(ak_load(&aqueue.waiters, mo_relaxed) == 0);
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(region1_destroyed);
+	aqueue_destroy(&aqueue);
+}
+
+static void test_aqueue_deq_wait_multithread() {
+	atomic_int nreceived = ATOMIC_VAR_INIT(0);
+	CHECKPOINT();
+	/* thread 0 produces, slowly enough that the others sleep, then
+	 * enqueues region2 once for each of them to tell it to stop */
+	WITH_THREADS(NTHREADS) {
+		struct timespec pause = { 0, 100000 };
+		struct arcp_region *region;
+		int k;
+		if (thread_number == 0) {
+			for (k = 0; k < NREPEATS; k++) {
+				ASSERT(aqueue_enq(&aqueue, region1) == 0);
+				if (k % 100 == 0) {
+					nanosleep(&pause, NULL);
+				}
+			}
+			for (k = 1; k < NTHREADS; k++) {
+				ASSERT(aqueue_enq(&aqueue, region2) == 0);
+			}
+		} else {
+			for (;;) {
+				region = aqueue_deq_wait(&aqueue, NULL);
+				ASSERT(region != NULL);
+				arcp_release(region);
+				if (region == (struct arcp_region *) region2) {
+					break;
+				}
+				ak_ldadd(&nreceived, 1, mo_relaxed);
+			}
+		}
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(ak_load(&nreceived, mo_relaxed) == NREPEATS);
+	ASSERT(ak_load(&aqueue.waiters, mo_relaxed) == 0);
+	ASSERT(aqueue_deq(&aqueue) == NULL);
+	ASSERT(arcp_usecount(region1) == 1);
+	ASSERT(arcp_usecount(region2) == 1);
+	arcp_release(region1);
+	arcp_release(region2);
+	aqueue_destroy(&aqueue);
+}
+
 /****************************/
 
 static void test_aqueue_full_fixture(void (*test)()) {
@@ -227,9 +491,21 @@ int run_queue_h_test_suite() {
 	char *void_test_names[] = { "aqueue_init", NULL };
 
 	void (*aqueue_init_tests[])() = { test_aqueue_destroy_empty,
-					  test_aqueue_enq, NULL };
+					  test_aqueue_enq, test_aqueue_chain,
+					  test_aqueue_enq_n, test_aqueue_deq_n,
+					  test_aqueue_drain,
+					  test_aqueue_batch_multithread,
+					  test_aqueue_deq_wait,
+					  test_aqueue_deq_wait_multithread,
+					  NULL };
 	char *aqueue_init_test_names[] = { "aqueue_destroy_empty",
-					   "aqueue_enq", NULL };
+					   "aqueue_enq", "aqueue_chain",
+					   "aqueue_enq_n", "aqueue_deq_n",
+					   "aqueue_drain",
+					   "aqueue_batch_multithread",
+					   "aqueue_deq_wait",
+					   "aqueue_deq_wait_multithread",
+					   NULL };
 
 	void (*aqueue_full_tests[])() = { test_aqueue_destroy_full,
 					  test_aqueue_deq, test_aqueue_cmpdeq,
@@ -100,6 +100,272 @@ static void test_arcp_region_init() {
 	ASSERT(!region1_destroyed);
 }
 
+static void test_arcp_alloc() {
+	struct arcp_test_region *rg;
+	arcp_t myarcp;
+	CHECKPOINT();
+	rg = arcp_alloc(sizeof(struct arcp_test_region)
+			+ strlen(strtest.string1) + 1, destroy_region1);
+	ASSERT(rg != NULL);
+	strcpy(rg->data, strtest.string1);
+	ASSERT(arcp_usecount(rg) == 1);
+	ASSERT(arcp_storecount(rg) == 0);
+	CHECKPOINT();
+	arcp_init(&myarcp, rg);
+	arcp_release(rg);
+	ASSERT(!region1_destroyed);
+	rg = (struct arcp_test_region *) arcp_load(&myarcp);
+	ASSERT(strcmp(rg->data, strtest.string1) == 0);
+	arcp_release(rg);
+	CHECKPOINT();
+	arcp_store(&myarcp, NULL);
+	ASSERT(region1_destroyed);
+}
+
+static void test_arcp_alloc_weak() {
+	struct arcp_test_region *rg;
+	struct arcp_weakref *weakref;
+	CHECKPOINT();
+	rg = arcp_alloc_weak(sizeof(struct arcp_test_region)
+			     + strlen(strtest.string1) + 1, destroy_region1);
+	ASSERT(rg != NULL);
+	strcpy(rg->data, strtest.string1);
+	/* the weakref is already there */
+	ASSERT(arcp_region_init_weakref(rg) == 0);
+	weakref = arcp_weakref(rg);
+	ASSERT(weakref != NULL);
+	CHECKPOINT();
+	ASSERT((struct arcp_test_region *) arcp_weakref_load(weakref) == rg);
+	arcp_release(rg);
+	ASSERT(!region1_destroyed);
+	CHECKPOINT();
+	arcp_release(rg);
+	ASSERT(region1_destroyed);
+	/* the weakref outlives the region */
+	ASSERT(arcp_weakref_load(weakref) == NULL);
+	arcp_release(weakref);
+}
+
+#define NRACES 100
+
+static atomic_int race_destroyed;
+
+static void destroy_race_region(struct arcp_region *region
+				__attribute__((unused))) {
+	ak_ldadd(&race_destroyed, 1, mo_relaxed);
+}
+
+static void test_arcp_weakref_race() {
+	struct arcp_region *rg;
+	_Atomic(struct arcp_weakref *) published;
+	int i;
+	CHECKPOINT();
+	ak_init(&race_destroyed, 0);
+	for (i = 0; i < NREPEATS / 10; i++) {
+		rg = arcp_alloc(sizeof(struct arcp_region),
+				destroy_race_region);
+		if (rg == NULL) {
+			UNRESOLVED("arcp_alloc failed");
+		}
+		/* one reference for each of the first two threads */
+		arcp_acquire(rg);
+		ak_init(&published, NULL);
+		WITH_THREADS(NTHREADS) {
+			struct arcp_weakref *weakref;
+			struct arcp_region *revived;
+			int k;
+			if (thread_number == 0) {
+				/* give the region a weak reference while the
+				 * other holder may be releasing it */
+				ASSERT(arcp_region_init_weakref(rg) == 0);
+				ak_store(&published, arcp_weakref(rg),
+					 mo_release);
+				arcp_release(rg);
+			} else if (thread_number == 1) {
+				/* alternate with the bulk release, which has
+				 * its own path to zero */
+				if (i % 2) {
+					arcp_release_n(&rg, 1);
+				} else {
+					arcp_release(rg);
+				}
+			} else {
+				/* revive the region through the weak
+				 * reference a while, or until it is gone */
+				while ((weakref = ak_load(&published,
+							  mo_acquire))
+				       == NULL) {
+					cpu_yield();
+				}
+				for (k = 0; k < NRACES; k++) {
+					revived = arcp_weakref_load(weakref);
+					if (revived == NULL) {
+						break;
+					}
+					ASSERT(revived == rg);
+					arcp_release(revived);
+				}
+			}
+		} END_WITH_THREADS(NTHREADS);
+		CHECKPOINT();
+		/* every reference is gone, so it was destroyed, once */
+		ASSERT(ak_load(&race_destroyed, mo_relaxed) == i + 1);
+		ASSERT(arcp_weakref_load(ak_load(&published, mo_relaxed))
+		       == NULL);
+		arcp_release(ak_load(&published, mo_relaxed));
+	}
+}
+
+struct arcp_test_counter {
+	struct arcp_region;
+	long value;
+};
+
+static int increment_counter(struct arcp_region *oldregion,
+			     struct arcp_region **newregion,
+			     void *arg __attribute__((unused))) {
+	struct arcp_test_counter *counter;
+	counter = arcp_alloc(sizeof(struct arcp_test_counter), NULL);
+	if (counter == NULL) {
+		return -1;
+	}
+	counter->value = oldregion == NULL
+		? 1 : ((struct arcp_test_counter *) oldregion)->value + 1;
+	*newregion = (struct arcp_region *) counter;
+	return 0;
+}
+
+static int refuse_update(struct arcp_region *oldregion
+			 __attribute__((unused)),
+			 struct arcp_region **newregion
+			 __attribute__((unused)),
+			 void *arg __attribute__((unused))) {
+	return 42;
+}
+
+static void test_arcp_update() {
+	arcp_t myarcp;
+	struct arcp_test_counter *counter;
+	CHECKPOINT();
+	arcp_init(&myarcp, NULL);
+	ASSERT(arcp_update(&myarcp, refuse_update, NULL) == 42);
+	ASSERT(arcp_load_phantom(&myarcp) == NULL);
+	CHECKPOINT();
+	WITH_THREADS(NTHREADS) {
+		REPEAT(NREPEATS) {
+			ASSERT(arcp_update(&myarcp, increment_counter, NULL)
+			       == 0);
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	counter = (struct arcp_test_counter *) arcp_load(&myarcp);
+	ASSERT(counter->value == NTHREADS * NREPEATS);
+	arcp_release(counter);
+	arcp_store(&myarcp, NULL);
+}
+
+static long counter_value(struct arcp_region *region) {
+	return ((struct arcp_test_counter *) region)->value;
+}
+
+static void versioned_increment(arcp_versioned_t *vrcp) {
+	struct arcp_region *oldregion;
+	struct arcp_region *newregion;
+	oldregion = arcp_load(&vrcp->rcp);
+	ASSERT(increment_counter(oldregion, &newregion, NULL) == 0);
+	arcp_release(oldregion);
+	arcp_versioned_store(vrcp, newregion);
+	arcp_release(newregion);
+}
+
+static void test_arcp_load_snapshot() {
+	arcp_versioned_t myarcps[2];
+	arcp_versioned_t *rcps[2] = { &myarcps[0], &myarcps[1] };
+	struct arcp_region *regions[2];
+	uintptr_t versions[2];
+	CHECKPOINT();
+	arcp_versioned_init(&myarcps[0], NULL);
+	arcp_versioned_init(&myarcps[1], NULL);
+	versioned_increment(&myarcps[0]);
+	versioned_increment(&myarcps[1]);
+	arcp_load_snapshot(rcps, 2, regions, versions);
+	ASSERT(regions[0] == arcp_load_phantom(&myarcps[0].rcp));
+	ASSERT(regions[1] == arcp_load_phantom(&myarcps[1].rcp));
+	ASSERT(versions[0] == ak_load(&myarcps[0].version, mo_relaxed));
+	ASSERT(versions[1] == ak_load(&myarcps[1].version, mo_relaxed));
+	ASSERT(arcp_usecount(regions[0]) == 1);
+	ASSERT(arcp_usecount(regions[1]) == 1);
+	arcp_release_n(regions, 2);
+	CHECKPOINT();
+	/* one writer always updates the first and then the second, so the
+	 * first can never be behind */
+	WITH_THREADS(NTHREADS) {
+		struct arcp_region *myregions[2];
+		uintptr_t myversions[2];
+		REPEAT(NREPEATS) {
+			if (thread_number == 0) {
+				versioned_increment(&myarcps[0]);
+				versioned_increment(&myarcps[1]);
+				continue;
+			}
+			arcp_load_snapshot(rcps, 2, myregions, myversions);
+			ASSERT(counter_value(myregions[0])
+			       - counter_value(myregions[1]) <= 1);
+			ASSERT(counter_value(myregions[0])
+			       - counter_value(myregions[1]) >= 0);
+			arcp_release_n(myregions, 2);
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	arcp_load_snapshot(rcps, 2, regions, versions);
+	ASSERT(counter_value(regions[0]) == NREPEATS + 1);
+	ASSERT(counter_value(regions[1]) == NREPEATS + 1);
+	arcp_release_n(regions, 2);
+	arcp_versioned_store(&myarcps[0], NULL);
+	arcp_versioned_store(&myarcps[1], NULL);
+}
+
+static void test_arcp_load_snapshot_aba() {
+	arcp_versioned_t myarcps[2];
+	arcp_versioned_t *rcps[2] = { &myarcps[0], &myarcps[1] };
+	struct arcp_region *a, *b, *w, *x;
+	CHECKPOINT();
+	a = arcp_alloc(sizeof(struct arcp_test_counter), NULL);
+	b = arcp_alloc(sizeof(struct arcp_test_counter), NULL);
+	w = arcp_alloc(sizeof(struct arcp_test_counter), NULL);
+	x = arcp_alloc(sizeof(struct arcp_test_counter), NULL);
+	ASSERT(a != NULL && b != NULL && w != NULL && x != NULL);
+	arcp_versioned_init(&myarcps[0], a);
+	arcp_versioned_init(&myarcps[1], w);
+	CHECKPOINT();
+	/* the writer cycles through (a, w), (b, w), (b, x), (b, w), so the
+	 * pointers never hold a and x at once, though each holds its half
+	 * again and again */
+	WITH_THREADS(NTHREADS) {
+		struct arcp_region *myregions[2];
+		uintptr_t myversions[2];
+		REPEAT(NREPEATS) {
+			if (thread_number == 0) {
+				arcp_versioned_store(&myarcps[0], b);
+				arcp_versioned_store(&myarcps[1], x);
+				arcp_versioned_store(&myarcps[1], w);
+				arcp_versioned_store(&myarcps[0], a);
+				continue;
+			}
+			arcp_load_snapshot(rcps, 2, myregions, myversions);
+			ASSERT(myregions[0] != a || myregions[1] != x);
+			arcp_release_n(myregions, 2);
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	arcp_versioned_store(&myarcps[0], NULL);
+	arcp_versioned_store(&myarcps[1], NULL);
+	arcp_release(a);
+	arcp_release(b);
+	arcp_release(w);
+	arcp_release(x);
+}
+
 /****************************/
 
 static void test_arcp_init_region_fixture(void (*test)()) {
@@ -165,6 +431,109 @@ static void test_arcp_acquire() {
 	} END_WITH_THREADS(NTHREADS);
 }
 
+#define NWIDE 40000
+
+static void test_arcp_wide_refcount() {
+#if ARCP_WIDE_REFCOUNT
+	arcp_t *arcps;
+	int i;
+	arcps = amalloc(sizeof(arcp_t) * NWIDE);
+	ASSERT(arcps != NULL);
+	CHECKPOINT();
+	for (i = 0; i < NWIDE; i++) {
+		arcp_init(&arcps[i], region1);
+		arcp_acquire(region1);
+	}
+	CHECKPOINT();
+	ASSERT(arcp_usecount(region1) == NWIDE + 1);
+	CHECKPOINT();
+	ASSERT(arcp_storecount(region1) == NWIDE);
+	CHECKPOINT();
+	for (i = 0; i < NWIDE; i++) {
+		arcp_store(&arcps[i], NULL);
+		arcp_release(region1);
+	}
+	CHECKPOINT();
+	ASSERT(arcp_usecount(region1) == 1);
+	CHECKPOINT();
+	ASSERT(arcp_storecount(region1) == 0);
+	ASSERT(!region1_destroyed);
+	afree(arcps, sizeof(arcp_t) * NWIDE);
+	arcp_release(region1);
+	ASSERT(region1_destroyed);
+#else
+	UNSUPPORTED("32-bit refcount layout");
+#endif
+}
+
+#define NBULK 1000
+
+static void test_arcp_acquire_n() {
+	struct arcp_region *regions[NBULK + 2];
+	int i;
+	for (i = 0; i < NBULK; i++) {
+		switch (i % 4) {
+		case 1:
+			regions[i] = (struct arcp_region *) region2;
+			break;
+		case 3:
+			regions[i] = NULL;
+			break;
+		default:
+			regions[i] = (struct arcp_region *) region1;
+		}
+	}
+	CHECKPOINT();
+	arcp_acquire_n(regions, NBULK);
+	CHECKPOINT();
+	ASSERT(arcp_usecount(region1) == 1 + NBULK / 2);
+	ASSERT(arcp_usecount(region2) == 1 + NBULK / 4);
+	/* release everything, including the initial references */
+	regions[NBULK] = (struct arcp_region *) region1;
+	regions[NBULK + 1] = (struct arcp_region *) region2;
+	CHECKPOINT();
+	arcp_release_n(regions, NBULK + 1);
+	CHECKPOINT();
+	ASSERT(region1_destroyed);
+	ASSERT(!region2_destroyed);
+	ASSERT(arcp_usecount(region2) == 1);
+	arcp_release_n(&regions[NBULK + 1], 1);
+	ASSERT(region2_destroyed);
+}
+
+static void test_arcp_stats() {
+#if ARCP_INSTRUMENT
+	struct arcp_stat stats[4];
+	arcp_t myarcp;
+	size_t n, i;
+	arcp_stats_reset();
+	arcp_init(&myarcp, region2);
+	for (i = 0; i < 3; i++) {
+		ASSERT(!arcp_cas(&myarcp, region1, region1));
+	}
+	CHECKPOINT();
+	n = arcp_stats_top(stats, 4);
+	ASSERT(n == 1);
+	ASSERT(stats[0].addr == &myarcp);
+	ASSERT(stats[0].count[ARCP_STAT_CAS_FAIL] == 3);
+	arcp_store(&myarcp, NULL);
+	arcp_release(region1);
+	arcp_release(region2);
+	CHECKPOINT();
+	n = arcp_stats_top(stats, 4);
+	ASSERT(n == 3);
+	for (i = 0; i < n; i++) {
+		if (stats[i].addr == (const void *) (uintptr_t) destroy_region1) {
+			break;
+		}
+	}
+	ASSERT(i < n);
+	ASSERT(stats[i].count[ARCP_STAT_DESTROY] == 1);
+#else
+	UNSUPPORTED("built without ARCP_INSTRUMENT");
+#endif
+}
+
 static void test_arcp_region_init_weakref() {
 	CHECKPOINT();
 	WITH_THREADS(NTHREADS) {
@@ -673,16 +1042,221 @@ static void test_arcp_swap() {
 	ASSERT(strcmp(region2->data, strtest.string2) == 0);
 }
 
+static void test_arcp_borrow() {
+	struct arcp_test_region *rg;
+	CHECKPOINT();
+	WITH_THREADS(NTHREADS) {
+		REPEAT(NREPEATS) {
+			struct arcp_test_region *rg;
+			rg = (struct arcp_test_region *) arcp_borrow(&arcp);
+			ASSERT(rg == region1);
+			ASSERT(strcmp(rg->data, strtest.string1) == 0);
+			ASSERT(!region1_destroyed);
+			arcp_unborrow(rg);
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(arcp_usecount(region1) == 1);
+	CHECKPOINT();
+	ASSERT(arcp_storecount(region1) == 1);
+	/* destruction waits for the borrow to end */
+	CHECKPOINT();
+	rg = (struct arcp_test_region *) arcp_borrow(&arcp);
+	ASSERT(rg == region1);
+	CHECKPOINT();
+	arcp_store(&arcp, NULL);
+	CHECKPOINT();
+	arcp_release(region1);
+	ASSERT(!region1_destroyed);
+	ASSERT(strcmp(rg->data, strtest.string1) == 0);
+	CHECKPOINT();
+	arcp_unborrow(rg);
+	ASSERT(region1_destroyed);
+	CHECKPOINT();
+	ASSERT(arcp_borrow(&arcp) == NULL);
+}
+
+static void test_arcp_borrow_many() {
+	struct arcp_region *rgs[ARCP_NBORROWS + 2];
+	int i;
+	CHECKPOINT();
+	for (i = 0; i < ARCP_NBORROWS + 2; i++) {
+		rgs[i] = arcp_borrow(&arcp);
+		ASSERT(rgs[i] == (struct arcp_region *) region1);
+	}
+	/* borrows past ARCP_NBORROWS take ordinary references */
+	CHECKPOINT();
+	ASSERT(arcp_usecount(region1) == 3);
+	CHECKPOINT();
+	for (i = 0; i < ARCP_NBORROWS + 2; i++) {
+		arcp_unborrow(rgs[i]);
+	}
+	CHECKPOINT();
+	ASSERT(arcp_usecount(region1) == 1);
+	ASSERT(!region1_destroyed);
+}
+
+static void test_arcp_borrow_store() {
+	CHECKPOINT();
+	WITH_THREADS(NTHREADS) {
+		REPEAT(NREPEATS) {
+			struct arcp_test_region *rg;
+			rg = (struct arcp_test_region *) arcp_borrow(&arcp);
+			ASSERT(rg == region1 || rg == region2);
+			ASSERT(!region1_destroyed);
+			ASSERT(!region2_destroyed);
+			ASSERT(strcmp(rg->data, rg == region1
+					      ? strtest.string1
+					      : strtest.string2) == 0);
+			arcp_unborrow(rg);
+			if (thread_number == 0) {
+				arcp_store(&arcp, region2);
+				arcp_store(&arcp, region1);
+			}
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(arcp_usecount(region2) == 1);
+	CHECKPOINT();
+	ASSERT(arcp_storecount(region2) == 0);
+	CHECKPOINT();
+	arcp_release(region2);
+	ASSERT(region2_destroyed);
+	ASSERT(!region1_destroyed);
+	CHECKPOINT();
+	arcp_store(&arcp, NULL);
+	ASSERT(!region1_destroyed);
+	CHECKPOINT();
+	arcp_release(region1);
+	ASSERT(region1_destroyed);
+}
+
+static void test_arcp_cached_load() {
+	arcp_versioned_t varcp;
+	struct arcp_cache cache = ARCP_CACHE_VAR_INIT;
+	struct arcp_test_region *rg;
+	CHECKPOINT();
+	arcp_versioned_init(&varcp, region1);
+	rg = (struct arcp_test_region *) arcp_cached_load(&varcp, &cache);
+	ASSERT(rg == region1);
+	ASSERT(arcp_usecount(region1) == 2);
+	CHECKPOINT();
+	/* a current cache takes no further references */
+	rg = (struct arcp_test_region *) arcp_cached_load(&varcp, &cache);
+	ASSERT(rg == region1);
+	ASSERT(arcp_usecount(region1) == 2);
+	CHECKPOINT();
+	arcp_versioned_store(&varcp, region2);
+	rg = (struct arcp_test_region *) arcp_cached_load(&varcp, &cache);
+	ASSERT(rg == region2);
+	ASSERT(arcp_usecount(region1) == 1);
+	ASSERT(arcp_usecount(region2) == 2);
+	CHECKPOINT();
+	arcp_cache_release(&cache);
+	ASSERT(arcp_usecount(region2) == 1);
+	arcp_versioned_store(&varcp, NULL);
+	ASSERT(arcp_storecount(region2) == 0);
+	ASSERT(!region2_destroyed);
+}
+
+/****************************/
+
+static void test_arcp_init_sharded_fixture(void (*test)()) {
+	region1_destroyed = false;
+	region2_destroyed = false;
+	region1 = alloca(sizeof(struct arcp_test_region)
+			 + strlen(strtest.string1) + 1);
+	strcpy(region1->data, strtest.string1);
+	CHECKPOINT();
+	ASSERT(arcp_region_init_sharded(region1, destroy_region1) == 0);
+	CHECKPOINT();
+	arcp_init(&arcp, region1);
+	test();
+}
+
+static void test_arcp_sharded_load() {
+	CHECKPOINT();
+	WITH_THREADS(NTHREADS) {
+		REPEAT(NREPEATS) {
+			struct arcp_test_region *rg;
+			rg = (struct arcp_test_region *) arcp_load(&arcp);
+			ASSERT(rg == region1);
+			arcp_acquire(rg);
+			arcp_release(rg);
+			ASSERT(strcmp(rg->data, strtest.string1) == 0);
+			ASSERT(!region1_destroyed);
+			arcp_release(rg);
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	arcp_store(&arcp, NULL);
+	CHECKPOINT();
+	ASSERT(arcp_usecount(region1) == 1);
+	CHECKPOINT();
+	ASSERT(arcp_storecount(region1) == 0);
+	ASSERT(!region1_destroyed);
+	CHECKPOINT();
+	arcp_release(region1);
+	ASSERT(region1_destroyed);
+}
+
+static void test_arcp_sharded_release() {
+	CHECKPOINT();
+	arcp_release(region1);
+	CHECKPOINT();
+	WITH_THREADS(NTHREADS) {
+		REPEAT(NREPEATS) {
+			struct arcp_test_region *rg;
+			rg = (struct arcp_test_region *) arcp_load(&arcp);
+			ASSERT(rg == region1);
+			arcp_release(rg);
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(!region1_destroyed);
+	region1 = (struct arcp_test_region *) arcp_load(&arcp);
+	CHECKPOINT();
+	arcp_store(&arcp, NULL);
+	CHECKPOINT();
+	WITH_THREADS(NTHREADS) {
+		REPEAT(NREPEATS) {
+			arcp_acquire(region1);
+			arcp_release(region1);
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(arcp_usecount(region1) == 1);
+	ASSERT(!region1_destroyed);
+	arcp_release(region1);
+	ASSERT(region1_destroyed);
+}
+
 int run_rcp_h_test_suite() {
 	int r;
-	void (*arcp_uninit_tests[])() = { test_arcp_region_init, NULL };
-	char *arcp_uninit_test_names[] = { "arcp_region_init", NULL };
+	void (*arcp_uninit_tests[])() = { test_arcp_region_init,
+					  test_arcp_alloc,
+					  test_arcp_alloc_weak,
+					  test_arcp_weakref_race,
+					  test_arcp_update,
+					  test_arcp_load_snapshot,
+					  test_arcp_load_snapshot_aba, NULL };
+	char *arcp_uninit_test_names[] = { "arcp_region_init", "arcp_alloc",
+					   "arcp_alloc_weak",
+					   "arcp_weakref_race", "arcp_update",
+					   "arcp_load_snapshot",
+					   "arcp_load_snapshot_aba", NULL };
 
 	void (*arcp_init_region_tests[])() = { test_arcp_init,
 					       test_arcp_acquire,
+					       test_arcp_wide_refcount,
+					       test_arcp_acquire_n,
+					       test_arcp_stats,
 					       test_arcp_region_init_weakref,
 					       NULL };
 	char *arcp_init_region_test_names[] = { "arcp_init", "arcp_acquire",
+						"arcp_wide_refcount",
+						"arcp_acquire_n",
+						"arcp_stats",
 						"arcp_region_init_weakref",
 						NULL };
 
@@ -701,7 +1275,10 @@ int run_rcp_h_test_suite() {
 					test_arcp_cas_release_fail,
 					test_arcp_cas_release_multithread,
 					test_arcp_store, test_arcp_release,
-					test_arcp_swap, NULL };
+					test_arcp_swap, test_arcp_borrow,
+					test_arcp_borrow_many,
+					test_arcp_borrow_store,
+					test_arcp_cached_load, NULL };
 
 	char *arcp_init_test_names[] = { "arcp_load", "arcp_load_phantom",
 					 "arcp_cas",
@@ -709,7 +1286,17 @@ int run_rcp_h_test_suite() {
 					 "arcp_cas_release_fail",
 					 "arcp_cas_release_multithread",
 					 "arcp_store", "arcp_release",
-					 "arcp_swap", NULL };
+					 "arcp_swap", "arcp_borrow",
+					 "arcp_borrow_many",
+					 "arcp_borrow_store",
+					 "arcp_cached_load", NULL };
+
+	void (*arcp_init_sharded_tests[])() = { test_arcp_sharded_load,
+						test_arcp_sharded_release,
+						NULL };
+	char *arcp_init_sharded_test_names[] = { "arcp_sharded_load",
+						 "arcp_sharded_release",
+						 NULL };
 
 	r = run_test_suite(test_arcp_uninit_fixture,
 			   arcp_uninit_test_names, arcp_uninit_tests);
@@ -737,5 +1324,12 @@ int run_rcp_h_test_suite() {
 		return r;
 	}
 
+	r = run_test_suite(test_arcp_init_sharded_fixture,
+			   arcp_init_sharded_test_names,
+			   arcp_init_sharded_tests);
+	if (r != 0) {
+		return r;
+	}
+
 	return 0;
 }
@@ -0,0 +1,236 @@
+/*
+ * test_ring_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include <alloca.h>
+#include <atomickit/rcp.h>
+#include <atomickit/ring.h>
+#include "alltests.h"
+#include "test.h"
+
+static struct {
+	char string1[14];
+	char string2[14];
+} ptrtest = { "Test String 1", "Test String 2" };
+
+static bool region1_destroyed;
+static bool region2_destroyed;
+
+static void destroy_region1(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region1_destroyed = true;
+}
+
+static void destroy_region2(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region2_destroyed = true;
+}
+
+struct arcp_test_region {
+	struct arcp_region;
+	char data[];
+};
+
+static struct arcp_test_region *region1;
+static struct arcp_test_region *region2;
+
+static aring_t ring;
+
+#define NTHREADS 8
+#define NREPEATS 1000
+#define RING_SIZE 8
+
+struct aring_test_item {
+	struct arcp_region;
+	int producer;
+	int seq;
+	atomic_bool dequeued;
+};
+
+static struct aring_test_item items[NTHREADS / 2][NREPEATS];
+
+/****************************/
+static void test_aring_init() {
+	int r;
+	CHECKPOINT();
+	r = aring_init(&ring, 5);
+	ASSERT(r == 0);
+	ASSERT(aring_capacity(&ring) == 8);
+	ASSERT(aring_try_deq(&ring) == NULL);
+	CHECKPOINT();
+	aring_destroy(&ring);
+}
+
+/****************************/
+
+static void test_aring_init_fixture(void (*test)()) {
+	int r;
+	CHECKPOINT();
+	region1_destroyed = false;
+	region2_destroyed = false;
+	region1 = alloca(sizeof(struct arcp_test_region) + 14);
+	region2 = alloca(sizeof(struct arcp_test_region) + 14);
+	strcpy(region1->data, ptrtest.string1);
+	strcpy(region2->data, ptrtest.string2);
+	arcp_region_init(region1, destroy_region1);
+	arcp_region_init(region2, destroy_region2);
+	CHECKPOINT();
+	r = aring_init(&ring, RING_SIZE);
+	if (r != 0) {
+		UNRESOLVED("aring_init failed");
+	}
+	test();
+}
+
+static void test_aring_enq() {
+	CHECKPOINT();
+	ASSERT(aring_try_enq(&ring, region1));
+	ASSERT(aring_try_enq(&ring, region2));
+	ASSERT(arcp_usecount(region1) == 2);
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	CHECKPOINT();
+	region1 = (struct arcp_test_region *) aring_try_deq(&ring);
+	region2 = (struct arcp_test_region *) aring_try_deq(&ring);
+	ASSERT(strcmp(region1->data, ptrtest.string1) == 0);
+	ASSERT(strcmp(region2->data, ptrtest.string2) == 0);
+	ASSERT(aring_try_deq(&ring) == NULL);
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+	aring_destroy(&ring);
+}
+
+static void test_aring_full() {
+	int i;
+	CHECKPOINT();
+	for (i = 0; i < RING_SIZE; i++) {
+		ASSERT(aring_try_enq(&ring, i % 2 ? region2 : region1));
+	}
+	ASSERT(!aring_try_enq(&ring, region1));
+	ASSERT(arcp_usecount(region1) == 1 + RING_SIZE / 2);
+	CHECKPOINT();
+	/* wrap around a few times */
+	for (i = 0; i < 3 * RING_SIZE; i++) {
+		ASSERT(aring_try_deq(&ring)
+		       == (struct arcp_region *) (i % 2 ? region2 : region1));
+		arcp_release(i % 2 ? region2 : region1);
+		ASSERT(aring_try_enq(&ring, i % 2 ? region2 : region1));
+	}
+	ASSERT(!aring_try_enq(&ring, region1));
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	aring_destroy(&ring);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+}
+
+static void test_aring_multithread() {
+	atomic_int ndequeued = ATOMIC_VAR_INIT(0);
+	int i, j;
+	CHECKPOINT();
+	for (i = 0; i < NTHREADS / 2; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			arcp_region_init(&items[i][j], NULL);
+			items[i][j].producer = i;
+			items[i][j].seq = j;
+			ak_init(&items[i][j].dequeued, false);
+		}
+	}
+	CHECKPOINT();
+	/* half the threads produce, and half consume */
+	WITH_THREADS(NTHREADS) {
+		struct aring_test_item *item;
+		int last[NTHREADS / 2];
+		int k;
+		if (thread_number % 2) {
+			for (k = 0; k < NREPEATS; k++) {
+				item = &items[thread_number / 2][k];
+				while (!aring_try_enq(&ring, item)) {
+					cpu_yield();
+				}
+			}
+		} else {
+			for (k = 0; k < NTHREADS / 2; k++) {
+				last[k] = -1;
+			}
+			while (ak_load(&ndequeued, mo_relaxed)
+			       < NTHREADS / 2 * NREPEATS) {
+				item = (struct aring_test_item *)
+					aring_try_deq(&ring);
+				if (item == NULL) {
+					cpu_yield();
+					continue;
+				}
+				ak_ldadd(&ndequeued, 1, mo_relaxed);
+				/* each producer's items arrive in order */
+				ASSERT(item->seq > last[item->producer]);
+				last[item->producer] = item->seq;
+				ASSERT(!ak_swap(&item->dequeued, true,
+						mo_relaxed));
+				arcp_release(item);
+			}
+		}
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(ak_load(&ndequeued, mo_relaxed) == NTHREADS / 2 * NREPEATS);
+	ASSERT(aring_try_deq(&ring) == NULL);
+	for (i = 0; i < NTHREADS / 2; i++) {
+		for (j = 0; j < NREPEATS; j++) {
+			ASSERT(ak_load(&items[i][j].dequeued, mo_relaxed));
+			ASSERT(arcp_usecount(&items[i][j]) == 1);
+		}
+	}
+	arcp_release(region1);
+	arcp_release(region2);
+	aring_destroy(&ring);
+}
+
+int run_ring_h_test_suite() {
+	int r;
+	void (*void_tests[])() = { test_aring_init, NULL };
+	char *void_test_names[] = { "aring_init", NULL };
+
+	void (*aring_init_tests[])() = { test_aring_enq, test_aring_full,
+					 test_aring_multithread, NULL };
+	char *aring_init_test_names[] = { "aring_enq", "aring_full",
+					  "aring_multithread", NULL };
+
+	r = run_test_suite(NULL, void_test_names, void_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	r = run_test_suite(test_aring_init_fixture,
+			   aring_init_test_names, aring_init_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
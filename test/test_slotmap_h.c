@@ -0,0 +1,226 @@
+/*
+ * test_slotmap_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ * 
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ * 
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include <alloca.h>
+#include <atomickit/rcp.h>
+#include <atomickit/slotmap.h>
+#include "alltests.h"
+#include "test.h"
+
+static struct {
+	char string1[14];
+	char string2[14];
+} ptrtest = { "Test String 1", "Test String 2" };
+
+static bool region1_destroyed;
+static bool region2_destroyed;
+
+static void destroy_region1(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region1_destroyed = true;
+}
+
+static void destroy_region2(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region2_destroyed = true;
+}
+
+struct arcp_test_region {
+	struct arcp_region;
+	char data[];
+};
+
+static struct arcp_test_region *region1;
+static struct arcp_test_region *region2;
+
+static aslotmap_t slotmap;
+
+#define NTHREADS 8
+#define NREPEATS 1000
+#define NGROW 1000
+
+/****************************/
+static void test_aslotmap_init() {
+	int r;
+	CHECKPOINT();
+	r = aslotmap_init(&slotmap);
+	ASSERT(r == 0);
+	ASSERT(!aslotmap_valid(&slotmap, ASLOT_NULL));
+	ASSERT(aslotmap_get(&slotmap, ASLOT_NULL) == NULL);
+	CHECKPOINT();
+	aslotmap_destroy(&slotmap);
+}
+
+/****************************/
+
+static void test_aslotmap_init_fixture(void (*test)()) {
+	int r;
+	CHECKPOINT();
+	region1_destroyed = false;
+	region2_destroyed = false;
+	region1 = alloca(sizeof(struct arcp_test_region) + 14);
+	region2 = alloca(sizeof(struct arcp_test_region) + 14);
+	strcpy(region1->data, ptrtest.string1);
+	strcpy(region2->data, ptrtest.string2);
+	arcp_region_init(region1, destroy_region1);
+	arcp_region_init(region2, destroy_region2);
+	CHECKPOINT();
+	r = aslotmap_init(&slotmap);
+	if (r != 0) {
+		UNRESOLVED("aslotmap_init failed");
+	}
+	test();
+}
+
+static void test_aslotmap_insert() {
+	aslot_t handle1, handle2;
+	struct arcp_test_region *rg;
+	CHECKPOINT();
+	handle1 = aslotmap_insert(&slotmap, region1);
+	ASSERT(handle1 != ASLOT_NULL);
+	handle2 = aslotmap_insert(&slotmap, region2);
+	ASSERT(handle2 != ASLOT_NULL);
+	ASSERT(handle1 != handle2);
+	ASSERT(arcp_storecount(region1) == 1);
+	CHECKPOINT();
+	ASSERT(aslotmap_valid(&slotmap, handle1));
+	rg = (struct arcp_test_region *) aslotmap_get(&slotmap, handle1);
+	ASSERT(rg == region1);
+	ASSERT(arcp_usecount(region1) == 2);
+	arcp_release(rg);
+	rg = (struct arcp_test_region *) aslotmap_get(&slotmap, handle2);
+	ASSERT(rg == region2);
+	arcp_release(rg);
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	aslotmap_destroy(&slotmap);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+}
+
+static void test_aslotmap_remove() {
+	aslot_t handle1, handle2;
+	struct arcp_test_region *rg;
+	CHECKPOINT();
+	handle1 = aslotmap_insert(&slotmap, region1);
+	arcp_release(region1);
+	ASSERT(aslotmap_remove(&slotmap, handle1));
+	ASSERT(region1_destroyed);
+	CHECKPOINT();
+	/* the handle is stale */
+	ASSERT(!aslotmap_valid(&slotmap, handle1));
+	ASSERT(aslotmap_get(&slotmap, handle1) == NULL);
+	ASSERT(!aslotmap_remove(&slotmap, handle1));
+	CHECKPOINT();
+	/* the slot is reused, but with a new generation */
+	handle2 = aslotmap_insert(&slotmap, region2);
+	ASSERT(handle2 != handle1);
+	ASSERT((uint32_t) handle2 == (uint32_t) handle1);
+	ASSERT(!aslotmap_valid(&slotmap, handle1));
+	ASSERT(aslotmap_get(&slotmap, handle1) == NULL);
+	rg = (struct arcp_test_region *) aslotmap_get(&slotmap, handle2);
+	ASSERT(rg == region2);
+	arcp_release(rg);
+	CHECKPOINT();
+	aslotmap_destroy(&slotmap);
+	arcp_release(region2);
+	ASSERT(region2_destroyed);
+}
+
+static void test_aslotmap_grow() {
+	aslot_t handles[NGROW];
+	int i;
+	CHECKPOINT();
+	for (i = 0; i < NGROW; i++) {
+		handles[i] = aslotmap_insert(&slotmap,
+					     i % 2 ? region1 : region2);
+		ASSERT(handles[i] != ASLOT_NULL);
+	}
+	ASSERT(arcp_storecount(region1) == NGROW / 2);
+	CHECKPOINT();
+	for (i = 0; i < NGROW; i++) {
+		ASSERT(aslotmap_get(&slotmap, handles[i])
+		       == (struct arcp_region *) (i % 2 ? region1 : region2));
+		arcp_release(i % 2 ? region1 : region2);
+	}
+	CHECKPOINT();
+	for (i = 0; i < NGROW; i += 2) {
+		ASSERT(aslotmap_remove(&slotmap, handles[i]));
+	}
+	ASSERT(arcp_storecount(region2) == 0);
+	aslotmap_destroy(&slotmap);
+	ASSERT(arcp_storecount(region1) == 0);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+}
+
+static void test_aslotmap_multithread() {
+	CHECKPOINT();
+	WITH_THREADS(NTHREADS) {
+		aslot_t handle;
+		struct arcp_region *rg;
+		REPEAT(NREPEATS) {
+			handle = aslotmap_insert(&slotmap, region1);
+			ASSERT(handle != ASLOT_NULL);
+			rg = aslotmap_get(&slotmap, handle);
+			ASSERT(rg == (struct arcp_region *) region1);
+			arcp_release(rg);
+			ASSERT(aslotmap_remove(&slotmap, handle));
+			ASSERT(!aslotmap_valid(&slotmap, handle));
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(arcp_storecount(region1) == 0);
+	/* slots were reused rather than handed out fresh each time */
+	ASSERT(ak_load(&slotmap.top, mo_relaxed) <= NTHREADS);
+	aslotmap_destroy(&slotmap);
+	ASSERT(!region1_destroyed);
+}
+
+int run_slotmap_h_test_suite() {
+	int r;
+	void (*void_tests[])() = { test_aslotmap_init, NULL };
+	char *void_test_names[] = { "aslotmap_init", NULL };
+
+	void (*aslotmap_init_tests[])() = { test_aslotmap_insert,
+					    test_aslotmap_remove,
+					    test_aslotmap_grow,
+					    test_aslotmap_multithread, NULL };
+	char *aslotmap_init_test_names[] = { "aslotmap_insert",
+					     "aslotmap_remove",
+					     "aslotmap_grow",
+					     "aslotmap_multithread", NULL };
+
+	r = run_test_suite(NULL, void_test_names, void_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	r = run_test_suite(test_aslotmap_init_fixture,
+			   aslotmap_init_test_names, aslotmap_init_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
@@ -0,0 +1,274 @@
+/*
+ * test_spsc_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ *
+ * This file is part of Atomic Kit.
+ *
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ *
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include <alloca.h>
+#include <atomickit/rcp.h>
+#include <atomickit/spsc.h>
+#include "alltests.h"
+#include "test.h"
+
+static struct {
+	char string1[14];
+	char string2[14];
+} ptrtest = { "Test String 1", "Test String 2" };
+
+static bool region1_destroyed;
+static bool region2_destroyed;
+
+static void destroy_region1(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region1_destroyed = true;
+}
+
+static void destroy_region2(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region2_destroyed = true;
+}
+
+struct arcp_test_region {
+	struct arcp_region;
+	char data[];
+};
+
+static struct arcp_test_region *region1;
+static struct arcp_test_region *region2;
+
+static aspsc_t spsc;
+
+#define NITEMS 10000
+#define SPSC_SIZE 16
+
+/* a payload which isn't a power of two in size */
+struct frame {
+	int seq;
+	short sample[3];
+};
+
+/****************************/
+static void test_aspsc_init() {
+	struct frame frame;
+	int r;
+	CHECKPOINT();
+	r = aspsc_init(&spsc, 5, sizeof(struct frame));
+	ASSERT(r == 0);
+	ASSERT(spsc.mask + 1 == 8);
+	ASSERT(!aspsc_pop(&spsc, &frame));
+	CHECKPOINT();
+	aspsc_destroy(&spsc);
+	ASSERT(aspsc_init(&spsc, 5, 0) != 0);
+}
+
+static void test_aspsc_bytes() {
+	struct frame in[SPSC_SIZE + 4], out[SPSC_SIZE + 4];
+	int i;
+	CHECKPOINT();
+	if (aspsc_init(&spsc, SPSC_SIZE, sizeof(struct frame)) != 0) {
+		UNRESOLVED("aspsc_init failed");
+	}
+	for (i = 0; i < SPSC_SIZE + 4; i++) {
+		in[i].seq = i;
+		in[i].sample[0] = i;
+		in[i].sample[1] = -i;
+		in[i].sample[2] = 2 * i;
+	}
+	ASSERT(aspsc_push(&spsc, &in[0]));
+	ASSERT(aspsc_pop(&spsc, &out[0]));
+	ASSERT(memcmp(&in[0], &out[0], sizeof(struct frame)) == 0);
+	ASSERT(!aspsc_pop(&spsc, &out[0]));
+	CHECKPOINT();
+	/* a bulk push only pushes what fits, wrapping around the end */
+	ASSERT(aspsc_push_n(&spsc, &in[1], SPSC_SIZE + 3) == SPSC_SIZE);
+	ASSERT(!aspsc_push(&spsc, &in[0]));
+	ASSERT(aspsc_pop_n(&spsc, out, 3) == 3);
+	ASSERT(aspsc_push_n(&spsc, &in[SPSC_SIZE + 1], 3) == 3);
+	ASSERT(aspsc_pop_n(&spsc, &out[3], SPSC_SIZE + 1) == SPSC_SIZE);
+	ASSERT(memcmp(&in[1], out, sizeof(struct frame) * (SPSC_SIZE + 3))
+	       == 0);
+	ASSERT(aspsc_pop_n(&spsc, out, SPSC_SIZE) == 0);
+	aspsc_destroy(&spsc);
+}
+
+/****************************/
+
+static void test_aspsc_region_fixture(void (*test)()) {
+	int r;
+	CHECKPOINT();
+	region1_destroyed = false;
+	region2_destroyed = false;
+	region1 = alloca(sizeof(struct arcp_test_region) + 14);
+	region2 = alloca(sizeof(struct arcp_test_region) + 14);
+	strcpy(region1->data, ptrtest.string1);
+	strcpy(region2->data, ptrtest.string2);
+	arcp_region_init(region1, destroy_region1);
+	arcp_region_init(region2, destroy_region2);
+	CHECKPOINT();
+	r = aspsc_init(&spsc, SPSC_SIZE, sizeof(struct arcp_region *));
+	if (r != 0) {
+		UNRESOLVED("aspsc_init failed");
+	}
+	test();
+}
+
+static void test_aspsc_region() {
+	struct arcp_region *regions[SPSC_SIZE + 1];
+	int i;
+	CHECKPOINT();
+	ASSERT(aspsc_push_region(&spsc, region1));
+	ASSERT(aspsc_push_region(&spsc, region2));
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(!region1_destroyed);
+	ASSERT(!region2_destroyed);
+	CHECKPOINT();
+	region1 = (struct arcp_test_region *) aspsc_pop_region(&spsc);
+	region2 = (struct arcp_test_region *) aspsc_pop_region(&spsc);
+	ASSERT(strcmp(region1->data, ptrtest.string1) == 0);
+	ASSERT(strcmp(region2->data, ptrtest.string2) == 0);
+	ASSERT(aspsc_pop_region(&spsc) == NULL);
+	CHECKPOINT();
+	/* only the regions that fit are acquired */
+	for (i = 0; i < SPSC_SIZE + 1; i++) {
+		regions[i] = (struct arcp_region *) (i % 2 ? region2 : region1);
+	}
+	ASSERT(aspsc_push_region_n(&spsc, regions, SPSC_SIZE + 1)
+	       == SPSC_SIZE);
+	ASSERT(arcp_usecount(region1) == 1 + SPSC_SIZE / 2);
+	ASSERT(arcp_usecount(region2) == 1 + SPSC_SIZE / 2);
+	memset(regions, 0, sizeof(regions));
+	ASSERT(aspsc_pop_region_n(&spsc, regions, SPSC_SIZE + 1)
+	       == SPSC_SIZE);
+	for (i = 0; i < SPSC_SIZE; i++) {
+		ASSERT(regions[i]
+		       == (struct arcp_region *) (i % 2 ? region2 : region1));
+	}
+	arcp_release_n(regions, SPSC_SIZE);
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+	aspsc_destroy(&spsc);
+}
+
+static void test_aspsc_multithread() {
+	CHECKPOINT();
+	WITH_THREADS(2) {
+		struct arcp_region *regions[7];
+		size_t n, k;
+		int i;
+		for (i = 0; i < 7; i++) {
+			regions[i] = (struct arcp_region *) region1;
+		}
+		if (thread_number == 0) {
+			/* produce in uneven batches */
+			for (i = 0; i < NITEMS; i += n) {
+				n = aspsc_push_region_n(&spsc, regions,
+							NITEMS - i < 7
+							? NITEMS - i : 7);
+				if (n == 0) {
+					cpu_yield();
+				}
+			}
+		} else {
+			for (i = 0; i < NITEMS; i += n) {
+				n = aspsc_pop_region_n(&spsc, regions,
+						       (i % 5) + 1);
+				for (k = 0; k < n; k++) {
+					ASSERT(regions[k]
+					       == (struct arcp_region *)
+					       region1);
+				}
+				arcp_release_n(regions, n);
+				if (n == 0) {
+					cpu_yield();
+				}
+			}
+		}
+	} END_WITH_THREADS(2);
+	CHECKPOINT();
+	ASSERT(aspsc_pop_region(&spsc) == NULL);
+	ASSERT(arcp_usecount(region1) == 1);
+	arcp_release(region1);
+	arcp_release(region2);
+	ASSERT(region1_destroyed);
+	aspsc_destroy(&spsc);
+}
+
+static void test_aspsc_order() {
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	aspsc_destroy(&spsc);
+	if (aspsc_init(&spsc, SPSC_SIZE, sizeof(int)) != 0) {
+		UNRESOLVED("aspsc_init failed");
+	}
+	CHECKPOINT();
+	WITH_THREADS(2) {
+		int buf[5];
+		size_t n, k;
+		int i;
+		if (thread_number == 0) {
+			for (i = 0; i < NITEMS; i++) {
+				while (!aspsc_push(&spsc, &i)) {
+					cpu_yield();
+				}
+			}
+		} else {
+			for (i = 0; i < NITEMS; i += n) {
+				n = aspsc_pop_n(&spsc, buf, 5);
+				for (k = 0; k < n; k++) {
+					ASSERT(buf[k] == i + (int) k);
+				}
+				if (n == 0) {
+					cpu_yield();
+				}
+			}
+		}
+	} END_WITH_THREADS(2);
+	aspsc_destroy(&spsc);
+}
+
+int run_spsc_h_test_suite() {
+	int r;
+	void (*void_tests[])() = { test_aspsc_init, test_aspsc_bytes, NULL };
+	char *void_test_names[] = { "aspsc_init", "aspsc_bytes", NULL };
+
+	void (*aspsc_region_tests[])() = { test_aspsc_region,
+					   test_aspsc_multithread,
+					   test_aspsc_order, NULL };
+	char *aspsc_region_test_names[] = { "aspsc_region",
+					    "aspsc_multithread",
+					    "aspsc_order", NULL };
+
+	r = run_test_suite(NULL, void_test_names, void_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	r = run_test_suite(test_aspsc_region_fixture,
+			   aspsc_region_test_names, aspsc_region_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}
@@ -0,0 +1,399 @@
+/*
+ * test_txn_h.c
+ *
+ * Copyright 2014 Evan Buswell
+ * 
+ * This file is part of Atomic Kit.
+ * 
+ * Atomic Kit is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 2.
+ * 
+ * Atomic Kit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Atomic Kit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include <alloca.h>
+#include <atomickit/rcp.h>
+#include <atomickit/txn.h>
+#include "alltests.h"
+#include "test.h"
+
+static bool region1_destroyed;
+static bool region2_destroyed;
+static bool region3_destroyed;
+
+static void destroy_region1(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region1_destroyed = true;
+}
+
+static void destroy_region2(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region2_destroyed = true;
+}
+
+static void destroy_region3(struct arcp_region *region
+			    __attribute__((unused))) {
+	CHECKPOINT();
+	region3_destroyed = true;
+}
+
+static struct arcp_region *region1;
+static struct arcp_region *region2;
+static struct arcp_region *region3;
+
+static arcp_t rcp1;
+static arcp_t rcp2;
+
+struct atxn_test_counter {
+	struct arcp_region;
+	long value;
+};
+
+static atomic_long live_counters;
+
+static void finalize_counter(struct arcp_region *region
+			     __attribute__((unused))) {
+	ak_ldsub(&live_counters, 1, mo_relaxed);
+}
+
+static struct arcp_region *new_counter(long value) {
+	struct atxn_test_counter *counter;
+	counter = arcp_alloc(sizeof(struct atxn_test_counter),
+			     finalize_counter);
+	if (counter == NULL) {
+		return NULL;
+	}
+	ak_ldadd(&live_counters, 1, mo_relaxed);
+	counter->value = value;
+	return (struct arcp_region *) counter;
+}
+
+static long counter_value(struct arcp_region *region) {
+	return ((struct atxn_test_counter *) region)->value;
+}
+
+static int increment_counter(struct arcp_region *oldregion,
+			     struct arcp_region **newregion,
+			     void *arg __attribute__((unused))) {
+	*newregion = new_counter(counter_value(oldregion) + 1);
+	return *newregion == NULL ? -1 : 0;
+}
+
+#define NTHREADS 8
+#define NREPEATS 1000
+#define NMANY 16
+/* enough transactions that some are preempted part way through */
+#define NSWAPPED 200000
+
+/****************************/
+static void test_atxn_fixture(void (*test)()) {
+	CHECKPOINT();
+	if (!ATXN_AVAILABLE) {
+		UNSUPPORTED("transactions need 64-bit pointers");
+	}
+	region1_destroyed = false;
+	region2_destroyed = false;
+	region3_destroyed = false;
+	region1 = alloca(sizeof(struct arcp_region));
+	region2 = alloca(sizeof(struct arcp_region));
+	region3 = alloca(sizeof(struct arcp_region));
+	arcp_region_init(region1, destroy_region1);
+	arcp_region_init(region2, destroy_region2);
+	arcp_region_init(region3, destroy_region3);
+	arcp_init(&rcp1, region1);
+	arcp_init(&rcp2, region2);
+	test();
+}
+
+static void test_atxn_commit() {
+	struct atxn *txn;
+	struct arcp_region *a, *b;
+	arcp_t many[NMANY];
+	int i;
+	CHECKPOINT();
+	txn = atxn_begin();
+	ASSERT(txn != NULL);
+	a = atxn_load(txn, &rcp1);
+	b = atxn_load(txn, &rcp2);
+	ASSERT(a == region1);
+	ASSERT(b == region2);
+	atxn_store(txn, &rcp1, b);
+	atxn_store(txn, &rcp2, a);
+	/* loading again gives the value to be stored */
+	ASSERT(atxn_load(txn, &rcp1) == region2);
+	arcp_release(region2);
+	/* nothing is visible until commit */
+	ASSERT(arcp_load_phantom(&rcp1) == region1);
+	arcp_release(a);
+	arcp_release(b);
+	CHECKPOINT();
+	ASSERT(atxn_commit(txn));
+	ASSERT(arcp_load_phantom(&rcp1) == region2);
+	ASSERT(arcp_load_phantom(&rcp2) == region1);
+	ASSERT(arcp_storecount(region1) == 1);
+	ASSERT(arcp_storecount(region2) == 1);
+	ASSERT(arcp_usecount(region1) == 1);
+	ASSERT(arcp_usecount(region2) == 1);
+	CHECKPOINT();
+	/* more pointers than fit in the transaction itself */
+	for (i = 0; i < NMANY; i++) {
+		arcp_init(&many[i], region3);
+	}
+	txn = atxn_begin();
+	ASSERT(txn != NULL);
+	for (i = NMANY - 1; i >= 0; i--) {
+		atxn_cas(txn, &many[i], region3, i % 2 ? region1 : NULL);
+	}
+	ASSERT(atxn_commit(txn));
+	for (i = 0; i < NMANY; i++) {
+		ASSERT(arcp_load_phantom(&many[i])
+		       == (i % 2 ? region1 : NULL));
+	}
+	ASSERT(arcp_storecount(region1) == 1 + NMANY / 2);
+	ASSERT(arcp_storecount(region3) == 0);
+	for (i = 0; i < NMANY; i++) {
+		arcp_store(&many[i], NULL);
+	}
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	arcp_release(region3);
+	ASSERT(region3_destroyed);
+	arcp_store(&rcp1, NULL);
+	arcp_store(&rcp2, NULL);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+}
+
+static void test_atxn_fail() {
+	struct atxn *txn;
+	CHECKPOINT();
+	txn = atxn_begin();
+	ASSERT(txn != NULL);
+	atxn_cas(txn, &rcp2, region2, region3);
+	atxn_cas(txn, &rcp1, region2, region3);
+	ASSERT(!atxn_commit(txn));
+	ASSERT(arcp_load_phantom(&rcp1) == region1);
+	ASSERT(arcp_load_phantom(&rcp2) == region2);
+	ASSERT(arcp_storecount(region3) == 0);
+	ASSERT(arcp_usecount(region3) == 1);
+	CHECKPOINT();
+	/* inconsistent compare and swaps of one pointer */
+	txn = atxn_begin();
+	ASSERT(txn != NULL);
+	atxn_cas(txn, &rcp1, region1, region3);
+	atxn_cas(txn, &rcp1, region1, region2);
+	ASSERT(!atxn_commit(txn));
+	ASSERT(arcp_load_phantom(&rcp1) == region1);
+	CHECKPOINT();
+	/* abandoned */
+	txn = atxn_begin();
+	ASSERT(txn != NULL);
+	atxn_store(txn, &rcp1, region3);
+	atxn_abort(txn);
+	ASSERT(arcp_load_phantom(&rcp1) == region1);
+	ASSERT(arcp_usecount(region3) == 1);
+	CHECKPOINT();
+	arcp_release(region1);
+	arcp_release(region2);
+	arcp_release(region3);
+	ASSERT(region3_destroyed);
+	arcp_store(&rcp1, NULL);
+	arcp_store(&rcp2, NULL);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+}
+
+static void test_atxn_multithread() {
+	CHECKPOINT();
+	WITH_THREADS(NTHREADS) {
+		struct atxn *txn;
+		struct arcp_region *a, *b;
+		bool committed;
+		REPEAT(NREPEATS) {
+			do {
+				txn = atxn_begin();
+				ASSERT(txn != NULL);
+				a = atxn_load(txn, &rcp1);
+				b = atxn_load(txn, &rcp2);
+				if (thread_number % 2) {
+					/* swap */
+					atxn_store(txn, &rcp1, b);
+					atxn_store(txn, &rcp2, a);
+				}
+				committed = atxn_commit(txn);
+				if (committed) {
+					/* a consistent snapshot */
+					ASSERT(a != b);
+				}
+				arcp_release(a);
+				arcp_release(b);
+			} while (!committed);
+			/* plain loads see one of the two */
+			a = arcp_load(&rcp1);
+			ASSERT(a == region1 || a == region2);
+			arcp_release(a);
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	ASSERT(arcp_load_phantom(&rcp1) != arcp_load_phantom(&rcp2));
+	ASSERT(arcp_storecount(region1) == 1);
+	ASSERT(arcp_storecount(region2) == 1);
+	ASSERT(arcp_usecount(region1) == 1);
+	ASSERT(arcp_usecount(region2) == 1);
+	arcp_release(region1);
+	arcp_release(region2);
+	arcp_release(region3);
+	arcp_store(&rcp1, NULL);
+	arcp_store(&rcp2, NULL);
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+}
+
+static void test_atxn_writers() {
+	struct arcp_region *region;
+	CHECKPOINT();
+	ak_init(&live_counters, 0);
+	arcp_release(region1);
+	arcp_release(region2);
+	arcp_store(&rcp1, new_counter(0));
+	arcp_release(arcp_load_phantom(&rcp1));
+	arcp_store(&rcp2, new_counter(0));
+	arcp_release(arcp_load_phantom(&rcp2));
+	ASSERT(region1_destroyed);
+	ASSERT(region2_destroyed);
+	CHECKPOINT();
+	/* transactions increment both counters while plain writers
+	 * increment only the first */
+	WITH_THREADS(NTHREADS) {
+		struct atxn *txn;
+		struct arcp_region *a, *b, *na, *nb;
+		REPEAT(NREPEATS) {
+			if (thread_number % 2) {
+				ASSERT(arcp_update(&rcp1, increment_counter,
+						   NULL) == 0);
+				continue;
+			}
+			do {
+				txn = atxn_begin();
+				ASSERT(txn != NULL);
+				a = atxn_load(txn, &rcp1);
+				b = atxn_load(txn, &rcp2);
+				na = new_counter(counter_value(a) + 1);
+				nb = new_counter(counter_value(b) + 1);
+				ASSERT(na != NULL && nb != NULL);
+				atxn_store(txn, &rcp1, na);
+				atxn_store(txn, &rcp2, nb);
+				arcp_release(a);
+				arcp_release(b);
+				arcp_release(na);
+				arcp_release(nb);
+			} while (!atxn_commit(txn));
+		} END_REPEAT(NREPEATS);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	region = arcp_load(&rcp1);
+	ASSERT(counter_value(region) == NTHREADS * NREPEATS);
+	arcp_release(region);
+	region = arcp_load(&rcp2);
+	ASSERT(counter_value(region) == NTHREADS / 2 * NREPEATS);
+	arcp_release(region);
+	CHECKPOINT();
+	arcp_store(&rcp1, NULL);
+	arcp_store(&rcp2, NULL);
+	ASSERT(ak_load(&live_counters, mo_relaxed) == 0);
+	arcp_release(region3);
+}
+
+static void test_atxn_swappers() {
+	struct arcp_region *region;
+	atomic_int ndone = ATOMIC_VAR_INIT(0);
+	CHECKPOINT();
+	ak_init(&live_counters, 0);
+	arcp_release(region1);
+	arcp_release(region2);
+	arcp_store(&rcp1, new_counter(0));
+	arcp_release(arcp_load_phantom(&rcp1));
+	arcp_store(&rcp2, new_counter(0));
+	arcp_release(arcp_load_phantom(&rcp2));
+	CHECKPOINT();
+	/* transactions increment both counters while plain writers reset
+	 * the first, taking out whatever descriptor is there, for as long as
+	 * the transactions run */
+	WITH_THREADS(NTHREADS) {
+		struct atxn *txn;
+		struct arcp_region *a, *b, *na, *nb;
+		int i;
+		if (thread_number % 2) {
+			i = 0;
+			while (ak_load(&ndone, mo_relaxed) < NTHREADS / 2) {
+				na = new_counter(0);
+				ASSERT(na != NULL);
+				if (i++ % 2) {
+					a = arcp_swap(&rcp1, na);
+					ASSERT(a != NULL);
+					ASSERT(counter_value(a) >= 0);
+					arcp_release(a);
+				} else {
+					arcp_store(&rcp1, na);
+				}
+				arcp_release(na);
+			}
+			return NULL;
+		}
+		for (i = 0; i < NSWAPPED; i++) {
+			do {
+				txn = atxn_begin();
+				ASSERT(txn != NULL);
+				a = atxn_load(txn, &rcp1);
+				b = atxn_load(txn, &rcp2);
+				na = new_counter(counter_value(a) + 1);
+				nb = new_counter(counter_value(b) + 1);
+				ASSERT(na != NULL && nb != NULL);
+				atxn_store(txn, &rcp1, na);
+				atxn_store(txn, &rcp2, nb);
+				arcp_release(a);
+				arcp_release(b);
+				arcp_release(na);
+				arcp_release(nb);
+			} while (!atxn_commit(txn));
+		}
+		ak_ldadd(&ndone, 1, mo_relaxed);
+	} END_WITH_THREADS(NTHREADS);
+	CHECKPOINT();
+	region = arcp_load(&rcp2);
+	ASSERT(counter_value(region) == NTHREADS / 2 * NSWAPPED);
+	arcp_release(region);
+	CHECKPOINT();
+	/* every displaced value and descriptor was given back */
+	arcp_store(&rcp1, NULL);
+	arcp_store(&rcp2, NULL);
+	ASSERT(ak_load(&live_counters, mo_relaxed) == 0);
+	arcp_release(region3);
+}
+
+int run_txn_h_test_suite() {
+	int r;
+	void (*atxn_tests[])() = { test_atxn_commit, test_atxn_fail,
+				   test_atxn_multithread, test_atxn_writers,
+				   test_atxn_swappers, NULL };
+	char *atxn_test_names[] = { "atxn_commit", "atxn_fail",
+				    "atxn_multithread", "atxn_writers",
+				    "atxn_swappers", NULL };
+
+	r = run_test_suite(test_atxn_fixture, atxn_test_names, atxn_tests);
+	if (r != 0) {
+		return r;
+	}
+
+	return 0;
+}